@@ -46,32 +46,54 @@ typedef struct operator_array_t
 	size_t capacity;
 	} OperatorArray,*OperatorArrayPtr;
 
-#define CAST_ARRAY(p) ((OperatorArrayPtr)p->_priv)
+/** one path per character, parsed once by HersheyNew. Read-only after, so a Hershey can be shared by threads */
+#define HERSHEY_GLYPH_COUNT 256
+typedef struct hershey_glyphs_t
+	{
+	OperatorArray glyphs[HERSHEY_GLYPH_COUNT];
+	} HersheyGlyphs,*HersheyGlyphsPtr;
+
+#define CAST_GLYPHS(p) ((HersheyGlyphsPtr)p->_priv)
+
+static int charToPathOp(char letter,OperatorArrayPtr array);
 
 HersheyPtr HersheyNew()
 	{
-	OperatorArrayPtr array;
+	int c;
+	HersheyGlyphsPtr glyphs;
 	HersheyPtr p=(HersheyPtr)calloc(1,sizeof(Hershey));
 	if(p==NULL) return NULL;
-	array = (OperatorArrayPtr)calloc(1,sizeof(OperatorArray));
-	if(array==NULL)
+	glyphs = (HersheyGlyphsPtr)calloc(1,sizeof(HersheyGlyphs));
+	if(glyphs==NULL)
 		{
 		free(p);
-		return p;
+		return NULL;
 		}
-	p->_priv=array;
+	p->_priv=glyphs;
 	p->scalex=10.0;
 	p->scaley=10.0;
+	for(c=0;c< HERSHEY_GLYPH_COUNT;++c)
+		{
+		if(charToPathOp((char)c,&(glyphs->glyphs[c]))!=0)
+			{
+			HersheyFree(p);
+			return NULL;
+			}
+		}
 	return p;
 	}
 
 void HersheyFree(HersheyPtr p)
 	{
+	int c;
 	if(p==NULL) return;
 	if(p->_priv!=NULL)
 		{
-		free(CAST_ARRAY(p)->data);
-		free(CAST_ARRAY(p));
+		for(c=0;c< HERSHEY_GLYPH_COUNT;++c)
+			{
+			free(CAST_GLYPHS(p)->glyphs[c].data);
+			}
+		free(CAST_GLYPHS(p));
 		}
 	free(p);
 	}
@@ -148,14 +170,15 @@ static const char* charToHersheyString(char c)
 		};
 	
 	
-static void charToPathOp(HersheyPtr ptr,char letter)
+/** parse the Hershey string of 'letter' into 'array'. returns 0 on success */
+static int charToPathOp(char letter,OperatorArrayPtr array)
 		{
 		size_t i;
-		CAST_ARRAY(ptr)->size=0UL;
-		if(letter==' ') return ;
+		array->size=0UL;
+		if(letter==' ') return 0;
 		const char* s= charToHersheyString(letter);
 		
-		if(s==NULL) return;
+		if(s==NULL) return 0;
 		
 		int num_vertices=0;
 		for( i=0;i< 3;++i)
@@ -170,18 +193,18 @@ static void charToPathOp(HersheyPtr ptr,char letter)
 		
 		while(nop<num_vertices)
 			{
-			if( CAST_ARRAY(ptr)->size +1 >= CAST_ARRAY(ptr)->capacity)
+			if( array->size +1 >= array->capacity)
 				{
-				CAST_ARRAY(ptr)->capacity += 100;
-				CAST_ARRAY(ptr)->data = (OperatorPtr)realloc(
-						CAST_ARRAY(ptr)->data,
-						sizeof(Operator)*(CAST_ARRAY(ptr)->capacity)
+				array->capacity += 100;
+				array->data = (OperatorPtr)realloc(
+						array->data,
+						sizeof(Operator)*(array->capacity)
 						);
-				if( CAST_ARRAY(ptr)->data==NULL) return;
+				if( array->data==NULL) return -1;
 				}
-			OperatorPtr pathOp=&(CAST_ARRAY(ptr)->data[CAST_ARRAY(ptr)->size]);
+			OperatorPtr pathOp=&(array->data[array->size]);
 
-			pathOp->operator=(CAST_ARRAY(ptr)->size==0? MOVETO: LINETO);
+			pathOp->operator=(array->size==0? MOVETO: LINETO);
 			char c=s[i++];
 			if(c==' ')
 				{
@@ -196,8 +219,9 @@ static void charToPathOp(HersheyPtr ptr,char letter)
 			pathOp->y=c-'R';
 			nop++;
 			
-			CAST_ARRAY(ptr)->size++;
+			array->size++;
 			}
+		return 0;
 		};
 
 
@@ -215,16 +239,19 @@ void HersheyPaint(
 	
 	size_t i=0,n;
 	double dx=width/s_length;
+	/* the cached glyphs are replayed with this transform */
+	double sx=dx/ptr->scalex;
+	double sy=height/ptr->scaley;
+	double y0=y+height/2.0;
 	for(i=0;i < s_length;++i)
 		{
-		OperatorArrayPtr array;
-		charToPathOp(ptr,s[i]);
-		array=CAST_ARRAY(ptr);
+		const OperatorArrayPtr array=&(CAST_GLYPHS(ptr)->glyphs[(unsigned char)s[i]]);
+		double x0=x+dx*i+dx/2.0;
 		for(n=0;n< array->size;++n)
 			{
-			OperatorPtr p2= &array->data[n];
-			double x2= x+ (p2->x/ptr->scalex)*dx + dx*i +dx/2.0;
-			double y2= y+ (p2->y/ptr->scaley)*height +height/2.0 ;
+			const OperatorPtr p2= &array->data[n];
+			double x2= x0+ p2->x*sx;
+			double y2= y0+ p2->y*sy;
 			
 			if(p2->operator == LINETO)
 				{
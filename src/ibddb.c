@@ -27,9 +27,26 @@ THE SOFTWARE.
 #include <inttypes.h>
 #include <assert.h>
 #include <math.h>
-
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <arpa/inet.h>
+
+#include <cairo-svg.h>
+#include <cairo-pdf.h>
 #include "ibddb.h"
 #include "hershey.h"
+#include "ibdkernel.h"
 
 #define DATASET_DICTIONARY "/dictionary"
 #define DATASET_PAIRS "/pairs"
@@ -37,7 +54,10 @@ THE SOFTWARE.
 #define DATASET_MARKERS "/markers"
 #define DATASET_PEDIGREE "/pedigree"
 #define DATASET_RESKIN "/reskin"
+#define DATASET_SNAPSHOT "/snapshot"
 #define DEFAULT_TRESHOLD_LIMIT 0.1f
+/** max number of bytes read from '/ibd' in one block when exporting or scanning the matrix */
+#define IBD_READ_BLOCK_SIZE (16*1024*1024)
 static const float IBD_UNDEFINED=-9999.99f;
 
 
@@ -162,10 +182,571 @@ static int PairIndiCompare(const void* a,const void *b)
 	return i->indi2idx - j->indi2idx;
 	}
 
+/** names of the RELATIONSHIP_* */
+static const char* RELATIONSHIP_NAMES[RELATIONSHIP_COUNT]={
+	"unrelated","self","parent-offspring","full-sibs","second-degree","third-degree","distant"
+	};
+
+/** local index of the parent 'name' in the family [fam_start,fam_end[ of the sorted pedigree, or -1 */
+static int findParentInFamily(ContextPtr ctx,size_t fam_start,size_t fam_end,const char* name)
+	{
+	IndividualPtr found;
+	Individual key;
+	if(name==NULL) return -1;
+	key.family=ctx->individuals[fam_start].family;
+	key.name=(char*)name;
+	found=(IndividualPtr)bsearch(
+		(const void*)&key,
+		&ctx->individuals[fam_start],
+		fam_end-fam_start,
+		sizeof(Individual),
+		IndividualCompareByFamName
+		);
+	return (found==NULL?-1:(int)(found-&ctx->individuals[fam_start]));
+	}
+
+/** relationship class of the individuals 'a' and 'b' of a family */
+static int pairRelationship(int a,int b,const int* father,const int* mother,double kinship)
+	{
+	int degree;
+	if(a==b) return RELATIONSHIP_SELF;
+	if(father[a]==b || mother[a]==b || father[b]==a || mother[b]==a) return RELATIONSHIP_PARENT_OFFSPRING;
+	if(father[a]>=0 && mother[a]>=0 && father[a]==father[b] && mother[a]==mother[b]) return RELATIONSHIP_FULL_SIBS;
+	if(kinship<=0.0) return RELATIONSHIP_UNRELATED;
+	/* kinship 1/4 for the first degree, 1/8 for the second degree... */
+	degree=(int)floor(-log2(kinship)+0.5)-1;
+	if(degree<=2) return RELATIONSHIP_SECOND_DEGREE;
+	if(degree==3) return RELATIONSHIP_THIRD_DEGREE;
+	return RELATIONSHIP_DISTANT;
+	}
+
+/**
+ * compute the kinship coefficient and the relationship class of the pairs from the pedigree
+ * (ctx->individuals must be sorted on family/name). For each family, the kinship matrix is filled
+ * with the recursive formula, the parents being visited before their children:
+ * phi(a,a)=(1+phi(father,mother))/2 and phi(a,b)=(phi(father,b)+phi(mother,b))/2.
+ * Two individuals of different families are unrelated.
+ */
+static void computePairKinship(ContextPtr ctx)
+	{
+	size_t i,fam_start,n_families=0UL;
+	size_t* family_of=(size_t*)safeCalloc(MAX(1,ctx->individual_count),sizeof(size_t));
+	size_t* family_pairs;
+	size_t* pair_order=(size_t*)safeCalloc(MAX(1,ctx->pair_count),sizeof(size_t));
+	
+	DEBUG("Computing the kinship of %zu pairs",ctx->pair_count);
+	for(i=0;i< ctx->individual_count;++i)
+		{
+		if(i>0 && strcmp(ctx->individuals[i-1].family,ctx->individuals[i].family)!=0) n_families++;
+		family_of[i]=n_families;
+		}
+	/* the pairs sorted on the family of their first individual: family f is [family_pairs[f],family_pairs[f+1][ */
+	family_pairs=(size_t*)safeCalloc(n_families+2,sizeof(size_t));
+	for(i=0;i< ctx->pair_count;++i)
+		{
+		PairIndiPtr pair=&ctx->pairs[i];
+		pair->kinship=0.0f;
+		pair->relationship=RELATIONSHIP_UNRELATED;
+		family_pairs[family_of[pair->indi1idx]+1]++;
+		}
+	for(i=0;i<= n_families;++i) family_pairs[i+1]+=family_pairs[i];
+	for(i=0;i< ctx->pair_count;++i) pair_order[family_pairs[family_of[ctx->pairs[i].indi1idx]]++]=i;
+	for(i=n_families+1;i>0;--i) family_pairs[i]=family_pairs[i-1];
+	family_pairs[0]=0UL;
+	
+	for(fam_start=0;fam_start< ctx->individual_count;)
+		{
+		size_t f=family_of[fam_start],fam_end=fam_start,n,t,u,pass;
+		int* father;
+		int* mother;
+		int* depth;
+		size_t* order;
+		size_t* depth_count;
+		double* phi;
+		while(fam_end< ctx->individual_count && family_of[fam_end]==f) fam_end++;
+		n=fam_end-fam_start;
+		if(family_pairs[f]==family_pairs[f+1])
+			{
+			fam_start=fam_end;
+			continue;
+			}
+		father=(int*)safeCalloc(n,sizeof(int));
+		mother=(int*)safeCalloc(n,sizeof(int));
+		depth=(int*)safeCalloc(n,sizeof(int));
+		order=(size_t*)safeCalloc(n,sizeof(size_t));
+		depth_count=(size_t*)safeCalloc(n+1,sizeof(size_t));
+		phi=(double*)safeCalloc(n*n,sizeof(double));
+		for(t=0;t< n;++t)
+			{
+			father[t]=findParentInFamily(ctx,fam_start,fam_end,ctx->individuals[fam_start+t].father);
+			mother[t]=findParentInFamily(ctx,fam_start,fam_end,ctx->individuals[fam_start+t].mother);
+			}
+		/* generation of each individual, the parents have a lower generation */
+		for(pass=0;;++pass)
+			{
+			boolean_t changed=FALSE;
+			for(t=0;t< n;++t)
+				{
+				int d=0;
+				if(father[t]>=0) d=MAX(d,depth[father[t]]+1);
+				if(mother[t]>=0) d=MAX(d,depth[mother[t]]+1);
+				if(d!=depth[t]) { depth[t]=d; changed=TRUE; }
+				}
+			if(!changed) break;
+			if(pass>n) DIE_FAILURE("loop in the pedigree of the family \"%s\".",ctx->individuals[fam_start].family);
+			}
+		/* counting sort on generation */
+		for(t=0;t< n;++t) depth_count[depth[t]+1]++;
+		for(t=0;t< n;++t) depth_count[t+1]+=depth_count[t];
+		for(t=0;t< n;++t) order[depth_count[depth[t]]++]=t;
+		/* kinship matrix */
+		for(t=0;t< n;++t)
+			{
+			size_t a=order[t];
+			int fa=father[a],mo=mother[a];
+			for(u=0;u< t;++u)
+				{
+				size_t b=order[u];
+				double v=0.5*((fa>=0?phi[fa*n+b]:0.0)+(mo>=0?phi[mo*n+b]:0.0));
+				phi[a*n+b]=v;
+				phi[b*n+a]=v;
+				}
+			phi[a*n+a]=0.5*(1.0+(fa>=0 && mo>=0?phi[fa*n+mo]:0.0));
+			}
+		for(t=family_pairs[f];t< family_pairs[f+1];++t)
+			{
+			PairIndiPtr pair=&ctx->pairs[pair_order[t]];
+			size_t a=(size_t)pair->indi1idx-fam_start,b;
+			if(family_of[pair->indi2idx]!=f) continue;
+			b=(size_t)pair->indi2idx-fam_start;
+			pair->kinship=(float)phi[a*n+b];
+			pair->relationship=pairRelationship((int)a,(int)b,father,mother,phi[a*n+b]);
+			}
+		free(phi);
+		free(depth_count);
+		free(order);
+		free(depth);
+		free(mother);
+		free(father);
+		fam_start=fam_end;
+		}
+	free(family_pairs);
+	free(pair_order);
+	free(family_of);
+	}
+
+/** compute the kinship of the pairs if the database was built before the kinship was stored in DATASET_PAIRS */
+static void ensurePairKinship(ContextPtr ctx)
+	{
+	if(ctx->pair_count==0 || ctx->pairs[0].relationship!=RELATIONSHIP_UNKNOWN) return;
+	if(ctx->individuals==NULL) DIE_FAILURE("the pedigree is required to compute the kinship.");
+	computePairKinship(ctx);
+	}
+
 /**
  * Read IBD data
  *
  */
+/** write a 1-dimension dataset of 'n' compound items */
+static void writeCompoundDataset(ContextPtr ctx,const char* name,hid_t type,size_t n,const void* items)
+	{
+	hsize_t  dims[1] = {n};
+	hid_t dataspace_id = VERIFY(H5Screate_simple (1,dims, NULL));
+	hid_t dataset_id = VERIFY(H5Dcreate2(
+			ctx->file_id,
+			name,
+			type,
+			dataspace_id,
+			H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+	if(n>0)
+		{
+		VERIFY(H5Dwrite(
+			dataset_id,
+			type,
+			H5S_ALL, H5S_ALL, H5P_DEFAULT,
+			items
+			));
+		}
+	VERIFY(H5Dclose(dataset_id));
+	VERIFY(H5Sclose(dataspace_id));
+	}
+
+/** write ctx->pairs in DATASET_PAIRS */
+static void writePairs(ContextPtr ctx)
+	{
+	hid_t pairtype = H5Tcreate (H5T_COMPOUND, sizeof (PairIndi));
+	H5Tinsert(pairtype, "indi1idx", HOFFSET(PairIndi, indi1idx), H5T_NATIVE_INT);
+	H5Tinsert(pairtype, "indi2idx", HOFFSET(PairIndi, indi2idx), H5T_NATIVE_INT);
+	H5Tinsert(pairtype, "index", HOFFSET(PairIndi, index), H5T_NATIVE_INT);
+	H5Tinsert(pairtype, "kinship", HOFFSET(PairIndi, kinship), H5T_NATIVE_FLOAT);
+	H5Tinsert(pairtype, "relationship", HOFFSET(PairIndi, relationship), H5T_NATIVE_INT);
+	writeCompoundDataset(ctx,DATASET_PAIRS,pairtype,ctx->pair_count,ctx->pairs);
+	H5Tclose(pairtype);
+	}
+
+/** write ctx->individuals in DATASET_PEDIGREE */
+static void writePedigree(ContextPtr ctx)
+	{
+	hid_t strtype = H5Tcopy(H5T_C_S1);
+	hid_t pedigreetype = H5Tcreate (H5T_COMPOUND, sizeof (Individual));
+	H5Tset_size (strtype, H5T_VARIABLE);
+	H5Tinsert(pedigreetype, "family", HOFFSET(Individual, family), strtype);
+	H5Tinsert(pedigreetype, "name", HOFFSET(Individual, name), strtype);
+	H5Tinsert(pedigreetype, "father", HOFFSET(Individual, father), strtype);
+	H5Tinsert(pedigreetype, "mother", HOFFSET(Individual, mother), strtype);
+	H5Tinsert(pedigreetype, "sex", HOFFSET(Individual, sex), H5T_NATIVE_INT);
+	H5Tinsert(pedigreetype, "status", HOFFSET(Individual, status), H5T_NATIVE_INT);
+	H5Tinsert(pedigreetype, "index", HOFFSET(Individual, index), H5T_NATIVE_INT);
+	writeCompoundDataset(ctx,DATASET_PEDIGREE,pedigreetype,ctx->individual_count,ctx->individuals);
+	H5Tclose (strtype);
+	H5Tclose(pedigreetype);
+	}
+
+/** write ctx->markers in DATASET_MARKERS */
+static void writeMarkers(ContextPtr ctx)
+	{
+	hid_t strtype = H5Tcopy(H5T_C_S1);
+	hid_t markertype = H5Tcreate (H5T_COMPOUND, sizeof (Marker));
+	H5Tset_size (strtype, H5T_VARIABLE);
+	H5Tinsert(markertype, "name", HOFFSET(Marker, name), strtype);
+	H5Tinsert(markertype, "tid", HOFFSET(Marker, tid), H5T_NATIVE_INT);
+	H5Tinsert(markertype, "position", HOFFSET(Marker, position), H5T_NATIVE_INT);
+	H5Tinsert(markertype, "index", HOFFSET(Marker, index), H5T_NATIVE_INT);
+	writeCompoundDataset(ctx,DATASET_MARKERS,markertype,ctx->marker_count,ctx->markers);
+	H5Tclose (strtype);
+	H5Tclose(markertype);
+	}
+
+/** write ctx->chromosomes in DATASET_DICTIONARY */
+static void writeDictionary(ContextPtr ctx)
+	{
+	hid_t strtype = H5Tcopy(H5T_C_S1);
+	hid_t chromtype = H5Tcreate (H5T_COMPOUND, sizeof (Chrom));
+	H5Tset_size (strtype, H5T_VARIABLE);
+	H5Tinsert(chromtype, "name", HOFFSET(Chrom, name), strtype);
+	H5Tinsert(chromtype, "tid", HOFFSET(Chrom, tid), H5T_NATIVE_INT);
+	H5Tinsert(chromtype, "length", HOFFSET(Chrom, length), H5T_NATIVE_INT);
+	writeCompoundDataset(ctx,DATASET_DICTIONARY,chromtype,ctx->chromosome_count,ctx->chromosomes);
+	H5Tclose (strtype);
+	H5Tclose(chromtype);
+	}
+
+/** sort ctx->reskins on pair and write them in DATASET_RESKIN. Nothing is written if there is no reskin */
+static void writeReskins(ContextPtr ctx)
+	{
+	hsize_t  array_dim[1] = {RESKIN_COLUMN_COUNT};
+	hid_t array_dt,reskintype;
+	if( ctx->reskin_count == 0) return;
+	array_dt = H5Tarray_create2(H5T_NATIVE_FLOAT, 1, array_dim);
+	reskintype = H5Tcreate (H5T_COMPOUND, sizeof (Reskin));
+	H5Tinsert(reskintype, "pair_id", HOFFSET(Reskin, pair_id), H5T_NATIVE_INT);
+	H5Tinsert(reskintype, "data", HOFFSET(Reskin, data),array_dt);
+	qsort(
+		(void*)ctx->reskins,
+		ctx->reskin_count,
+		sizeof (Reskin),
+		ReskinCompareByPairId
+		);
+	writeCompoundDataset(ctx,DATASET_RESKIN,reskintype,ctx->reskin_count,ctx->reskins);
+	H5Tclose(array_dt);
+	H5Tclose(reskintype);
+	}
+
+/** create the dataset DATASET_IBD [marker_count][pair_count][3] filled with IBD_UNDEFINED */
+static hid_t createIbdDataset(ContextPtr ctx)
+	{
+	hsize_t  dims[3] = {ctx->marker_count,ctx->pair_count,3};
+	hid_t plistid=VERIFY(H5Pcreate(H5P_DATASET_CREATE));
+	hid_t dataspace_id = VERIFY(H5Screate_simple (3,dims, NULL));
+	hid_t dataset_id;
+	/** set default fill status */
+	VERIFY(H5Pset_fill_value(plistid, H5T_NATIVE_FLOAT, &IBD_UNDEFINED));
+	dataset_id = VERIFY(H5Dcreate2(
+			ctx->file_id,
+			DATASET_IBD,
+			H5T_NATIVE_FLOAT,
+			dataspace_id,
+			H5P_DEFAULT,
+			plistid,
+			H5P_DEFAULT));
+	VERIFY(H5Sclose(dataspace_id));
+	VERIFY(H5Pclose(plistid));
+	return dataset_id;
+	}
+
+/**
+ * the metadata snapshot: a copy of /dictionary, /markers, /pedigree and /pairs stored as an opaque
+ * array of bytes (DATASET_SNAPSHOT) that can be mapped without decoding the compound datasets.
+ * A header is followed by 8-bytes-aligned sections of fixed-size values (one array per field)
+ * and a blob of nul-terminated strings. The strings are offsets in the blob.
+ * Since version 3, the sections are split in 'units' (the dictionary, the pedigree, the pairs and the markers
+ * of each chromosome) having their own crc32, so a unit is only checked when it is loaded.
+ */
+#define SNAPSHOT_MAGIC "IBDSNAP"
+/* version 2: kinship and relationship of the pairs */
+/* version 3: first marker of each chromosome and one checksum per unit */
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+#define SNAPSHOT_NO_STRING UINT64_MAX
+/* units of a snapshot: the markers of the chromosome 'tid' are the unit SNAPSHOT_UNIT_MARKERS+tid */
+#define SNAPSHOT_UNIT_DICT 0
+#define SNAPSHOT_UNIT_PEDIGREE 1
+#define SNAPSHOT_UNIT_PAIRS 2
+#define SNAPSHOT_UNIT_MARKERS 3
+
+typedef struct snapshot_header_t
+	{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t chromosome_count;
+	uint64_t marker_count;
+	uint64_t individual_count;
+	uint64_t pair_count;
+	uint64_t blob_size;
+	/** crc32 of the bytes after the header (version<3) or of the section 'unit_checksum' */
+	uint32_t checksum;
+	/** version>=3: crc32 of the header with header_checksum=0 */
+	uint32_t header_checksum;
+	} SnapshotHeader,*SnapshotHeaderPtr;
+
+/** offsets of the sections of a snapshot */
+typedef struct snapshot_layout_t
+	{
+	size_t chrom_length,chrom_name;
+	size_t marker_tid,marker_position,marker_name;
+	size_t indi_family,indi_name,indi_father,indi_mother,indi_sex,indi_status;
+	size_t pair_indi1,pair_indi2,pair_kinship,pair_relationship;
+	/** version>=3: first marker and first marker name in the blob of each chromosome (chromosome_count+1 items), crc32 of each unit */
+	size_t chrom_marker_offset,chrom_blob_offset,unit_checksum;
+	size_t blob;
+	size_t size;
+	} SnapshotLayout,*SnapshotLayoutPtr;
+
+static void snapshotLayout(const SnapshotHeaderPtr h,SnapshotLayoutPtr L)
+	{
+	size_t o=sizeof(SnapshotHeader);
+#define SNAPSHOT_SECTION(field,n,type) L->field=o; o+=(((size_t)(n)*sizeof(type))+7UL)&~((size_t)7UL)
+	SNAPSHOT_SECTION(chrom_length,h->chromosome_count,int32_t);
+	SNAPSHOT_SECTION(chrom_name,h->chromosome_count,uint64_t);
+	SNAPSHOT_SECTION(marker_tid,h->marker_count,int32_t);
+	SNAPSHOT_SECTION(marker_position,h->marker_count,int32_t);
+	SNAPSHOT_SECTION(marker_name,h->marker_count,uint64_t);
+	SNAPSHOT_SECTION(indi_family,h->individual_count,uint64_t);
+	SNAPSHOT_SECTION(indi_name,h->individual_count,uint64_t);
+	SNAPSHOT_SECTION(indi_father,h->individual_count,uint64_t);
+	SNAPSHOT_SECTION(indi_mother,h->individual_count,uint64_t);
+	SNAPSHOT_SECTION(indi_sex,h->individual_count,int32_t);
+	SNAPSHOT_SECTION(indi_status,h->individual_count,int32_t);
+	SNAPSHOT_SECTION(pair_indi1,h->pair_count,int32_t);
+	SNAPSHOT_SECTION(pair_indi2,h->pair_count,int32_t);
+	L->pair_kinship=0UL;
+	L->pair_relationship=0UL;
+	if(h->version>=2)
+		{
+		SNAPSHOT_SECTION(pair_kinship,h->pair_count,float);
+		SNAPSHOT_SECTION(pair_relationship,h->pair_count,int32_t);
+		}
+	L->chrom_marker_offset=0UL;
+	L->chrom_blob_offset=0UL;
+	L->unit_checksum=0UL;
+	if(h->version>=3)
+		{
+		SNAPSHOT_SECTION(chrom_marker_offset,h->chromosome_count+1,uint64_t);
+		SNAPSHOT_SECTION(chrom_blob_offset,h->chromosome_count+1,uint64_t);
+		SNAPSHOT_SECTION(unit_checksum,h->chromosome_count+SNAPSHOT_UNIT_MARKERS,uint32_t);
+		}
+	SNAPSHOT_SECTION(blob,h->blob_size,char);
+#undef SNAPSHOT_SECTION
+	L->size=o;
+	}
+
+/** update 'crc' with 'size' bytes, by blocks because crc32() takes an 'uInt' length */
+static uLong snapshotCrc(uLong crc,const unsigned char* buffer,size_t size)
+	{
+	size_t i=0UL;
+	while(i< size)
+		{
+		size_t n=MIN(size-i,(size_t)(1UL<<30));
+		crc=crc32(crc,&buffer[i],(uInt)n);
+		i+=n;
+		}
+	return crc;
+	}
+
+/** crc32 of the bytes after the header (version<3) */
+static uint32_t snapshotChecksum(const unsigned char* buffer,size_t size)
+	{
+	return (uint32_t)snapshotCrc(crc32(0L,Z_NULL,0),&buffer[sizeof(SnapshotHeader)],size-sizeof(SnapshotHeader));
+	}
+
+/** crc32 of the header with header_checksum=0 (version>=3) */
+static uint32_t snapshotHeaderChecksum(const SnapshotHeaderPtr h)
+	{
+	SnapshotHeader copy;
+	memcpy((void*)&copy,(const void*)h,sizeof(SnapshotHeader));
+	copy.header_checksum=0U;
+	return (uint32_t)snapshotCrc(crc32(0L,Z_NULL,0),(const unsigned char*)&copy,sizeof(SnapshotHeader));
+	}
+
+/** crc32 of a unit (version>=3). The unit of a chromosome uses the offsets of the dictionary: check SNAPSHOT_UNIT_DICT first */
+static uint32_t snapshotUnitChecksum(const unsigned char* buffer,const SnapshotHeaderPtr h,const SnapshotLayoutPtr L,size_t unit)
+	{
+	uLong crc=crc32(0L,Z_NULL,0);
+	const uint64_t* marker_offsets=(const uint64_t*)&buffer[L->chrom_marker_offset];
+	const uint64_t* blob_offsets=(const uint64_t*)&buffer[L->chrom_blob_offset];
+	switch(unit)
+		{
+		case SNAPSHOT_UNIT_DICT:
+			crc=snapshotCrc(crc,&buffer[L->chrom_length],L->marker_tid-L->chrom_length);
+			crc=snapshotCrc(crc,&buffer[L->chrom_marker_offset],L->unit_checksum-L->chrom_marker_offset);
+			crc=snapshotCrc(crc,&buffer[L->blob],MIN(blob_offsets[0],h->blob_size));
+			break;
+		case SNAPSHOT_UNIT_PEDIGREE:
+			crc=snapshotCrc(crc,&buffer[L->indi_family],L->pair_indi1-L->indi_family);
+			crc=snapshotCrc(crc,&buffer[L->blob+MIN(blob_offsets[h->chromosome_count],h->blob_size)],h->blob_size-MIN(blob_offsets[h->chromosome_count],h->blob_size));
+			break;
+		case SNAPSHOT_UNIT_PAIRS:
+			crc=snapshotCrc(crc,&buffer[L->pair_indi1],L->chrom_marker_offset-L->pair_indi1);
+			break;
+		default:
+			{
+			size_t tid=unit-SNAPSHOT_UNIT_MARKERS;
+			size_t begin=marker_offsets[tid],end=marker_offsets[tid+1];
+			assert(tid< h->chromosome_count);
+			crc=snapshotCrc(crc,&buffer[L->marker_tid+begin*sizeof(int32_t)],(end-begin)*sizeof(int32_t));
+			crc=snapshotCrc(crc,&buffer[L->marker_position+begin*sizeof(int32_t)],(end-begin)*sizeof(int32_t));
+			crc=snapshotCrc(crc,&buffer[L->marker_name+begin*sizeof(uint64_t)],(end-begin)*sizeof(uint64_t));
+			crc=snapshotCrc(crc,&buffer[L->blob+blob_offsets[tid]],blob_offsets[tid+1]-blob_offsets[tid]);
+			break;
+			}
+		}
+	return (uint32_t)crc;
+	}
+
+/** compare the crc32 of a unit with the table of a snapshot (version>=3) */
+static boolean_t snapshotUnitIsValid(const unsigned char* buffer,size_t unit)
+	{
+	SnapshotHeader header;
+	SnapshotLayout L;
+	memcpy((void*)&header,(const void*)buffer,sizeof(SnapshotHeader));
+	snapshotLayout(&header,&L);
+	return ((const uint32_t*)&buffer[L.unit_checksum])[unit]==snapshotUnitChecksum(buffer,&header,&L,unit);
+	}
+
+/** copy 's' in the blob of the snapshot and return its offset */
+static uint64_t snapshotPutString(char* blob,size_t* blob_size,const char* s)
+	{
+	uint64_t offset=(uint64_t)*blob_size;
+	size_t len;
+	if(s==NULL) return SNAPSHOT_NO_STRING;
+	len=strlen(s)+1;
+	memcpy((void*)&blob[*blob_size],(const void*)s,len);
+	*blob_size+=len;
+	return offset;
+	}
+
+/** write the metadata snapshot of ctx in DATASET_SNAPSHOT */
+static void writeSnapshot(ContextPtr ctx)
+	{
+	size_t i,t,blob_size=0UL;
+	SnapshotHeader header;
+	SnapshotLayout L;
+	unsigned char* buffer;
+	char* blob;
+	hid_t dataset_id,dataspace_id;
+	hsize_t dims[1];
+	
+	memset((void*)&header,0,sizeof(SnapshotHeader));
+	strcpy(header.magic,SNAPSHOT_MAGIC);
+	header.version=SNAPSHOT_VERSION;
+	header.byte_order=SNAPSHOT_BYTE_ORDER;
+	header.chromosome_count=ctx->chromosome_count;
+	header.marker_count=ctx->marker_count;
+	header.individual_count=ctx->individual_count;
+	header.pair_count=ctx->pair_count;
+	for(i=0;i< ctx->chromosome_count;++i) header.blob_size+=strlen(ctx->chromosomes[i].name)+1;
+	for(i=0;i< ctx->marker_count;++i) header.blob_size+=strlen(ctx->markers[i].name)+1;
+	for(i=0;i< ctx->individual_count;++i)
+		{
+		IndividualPtr indi=&ctx->individuals[i];
+		header.blob_size+=strlen(indi->family)+1+strlen(indi->name)+1;
+		if(indi->father!=NULL) header.blob_size+=strlen(indi->father)+1;
+		if(indi->mother!=NULL) header.blob_size+=strlen(indi->mother)+1;
+		}
+	snapshotLayout(&header,&L);
+	buffer=(unsigned char*)safeCalloc(L.size,1);
+	blob=(char*)&buffer[L.blob];
+#define SNAPSHOT_ARRAY(type,field) ((type*)&buffer[L.field])
+	for(i=0;i< ctx->chromosome_count;++i)
+		{
+		SNAPSHOT_ARRAY(int32_t,chrom_length)[i]=ctx->chromosomes[i].length;
+		SNAPSHOT_ARRAY(uint64_t,chrom_name)[i]=snapshotPutString(blob,&blob_size,ctx->chromosomes[i].name);
+		}
+	/* the markers are sorted on 'tid': first marker and first name of each chromosome */
+	for(i=0;i< ctx->marker_count;++i)
+		{
+		assert(ctx->markers[i].tid>=0 && (size_t)ctx->markers[i].tid< ctx->chromosome_count);
+		assert(i==0 || ctx->markers[i-1].tid<=ctx->markers[i].tid);
+		SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[ctx->markers[i].tid+1]++;
+		}
+	for(i=0;i< ctx->chromosome_count;++i)
+		{
+		SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[i+1]+=SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[i];
+		}
+	for(t=0;t< ctx->chromosome_count;++t)
+		{
+		SNAPSHOT_ARRAY(uint64_t,chrom_blob_offset)[t]=blob_size;
+		for(i=SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[t];i< SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[t+1];++i)
+			{
+			SNAPSHOT_ARRAY(int32_t,marker_tid)[i]=ctx->markers[i].tid;
+			SNAPSHOT_ARRAY(int32_t,marker_position)[i]=ctx->markers[i].position;
+			SNAPSHOT_ARRAY(uint64_t,marker_name)[i]=snapshotPutString(blob,&blob_size,ctx->markers[i].name);
+			}
+		}
+	SNAPSHOT_ARRAY(uint64_t,chrom_blob_offset)[ctx->chromosome_count]=blob_size;
+	for(i=0;i< ctx->individual_count;++i)
+		{
+		IndividualPtr indi=&ctx->individuals[i];
+		SNAPSHOT_ARRAY(uint64_t,indi_family)[i]=snapshotPutString(blob,&blob_size,indi->family);
+		SNAPSHOT_ARRAY(uint64_t,indi_name)[i]=snapshotPutString(blob,&blob_size,indi->name);
+		SNAPSHOT_ARRAY(uint64_t,indi_father)[i]=snapshotPutString(blob,&blob_size,indi->father);
+		SNAPSHOT_ARRAY(uint64_t,indi_mother)[i]=snapshotPutString(blob,&blob_size,indi->mother);
+		SNAPSHOT_ARRAY(int32_t,indi_sex)[i]=indi->sex;
+		SNAPSHOT_ARRAY(int32_t,indi_status)[i]=indi->status;
+		}
+	for(i=0;i< ctx->pair_count;++i)
+		{
+		SNAPSHOT_ARRAY(int32_t,pair_indi1)[i]=ctx->pairs[i].indi1idx;
+		SNAPSHOT_ARRAY(int32_t,pair_indi2)[i]=ctx->pairs[i].indi2idx;
+		SNAPSHOT_ARRAY(float,pair_kinship)[i]=ctx->pairs[i].kinship;
+		SNAPSHOT_ARRAY(int32_t,pair_relationship)[i]=ctx->pairs[i].relationship;
+		}
+#undef SNAPSHOT_ARRAY
+	assert(blob_size==header.blob_size);
+	for(i=0;i< ctx->chromosome_count+SNAPSHOT_UNIT_MARKERS;++i)
+		{
+		((uint32_t*)&buffer[L.unit_checksum])[i]=snapshotUnitChecksum(buffer,&header,&L,i);
+		}
+	header.checksum=(uint32_t)snapshotCrc(crc32(0L,Z_NULL,0),&buffer[L.unit_checksum],(ctx->chromosome_count+SNAPSHOT_UNIT_MARKERS)*sizeof(uint32_t));
+	header.header_checksum=snapshotHeaderChecksum(&header);
+	memcpy((void*)buffer,(void*)&header,sizeof(SnapshotHeader));
+	
+	DEBUG("Writing " DATASET_SNAPSHOT " (%zu bytes)",L.size);
+	dims[0]=L.size;
+	dataspace_id = VERIFY(H5Screate_simple (1,dims, NULL));
+	dataset_id = VERIFY(H5Dcreate2(
+			ctx->file_id,
+			DATASET_SNAPSHOT,
+			H5T_NATIVE_UINT8,
+			dataspace_id,
+			H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+	VERIFY(H5Dwrite(dataset_id,H5T_NATIVE_UINT8,H5S_ALL,H5S_ALL,H5P_DEFAULT,buffer));
+	VERIFY(H5Dclose(dataset_id));
+	VERIFY(H5Sclose(dataspace_id));
+	free(buffer);
+	}
+
 static void readIbd(ContextPtr ctx)
 	{
 	
@@ -301,58 +882,17 @@ static void readIbd(ContextPtr ctx)
 		{
 		ctx->pairs[i].index=(int)i;
 		}
+	computePairKinship(ctx);
 	
 	/* insert pairs in HDF5 */
-	{
-	 hsize_t  dims[1] = {ctx->pair_count};
-
-	int pairtype = H5Tcreate (H5T_COMPOUND, sizeof (PairIndi));
-        H5Tinsert(pairtype, "indi1idx", HOFFSET(PairIndi, indi1idx), H5T_NATIVE_INT);
- 	H5Tinsert(pairtype, "indi2idx", HOFFSET(PairIndi, indi2idx), H5T_NATIVE_INT);
-	H5Tinsert(pairtype, "index", HOFFSET(PairIndi, index), H5T_NATIVE_INT);
-	
-	
-
-	 /* Create the data space for the dataset. */
-	int dataspace_id =  H5Screate_simple (1,dims, NULL);
-	/* create dataset */
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_PAIRS,
-			  pairtype,
-			  dataspace_id, 
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	 H5Dwrite(
-			dataset_id,
-			pairtype,
-			H5S_ALL, H5S_ALL, H5P_DEFAULT,
-			ctx->pairs
-			);
-
-	H5Dclose(dataset_id);
-	H5Sclose(dataspace_id);
-	H5Tclose(pairtype);
-	}	
+	writePairs(ctx);
 
 	/** insert the data */
 	{
-	hid_t plistid;
 	hsize_t  dims_memory[3]={1,1,3};
-	hsize_t  dims[3] = {ctx->marker_count,ctx->pair_count,3};
 	hid_t  memspace  = H5Screate_simple(3, dims_memory, NULL); 
-	/** set default fill status */
-	plistid=VERIFY(H5Pcreate(H5P_DATASET_CREATE));
-	VERIFY(H5Pset_fill_value(plistid, H5T_NATIVE_FLOAT, &IBD_UNDEFINED));
-
-	int dataspace_id =  H5Screate_simple (3,dims, NULL);
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_IBD,
-			  H5T_NATIVE_FLOAT,
-			  dataspace_id, 
-                          H5P_DEFAULT,
-			  plistid	,//H5P_DEFAULT,
-			  H5P_DEFAULT);
+	hid_t dataset_id = createIbdDataset(ctx);
+	hid_t dataspace_id = VERIFY(H5Dget_space(dataset_id));
 	
 	
 	in1=safeGZOpen(ctx->ibd_filename,"r");
@@ -566,7 +1106,6 @@ static void readIbd(ContextPtr ctx)
 		free(ibd_markers_id);	
 		}
 	gzclose(in1);
-	H5Pclose(plistid);
 	H5Sclose(memspace);
 	H5Dclose(dataset_id);
 	H5Sclose(dataspace_id);
@@ -626,44 +1165,7 @@ static void readPed(ContextPtr ctx)
 		);
 	for(i=0;i< ctx->individual_count;++i) ctx->individuals[i].index=i;
 
-	
-	{
-	 hsize_t  dims[1] = {ctx->individual_count};
-	int   strtype = H5Tcopy(H5T_C_S1);
-	H5Tset_size (strtype, H5T_VARIABLE);
-	
-	int pedigreetype = H5Tcreate (H5T_COMPOUND, sizeof (Individual));
-	H5Tinsert(pedigreetype, "family", HOFFSET(Individual, family), strtype);
-	H5Tinsert(pedigreetype, "name", HOFFSET(Individual, name), strtype);
-	H5Tinsert(pedigreetype, "father", HOFFSET(Individual, father), strtype);
-	H5Tinsert(pedigreetype, "mother", HOFFSET(Individual, mother), strtype);
-        H5Tinsert(pedigreetype, "sex", HOFFSET(Individual, sex), H5T_NATIVE_INT);
- 	H5Tinsert(pedigreetype, "status", HOFFSET(Individual, status), H5T_NATIVE_INT);
-	H5Tinsert(pedigreetype, "index", HOFFSET(Individual, index), H5T_NATIVE_INT);
-	
-	
-
-	 /* Create the data space for the dataset. */
-	int dataspace_id =  H5Screate_simple (1,dims, NULL);
-	/* create dataset */
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_PEDIGREE,
-			  pedigreetype,
-			  dataspace_id, 
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	 H5Dwrite(
-			dataset_id,
-			pedigreetype,
-			H5S_ALL, H5S_ALL, H5P_DEFAULT,
-			ctx->individuals
-			);
-
-	H5Tclose (strtype);
-	H5Dclose(dataset_id);
-	H5Sclose(dataspace_id);
-	H5Tclose(pedigreetype);
-	}
+	writePedigree(ctx);
 
 	}
 
@@ -736,40 +1238,7 @@ static void readBed(ContextPtr ctx)
 		);
 	for(i=0;i< ctx->marker_count;++i) ctx->markers[i].index=i;
 	
-	{
-	 hsize_t  dims[1] = {ctx->marker_count};
-	int   strtype = H5Tcopy(H5T_C_S1);
-	H5Tset_size (strtype, H5T_VARIABLE);
-	
-	int markertype = H5Tcreate (H5T_COMPOUND, sizeof (Marker));
-	H5Tinsert(markertype, "name", HOFFSET(Marker, name), strtype);
-        H5Tinsert(markertype, "tid", HOFFSET(Marker, tid), H5T_NATIVE_INT);
- 	H5Tinsert(markertype, "position", HOFFSET(Marker, position), H5T_NATIVE_INT);
-	H5Tinsert(markertype, "index", HOFFSET(Marker, index), H5T_NATIVE_INT);
-	
-	
-
-	 /* Create the data space for the dataset. */
-	int dataspace_id =  H5Screate_simple (1,dims, NULL);
-	/* create dataset */
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_MARKERS,
-			  markertype,
-			  dataspace_id, 
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	 H5Dwrite(
-			dataset_id,
-			markertype,
-			H5S_ALL, H5S_ALL, H5P_DEFAULT,
-			ctx->markers
-			);
-
-	H5Tclose (strtype);
-	H5Dclose(dataset_id);
-	H5Sclose(dataspace_id);
-	H5Tclose(markertype);
-	}
+	writeMarkers(ctx);
 
 
 	
@@ -825,40 +1294,7 @@ static void readFaidx(ContextPtr ctx)
 		}
 	gzclose(in);
 	
-	{
-	
-	hsize_t  dims[1] = {ctx->chromosome_count};
-	int   strtype = H5Tcopy(H5T_C_S1);
-	H5Tset_size (strtype, H5T_VARIABLE);
-	
-	hid_t chromtype = H5Tcreate (H5T_COMPOUND, sizeof (Chrom));
-	H5Tinsert(chromtype, "name", HOFFSET(Chrom, name), strtype);
-    H5Tinsert(chromtype, "tid", HOFFSET(Chrom, tid), H5T_NATIVE_INT);
- 	H5Tinsert(chromtype, "length", HOFFSET(Chrom, length), H5T_NATIVE_INT);
-	
-
-
-	 /* Create the data space for the dataset. */
-	int dataspace_id =  H5Screate_simple (1,dims, NULL);
-	/* create dataset */
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_DICTIONARY,
-			  chromtype,
-			  dataspace_id, 
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	 H5Dwrite(
-			dataset_id,
-			chromtype,
-			H5S_ALL, H5S_ALL, H5P_DEFAULT,
-			ctx->chromosomes
-			);
-
-	H5Tclose (strtype);
-	H5Dclose(dataset_id);
-	H5Sclose(dataspace_id);
-	H5Tclose(chromtype);
-	}
+	writeDictionary(ctx);
 
 
 	
@@ -930,7 +1366,7 @@ static void readReskin(ContextPtr ctx)
 					tokens[0],tokens[2]
 					); 
 				}
-			ctx->reskins = (ReskinPtr)safeRealloc( ctx->reskins, ctx->reskin_count+1);
+			ctx->reskins = (ReskinPtr)safeRealloc( ctx->reskins, (ctx->reskin_count+1)*sizeof(Reskin));
 			last = &ctx->reskins[ ctx->reskin_count ];
 			ctx->reskin_count++;
 			
@@ -960,52 +1396,10 @@ static void readReskin(ContextPtr ctx)
 			}
 		gzclose(in);
 		
-	if( ctx->reskin_count == 0) return;
+	writeReskins(ctx);
 
-	{
-	hsize_t  dims[1] = {ctx->reskin_count};
-	hsize_t  array_dim[1] = {RESKIN_COLUMN_COUNT};
-	hid_t array_dt = H5Tarray_create2(H5T_NATIVE_FLOAT, 1, array_dim);
-	
-	hid_t reskintype = H5Tcreate (H5T_COMPOUND, sizeof (Reskin));
-    H5Tinsert(reskintype, "pair_id", HOFFSET(Reskin, pair_id), H5T_NATIVE_INT);
- 	H5Tinsert(reskintype, "data", HOFFSET(Reskin, data),array_dt);
-	
-	if( ctx->reskin_count > 0 ) {
-		qsort(
-			(void*)ctx->reskins,
-			ctx->reskin_count,
-			sizeof (Reskin),
-			ReskinCompareByPairId
-			);
-		}
 	
-
-
-	 /* Create the data space for the dataset. */
-	int dataspace_id =  H5Screate_simple (1,dims, NULL);
-	/* create dataset */
-	int dataset_id = H5Dcreate2(
-			ctx->file_id,
-			  DATASET_RESKIN,
-			  reskintype,
-			  dataspace_id, 
-              H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-	 H5Dwrite(
-			dataset_id,
-			reskintype,
-			H5S_ALL, H5S_ALL, H5P_DEFAULT,
-			ctx->reskins
-			);
-
-	H5Tclose(array_dt);
-	H5Dclose(dataset_id);
-	H5Sclose(dataspace_id);
-	H5Tclose(reskintype);
-	}
-
-	
-	}
+	}
 
 
 ContextPtr ContextNew(int argc,char** argv)
@@ -1015,6 +1409,7 @@ ContextPtr ContextNew(int argc,char** argv)
 	config->argv = argv;
 	config->out = stdout;
 	config->startup = time(NULL);
+	config->chunk_cache_w0 = -1.0;
 	return config;
 	}
 
@@ -1103,6 +1498,7 @@ int main_build(int argc,char** argv)
 	readBed(config);
 	readIbd(config);
 	readReskin(config);
+	writeSnapshot(config);
 	DEBUG("Closing HDF5 file");
 	assertGE0(H5Fclose(config->file_id)); 
 	return EXIT_SUCCESS;
@@ -1114,35 +1510,417 @@ int main_build(int argc,char** argv)
 		hid_t dataset_id = VERIFY(H5Dopen2(config->file_id,DATASETNAME, H5P_DEFAULT)); \
 		hid_t dspace = VERIFY(H5Dget_space(dataset_id)); \
 		assert(H5Sget_simple_extent_ndims(dspace)==1); \
-		int atype  = H5Dget_type(dataset_id);  \
+		hid_t atype  = VERIFY(H5Dget_type(dataset_id));  \
 		hsize_t dims[1]; \
 		H5Sget_simple_extent_dims(dspace, dims, NULL); \
 		config->ITEM_COUNT = dims[0]; \
 		config->ITEM_NAME = (DATATYPE*)safeCalloc(config->ITEM_COUNT,sizeof(DATATYPE)); \
 		VERIFY(H5Dread(dataset_id, atype, H5S_ALL, H5S_ALL, H5P_DEFAULT, config->ITEM_NAME)); \
+		VERIFY(H5Tclose(atype)); \
 		VERIFY(H5Sclose(dspace)); \
 		VERIFY(H5Dclose(dataset_id)); \
 		DEBUG("End reading " DATASETNAME)
 
+/** if this environment variable is defined, the datasets are always read with H5Dread */
+#define IBD_NO_MMAP_ENV "IBDDB_NO_MMAP"
+
 /**
- *
- * open IBD context for reading after config->hdf5_filename and config->on_load_* be assigned
- *
- */		
-void ContextOpenForRead(ContextPtr config)
+ * map the raw data of a dataset with mmap when they are stored as a contiguous array of 'mem_type'
+ * (no chunk, no filter) of 'expect_size' bytes. Returns the address of the first byte or NULL if
+ * the dataset must be read with H5Dread. The pages to be released with munmap are put in *mmap_base,*mmap_length
+ */
+static const void* mapContiguousDataset(ContextPtr config,hid_t dataset_id,hid_t mem_type,size_t expect_size,void** mmap_base,size_t* mmap_length)
 	{
-	DEBUG("Opening HDF5 file %s",config->hdf5_filename );
-	config->file_id = H5Fopen(config->hdf5_filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-	if( config->file_id < 0)
+	int fd;
+	const void* data=NULL;
+	long page_size=sysconf(_SC_PAGESIZE);
+	haddr_t offset;
+	hsize_t userblock=0;
+	off_t map_start;
+	hid_t plist,fcpl,dtype;
+	
+	*mmap_base=NULL;
+	*mmap_length=0UL;
+	if(getenv(IBD_NO_MMAP_ENV)!=NULL || expect_size==0) return NULL;
+	plist=VERIFY(H5Dget_create_plist(dataset_id));
+	fcpl=VERIFY(H5Fget_create_plist(config->file_id));
+	dtype=VERIFY(H5Dget_type(dataset_id));
+	H5Pget_userblock(fcpl,&userblock);
+	offset=H5Dget_offset(dataset_id);
+	if(H5Pget_layout(plist)==H5D_CONTIGUOUS &&
+		H5Pget_nfilters(plist)==0 &&
+		H5Tequal(dtype,mem_type)>0 &&
+		userblock==0 &&
+		offset!=HADDR_UNDEF &&
+		H5Dget_storage_size(dataset_id)==expect_size &&
+		(fd=open(config->hdf5_filename,O_RDONLY))!=-1)
 		{
-		DIE_FAILURE("H5Fopen failed err=%d.\n", config->file_id);
+		void* base;
+		map_start=(off_t)(offset-(offset%page_size));
+		*mmap_length=(size_t)(offset-map_start+expect_size);
+		base=mmap(NULL,*mmap_length,PROT_READ,MAP_SHARED,fd,map_start);
+		close(fd);
+		if(base!=MAP_FAILED)
+			{
+			*mmap_base=base;
+			data=(const void*)((const char*)base+(offset-map_start));
+			}
+		else
+			{
+			*mmap_length=0UL;
+			}
+		}
+	VERIFY(H5Tclose(dtype));
+	VERIFY(H5Pclose(fcpl));
+	VERIFY(H5Pclose(plist));
+	return data;
+	}
+
+/** memory type of a Marker, used to read slices of DATASET_MARKERS */
+static hid_t createMarkerMemType()
+	{
+	hid_t strtype = H5Tcopy(H5T_C_S1);
+	hid_t markertype = H5Tcreate (H5T_COMPOUND, sizeof (Marker));
+	H5Tset_size (strtype, H5T_VARIABLE);
+	H5Tinsert(markertype, "name", HOFFSET(Marker, name), strtype);
+	H5Tinsert(markertype, "tid", HOFFSET(Marker, tid), H5T_NATIVE_INT);
+	H5Tinsert(markertype, "position", HOFFSET(Marker, position), H5T_NATIVE_INT);
+	H5Tinsert(markertype, "index", HOFFSET(Marker, index), H5T_NATIVE_INT);
+	H5Tclose (strtype);
+	return markertype;
+	}
+
+/** read the 'tid' of the marker at 'index' in DATASET_MARKERS */
+static int readMarkerTid(hid_t dataset_id,hid_t dspace,hid_t tidtype,size_t index)
+	{
+	int tid;
+	hsize_t start[1]={index};
+	hsize_t count[1]={1};
+	hid_t memspace = VERIFY(H5Screate_simple(1, count, NULL));
+	VERIFY(H5Sselect_hyperslab(dspace,H5S_SELECT_SET,start,NULL,count,NULL));
+	VERIFY(H5Dread(dataset_id, tidtype, memspace, dspace, H5P_DEFAULT, &tid));
+	VERIFY(H5Sclose(memspace));
+	return tid;
+	}
+
+/** copy the markers [begin,end[ of a snapshot in config->markers, the names point into the snapshot */
+static void snapshotFillMarkers(ContextPtr config,const unsigned char* buffer,size_t begin,size_t end)
+	{
+	size_t i;
+	SnapshotHeader header;
+	SnapshotLayout L;
+	const char* blob;
+	memcpy((void*)&header,(const void*)buffer,sizeof(SnapshotHeader));
+	snapshotLayout(&header,&L);
+	blob=(const char*)&buffer[L.blob];
+	for(i=begin;i< end;++i)
+		{
+		config->markers[i].name=(char*)&blob[((const uint64_t*)&buffer[L.marker_name])[i]];
+		config->markers[i].tid=((const int32_t*)&buffer[L.marker_tid])[i];
+		config->markers[i].position=((const int32_t*)&buffer[L.marker_position])[i];
+		config->markers[i].index=(int)i;
+		}
+	}
+
+/**
+ * lazy loading of the markers: only read the number of markers and find the first marker of each chromosome
+ * with a binary search on the 'tid' of the markers in the file. The markers are loaded by ContextLoadMarkers
+ */
+static void openLazyMarkers(ContextPtr config)
+	{
+	size_t tid;
+	hsize_t dims[1];
+	hid_t dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_MARKERS, H5P_DEFAULT));
+	hid_t dspace = VERIFY(H5Dget_space(dataset_id));
+	hid_t tidtype = H5Tcreate (H5T_COMPOUND, sizeof(int));
+	H5Tinsert(tidtype, "tid", 0, H5T_NATIVE_INT);
+	H5Sget_simple_extent_dims(dspace, dims, NULL);
+	config->marker_count = dims[0];
+	config->markers = (MarkerPtr)safeCalloc(MAX(1,config->marker_count),sizeof(Marker));
+	config->chrom_marker_offsets = (size_t*)safeCalloc(config->chromosome_count+1,sizeof(size_t));
+	config->chrom_markers_loaded = (boolean_t*)safeCalloc(MAX(1,config->chromosome_count),sizeof(boolean_t));
+	config->chrom_marker_offsets[config->chromosome_count]=config->marker_count;
+	for(tid=0;tid< config->chromosome_count;++tid)
+		{
+		/* lower bound of 'tid' */
+		size_t low=(tid==0?0:config->chrom_marker_offsets[tid-1]);
+		size_t high=config->marker_count;
+		while(low<high)
+			{
+			size_t mid=low+(high-low)/2;
+			if(readMarkerTid(dataset_id,dspace,tidtype,mid) < (int)tid)
+				{
+				low=mid+1;
+				}
+			else
+				{
+				high=mid;
+				}
+			}
+		config->chrom_marker_offsets[tid]=low;
+		}
+	VERIFY(H5Tclose(tidtype));
+	VERIFY(H5Sclose(dspace));
+	VERIFY(H5Dclose(dataset_id));
+	}
+
+void ContextLoadMarkers(ContextPtr config,int tid)
+	{
+	size_t begin,end;
+	if(config->chrom_marker_offsets==NULL) return;
+	if(tid<0 || (size_t)tid>=config->chromosome_count) return;
+	if(config->chrom_markers_loaded[tid]) return;
+	config->chrom_markers_loaded[tid]=TRUE;
+	begin=config->chrom_marker_offsets[tid];
+	end=config->chrom_marker_offsets[tid+1];
+	if(begin<end && config->snapshot_data!=NULL)
+		{
+		const unsigned char* buffer=(const unsigned char*)config->snapshot_data;
+		DEBUG("Loading the %zu markers of %s",end-begin,config->chromosomes[tid].name);
+		if(snapshotUnitIsValid(buffer,SNAPSHOT_UNIT_MARKERS+(size_t)tid))
+			{
+			snapshotFillMarkers(config,buffer,begin,end);
+			return;
+			}
+		fprintf(stderr,"[WARN] invalid markers of %s in the " DATASET_SNAPSHOT " of %s, reading " DATASET_MARKERS ".\n",config->chromosomes[tid].name,config->hdf5_filename);
+		}
+	if(begin<end)
+		{
+		hsize_t start[1]={begin};
+		hsize_t count[1]={end-begin};
+		hid_t dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_MARKERS, H5P_DEFAULT));
+		hid_t dspace = VERIFY(H5Dget_space(dataset_id));
+		hid_t memspace = VERIFY(H5Screate_simple(1, count, NULL));
+		hid_t markertype = createMarkerMemType();
+		DEBUG("Loading the %zu markers of %s",end-begin,config->chromosomes[tid].name);
+		VERIFY(H5Sselect_hyperslab(dspace,H5S_SELECT_SET,start,NULL,count,NULL));
+		VERIFY(H5Dread(dataset_id, markertype, memspace, dspace, H5P_DEFAULT, &config->markers[begin]));
+		VERIFY(H5Tclose(markertype));
+		VERIFY(H5Sclose(memspace));
+		VERIFY(H5Sclose(dspace));
+		VERIFY(H5Dclose(dataset_id));
+		}
+	}
+
+MarkerPtr ContextGetMarker(ContextPtr config,size_t index)
+	{
+	assert(index < config->marker_count);
+	if(config->chrom_marker_offsets!=NULL)
+		{
+		/* last chromosome whose first marker is <= index */
+		size_t low=0,high=config->chromosome_count;
+		while(low+1<high)
+			{
+			size_t mid=low+(high-low)/2;
+			if(config->chrom_marker_offsets[mid] <= index)
+				{
+				low=mid;
+				}
+			else
+				{
+				high=mid;
+				}
+			}
+		ContextLoadMarkers(config,(int)low);
+		}
+	return &config->markers[index];
+	}
+
+/**
+ * load the requested tables from DATASET_SNAPSHOT, mapped in memory when possible.
+ * The strings point into the snapshot. Since version 3, only the header and the units that are loaded are checked
+ * and, with on_read_lazy_markers, the markers of a chromosome are copied from the snapshot by ContextLoadMarkers.
+ * Returns 0 on success, -1 if there is no valid snapshot
+ */
+static int loadSnapshot(ContextPtr config)
+	{
+	size_t i;
+	hsize_t dims[1];
+	SnapshotHeader header;
+	SnapshotLayout L;
+	const unsigned char* buffer;
+	const char* blob;
+	hid_t dataset_id,dspace;
+	boolean_t valid,lazy_markers;
+	
+	if(!(config->on_read_load_dict || config->on_read_load_markers || config->on_read_load_pedigree || config->on_read_load_pairs)) return -1;
+	if(H5Lexists(config->file_id,DATASET_SNAPSHOT,H5P_DEFAULT)<=0) return -1;
+	dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_SNAPSHOT, H5P_DEFAULT));
+	dspace = VERIFY(H5Dget_space(dataset_id));
+	H5Sget_simple_extent_dims(dspace, dims, NULL);
+	buffer=(const unsigned char*)mapContiguousDataset(config,dataset_id,H5T_NATIVE_UINT8,dims[0],&config->snapshot_mmap_base,&config->snapshot_mmap_length);
+	if(buffer==NULL && dims[0]>=sizeof(SnapshotHeader))
+		{
+		config->snapshot_buffer=safeMalloc(dims[0]);
+		VERIFY(H5Dread(dataset_id,H5T_NATIVE_UINT8,H5S_ALL,H5S_ALL,H5P_DEFAULT,config->snapshot_buffer));
+		buffer=(const unsigned char*)config->snapshot_buffer;
+		}
+	VERIFY(H5Sclose(dspace));
+	VERIFY(H5Dclose(dataset_id));
+	if(buffer==NULL) return -1;
+	
+	memcpy((void*)&header,(const void*)buffer,sizeof(SnapshotHeader));
+	valid=(strncmp(header.magic,SNAPSHOT_MAGIC,8)==0 &&
+		header.version>=1 && header.version<=SNAPSHOT_VERSION &&
+		header.byte_order==SNAPSHOT_BYTE_ORDER &&
+		(header.version<3 || header.header_checksum==snapshotHeaderChecksum(&header)));
+	if(valid)
+		{
+		snapshotLayout(&header,&L);
+		valid=(L.size==dims[0]);
+		}
+	lazy_markers=(valid && header.version>=3 && config->on_read_load_markers && config->on_read_lazy_markers && config->on_read_load_dict);
+	if(valid && header.version<3)
+		{
+		valid=(header.checksum==snapshotChecksum(buffer,L.size));
+		}
+	else if(valid)
+		{
+		/* the table of the checksums, then the units to be loaded now */
+		valid=(header.checksum==(uint32_t)snapshotCrc(crc32(0L,Z_NULL,0),&buffer[L.unit_checksum],(header.chromosome_count+SNAPSHOT_UNIT_MARKERS)*sizeof(uint32_t)));
+		if(valid && (config->on_read_load_dict || config->on_read_load_markers)) valid=snapshotUnitIsValid(buffer,SNAPSHOT_UNIT_DICT);
+		if(valid && config->on_read_load_pedigree) valid=snapshotUnitIsValid(buffer,SNAPSHOT_UNIT_PEDIGREE);
+		if(valid && config->on_read_load_pairs) valid=snapshotUnitIsValid(buffer,SNAPSHOT_UNIT_PAIRS);
+		for(i=0;valid && config->on_read_load_markers && !lazy_markers && i< header.chromosome_count;++i)
+			{
+			valid=snapshotUnitIsValid(buffer,SNAPSHOT_UNIT_MARKERS+i);
+			}
+		}
+	if(!valid)
+		{
+		fprintf(stderr,"[WARN] ignoring the invalid " DATASET_SNAPSHOT " of %s.\n",config->hdf5_filename);
+		if(config->snapshot_mmap_base!=NULL) munmap(config->snapshot_mmap_base,config->snapshot_mmap_length);
+		free(config->snapshot_buffer);
+		config->snapshot_mmap_base=NULL;
+		config->snapshot_mmap_length=0UL;
+		config->snapshot_buffer=NULL;
+		return -1;
+		}
+	DEBUG("Loading " DATASET_SNAPSHOT);
+	blob=(const char*)&buffer[L.blob];
+#define SNAPSHOT_ARRAY(type,field) ((const type*)&buffer[L.field])
+#define SNAPSHOT_STRING(offset) ((offset)==SNAPSHOT_NO_STRING?NULL:(char*)&blob[offset])
+	if( config->on_read_load_dict )
+		{
+		config->chromosome_count=header.chromosome_count;
+		config->chromosomes=(ChromPtr)safeCalloc(MAX(1,config->chromosome_count),sizeof(Chrom));
+		for(i=0;i< config->chromosome_count;++i)
+			{
+			config->chromosomes[i].name=SNAPSHOT_STRING(SNAPSHOT_ARRAY(uint64_t,chrom_name)[i]);
+			config->chromosomes[i].tid=(int)i;
+			config->chromosomes[i].length=SNAPSHOT_ARRAY(int32_t,chrom_length)[i];
+			}
+		}
+	if( lazy_markers )
+		{
+		/* the markers stay in the snapshot until ContextLoadMarkers */
+		config->marker_count=header.marker_count;
+		config->markers=(MarkerPtr)safeCalloc(MAX(1,config->marker_count),sizeof(Marker));
+		config->chrom_marker_offsets=(size_t*)safeCalloc(config->chromosome_count+1,sizeof(size_t));
+		config->chrom_markers_loaded=(boolean_t*)safeCalloc(MAX(1,config->chromosome_count),sizeof(boolean_t));
+		for(i=0;i<= config->chromosome_count;++i)
+			{
+			config->chrom_marker_offsets[i]=(size_t)SNAPSHOT_ARRAY(uint64_t,chrom_marker_offset)[i];
+			}
+		}
+	else if( config->on_read_load_markers )
+		{
+		config->marker_count=header.marker_count;
+		config->markers=(MarkerPtr)safeCalloc(MAX(1,config->marker_count),sizeof(Marker));
+		snapshotFillMarkers(config,buffer,0UL,config->marker_count);
+		}
+	if( config->on_read_load_pedigree )
+		{
+		config->individual_count=header.individual_count;
+		config->individuals=(IndividualPtr)safeCalloc(MAX(1,config->individual_count),sizeof(Individual));
+		for(i=0;i< config->individual_count;++i)
+			{
+			IndividualPtr indi=&config->individuals[i];
+			indi->family=SNAPSHOT_STRING(SNAPSHOT_ARRAY(uint64_t,indi_family)[i]);
+			indi->name=SNAPSHOT_STRING(SNAPSHOT_ARRAY(uint64_t,indi_name)[i]);
+			indi->father=SNAPSHOT_STRING(SNAPSHOT_ARRAY(uint64_t,indi_father)[i]);
+			indi->mother=SNAPSHOT_STRING(SNAPSHOT_ARRAY(uint64_t,indi_mother)[i]);
+			indi->sex=SNAPSHOT_ARRAY(int32_t,indi_sex)[i];
+			indi->status=SNAPSHOT_ARRAY(int32_t,indi_status)[i];
+			indi->index=(int)i;
+			}
+		}
+	if( config->on_read_load_pairs )
+		{
+		config->pair_count=header.pair_count;
+		config->pairs=(PairIndiPtr)safeCalloc(MAX(1,config->pair_count),sizeof(PairIndi));
+		for(i=0;i< config->pair_count;++i)
+			{
+			config->pairs[i].indi1idx=SNAPSHOT_ARRAY(int32_t,pair_indi1)[i];
+			config->pairs[i].indi2idx=SNAPSHOT_ARRAY(int32_t,pair_indi2)[i];
+			config->pairs[i].index=(int)i;
+			config->pairs[i].kinship=(header.version>=2?SNAPSHOT_ARRAY(float,pair_kinship)[i]:PAIR_KINSHIP_UNKNOWN);
+			config->pairs[i].relationship=(header.version>=2?SNAPSHOT_ARRAY(int32_t,pair_relationship)[i]:RELATIONSHIP_UNKNOWN);
+			}
+		}
+#undef SNAPSHOT_STRING
+#undef SNAPSHOT_ARRAY
+	config->snapshot_loaded=TRUE;
+	config->snapshot_data=(lazy_markers?(const void*)buffer:NULL);
+	return 0;
+	}
+
+/**
+ * read DATASET_PAIRS with the fields of PairIndi found in the file: the pairs of the
+ * databases built before the kinship was stored get PAIR_KINSHIP_UNKNOWN/RELATIONSHIP_UNKNOWN
+ */
+static void loadPairs(ContextPtr config)
+	{
+	size_t i;
+	hsize_t dims[1];
+	hid_t dataset_id,dspace,file_type,mem_type;
+	boolean_t has_kinship;
+	DEBUG("Loading " DATASET_PAIRS);
+	dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_PAIRS, H5P_DEFAULT));
+	dspace = VERIFY(H5Dget_space(dataset_id));
+	H5Sget_simple_extent_dims(dspace, dims, NULL);
+	file_type = VERIFY(H5Dget_type(dataset_id));
+	has_kinship=(H5Tget_member_index(file_type,"kinship")>=0 && H5Tget_member_index(file_type,"relationship")>=0);
+	mem_type = VERIFY(H5Tcreate(H5T_COMPOUND, sizeof(PairIndi)));
+	H5Tinsert(mem_type, "indi1idx", HOFFSET(PairIndi, indi1idx), H5T_NATIVE_INT);
+	H5Tinsert(mem_type, "indi2idx", HOFFSET(PairIndi, indi2idx), H5T_NATIVE_INT);
+	H5Tinsert(mem_type, "index", HOFFSET(PairIndi, index), H5T_NATIVE_INT);
+	if(has_kinship)
+		{
+		H5Tinsert(mem_type, "kinship", HOFFSET(PairIndi, kinship), H5T_NATIVE_FLOAT);
+		H5Tinsert(mem_type, "relationship", HOFFSET(PairIndi, relationship), H5T_NATIVE_INT);
+		}
+	config->pair_count = dims[0];
+	config->pairs = (PairIndiPtr)safeCalloc(MAX(1,config->pair_count),sizeof(PairIndi));
+	if(config->pair_count>0)
+		{
+		VERIFY(H5Dread(dataset_id, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, config->pairs));
+		}
+	for(i=0;i< config->pair_count && !has_kinship;++i)
+		{
+		config->pairs[i].kinship=PAIR_KINSHIP_UNKNOWN;
+		config->pairs[i].relationship=RELATIONSHIP_UNKNOWN;
 		}
+	VERIFY(H5Tclose(mem_type));
+	VERIFY(H5Tclose(file_type));
+	VERIFY(H5Sclose(dspace));
+	VERIFY(H5Dclose(dataset_id));
+	DEBUG("End reading " DATASET_PAIRS);
+	}
+
+/** load the requested tables from the compound datasets */
+static void loadMetadataDatasets(ContextPtr config)
+	{
 	if( config->on_read_load_dict )
 		{
 		LOAD_CONFIG_DATASET(DATASET_DICTIONARY,Chrom,chromosomes,chromosome_count);
 		}
 
-	if( config->on_read_load_markers )
+	if( config->on_read_load_markers && config->on_read_lazy_markers && config->on_read_load_dict )
+		{
+		openLazyMarkers(config);
+		}
+	else if( config->on_read_load_markers )
 		{
 		LOAD_CONFIG_DATASET(DATASET_MARKERS,Marker,markers,marker_count);
 		}
@@ -1153,7 +1931,26 @@ void ContextOpenForRead(ContextPtr config)
 	
 	if( config->on_read_load_pairs )
 		{
-		LOAD_CONFIG_DATASET(DATASET_PAIRS,PairIndi,pairs,pair_count);
+		loadPairs(config);
+		}
+	}
+
+/**
+ *
+ * open IBD context for reading after config->hdf5_filename and config->on_load_* be assigned
+ *
+ */		
+void ContextOpenForRead(ContextPtr config)
+	{
+	DEBUG("Opening HDF5 file %s",config->hdf5_filename );
+	config->file_id = H5Fopen(config->hdf5_filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+	if( config->file_id < 0)
+		{
+		DIE_FAILURE("H5Fopen failed err=%d.\n", config->file_id);
+		}
+	if( config->on_read_no_snapshot || loadSnapshot(config)!=0 )
+		{
+		loadMetadataDatasets(config);
 		}
 	
 	if( config->on_read_load_reskins )
@@ -1183,15 +1980,18 @@ void ContextFree(ContextPtr config)
 		fflush(config->out);
 		}
 	
-	for(i=0;i< config->marker_count;++i)
+	/* with a snapshot, the strings point into the snapshot */
+	for(i=0;i< config->marker_count && !config->snapshot_loaded;++i)
 		{
 		free( config->markers[i].name);
 		}
 
 	free(config->markers);
+	free(config->chrom_marker_offsets);
+	free(config->chrom_markers_loaded);
 	
 	
-	for(i=0;i< config->chromosome_count;++i)
+	for(i=0;i< config->chromosome_count && !config->snapshot_loaded;++i)
 		{
 		free( config->chromosomes[i].name);
 		}
@@ -1200,7 +2000,7 @@ void ContextFree(ContextPtr config)
 
 	free(config->pairs);
 	
-	for(i=0;i< config->individual_count;++i)
+	for(i=0;i< config->individual_count && !config->snapshot_loaded;++i)
 		{
 		free( config->individuals[i].family);
 		free( config->individuals[i].name);
@@ -1209,6 +2009,12 @@ void ContextFree(ContextPtr config)
 		}
 
 	free(config->individuals);
+	
+	if(config->snapshot_mmap_base!=NULL)
+		{
+		munmap(config->snapshot_mmap_base,config->snapshot_mmap_length);
+		}
+	free(config->snapshot_buffer);
 
 	
 	if(config->file_id!=0)
@@ -1288,30 +2094,255 @@ void parseRegion(ContextPtr ctx,RegionPtr rgn,const char* s)
 		}
 	}
 
-int main_markers(int argc,char** argv)
+/**
+ * find the indexes [*begin,*end[ of the markers overlapping the region.
+ * Markers are sorted on tid/position, so the range is contiguous.
+ * If region==NULL, all the markers are returned
+ */
+static void findMarkerRange(ContextPtr config,const RegionPtr region,size_t* begin,size_t* end)
+	{
+	size_t low=0,high=config->marker_count;
+	if(region==NULL)
+		{
+		size_t tid;
+		for(tid=0;tid< config->chromosome_count;++tid) ContextLoadMarkers(config,(int)tid);
+		*begin=0;
+		*end=config->marker_count;
+		return;
+		}
+	if(config->chrom_marker_offsets!=NULL)
+		{
+		/* only the markers of this chromosome are loaded */
+		ContextLoadMarkers(config,region->tid);
+		low=config->chrom_marker_offsets[region->tid];
+		high=config->chrom_marker_offsets[region->tid+1];
+		}
+	/* lower bound of (tid,start) */
+	while(low<high)
+		{
+		size_t mid=low+(high-low)/2;
+		MarkerPtr m=&config->markers[mid];
+		if(m->tid < region->tid || (m->tid==region->tid && m->position < region->start))
+			{
+			low=mid+1;
+			}
+		else
+			{
+			high=mid;
+			}
+		}
+	*begin=low;
+	/* upper bound of (tid,end) */
+	high=(config->chrom_marker_offsets!=NULL?config->chrom_marker_offsets[region->tid+1]:config->marker_count);
+	while(low<high)
+		{
+		size_t mid=low+(high-low)/2;
+		MarkerPtr m=&config->markers[mid];
+		if(m->tid < region->tid || (m->tid==region->tid && m->position <= region->end))
+			{
+			low=mid+1;
+			}
+		else
+			{
+			high=mid;
+			}
+		}
+	*end=low;
+	}
+
+/** an interval read from a BED file, before merging */
+typedef struct bed_interval_t
+	{
+	int tid;
+	int start;
+	int end;
+	char* label;
+	} BedInterval,*BedIntervalPtr;
+
+static int BedIntervalCompare(const void* a,const void *b)
+	{
+	const BedIntervalPtr i=(const BedIntervalPtr)a;
+	const BedIntervalPtr j=(const BedIntervalPtr)b;
+	int d=i->tid - j->tid;
+	if(d!=0) return d;
+	d= i->start - j->start;
+	if(d!=0) return d;
+	return i->end - j->end;
+	}
+
+/**
+ * read a BED file (chrom/start/end/(name)), sort and merge the overlapping intervals,
+ * and resolve each merged interval to the range of markers it contains.
+ * The label of a range is the comma-separated names of the merged intervals or 'chrom:start-end'.
+ * The ranges are sorted on the marker index, that is to say in the on-disk order of '/ibd'.
+ */
+static MarkerRangePtr readMarkerRangesFromBed(ContextPtr config,const char* filename,size_t* n_ranges)
+	{
+	char* line;
+	size_t i,line_len=0UL,n_intervals=0UL,n_merged=0UL;
+	BedIntervalPtr intervals=NULL;
+	MarkerRangePtr ranges=NULL;
+	gzFile in;
+	DEBUG("Opening BED %s",filename);
+	in=safeGZOpen(filename,"r");
+	while((line=gzReadLine(in,&line_len))!=NULL)
+		{
+		char* tokens[5];
+		size_t n_tokens;
+		BedIntervalPtr interval;
+		ChromPtr chrom;
+		line = ltrim(line,&line_len);
+		if(line_len==0 || line[0]=='#' || strStartsWith(line,"track") || strStartsWith(line,"browser"))
+			{
+			free(line);
+			continue;
+			}
+		n_tokens=strsplit(line,'\t',tokens,5);
+		if(n_tokens<3)
+			{
+			DIE_FAILURE("expected at least 3 columns in BED %s",filename);
+			}
+		chrom=findExistingChromosomeByName(config,tokens[0]);
+		intervals=(BedIntervalPtr)safeRealloc(intervals,sizeof(BedInterval)*(n_intervals+1));
+		interval=&intervals[n_intervals];
+		interval->tid=chrom->tid;
+		interval->start=atoi(tokens[1]);
+		interval->end=atoi(tokens[2]);
+		if(interval->start<0 || interval->start > interval->end)
+			{
+			DIE_FAILURE("bad interval %s:%s-%s in %s",tokens[0],tokens[1],tokens[2],filename);
+			}
+		interval->label=(n_tokens>3 && tokens[3][0]!=0 ? safeStrDup(tokens[3]) : NULL);
+		n_intervals++;
+		free(line);
+		}
+	gzclose(in);
+
+	qsort((void*)intervals,n_intervals,sizeof(BedInterval),BedIntervalCompare);
+
+	/* merge the overlapping intervals */
+	for(i=0;i< n_intervals;++i)
+		{
+		BedIntervalPtr curr=&intervals[i];
+		if(n_merged>0 &&
+			intervals[n_merged-1].tid==curr->tid &&
+			curr->start < intervals[n_merged-1].end)
+			{
+			BedIntervalPtr prev=&intervals[n_merged-1];
+			prev->end=MAX(prev->end,curr->end);
+			if(curr->label!=NULL)
+				{
+				if(prev->label==NULL)
+					{
+					prev->label=curr->label;
+					}
+				else
+					{
+					prev->label=(char*)safeRealloc(prev->label,strlen(prev->label)+strlen(curr->label)+2);
+					strcat(prev->label,",");
+					strcat(prev->label,curr->label);
+					free(curr->label);
+					}
+				}
+			continue;
+			}
+		intervals[n_merged++]=*curr;
+		}
+	DEBUG("%zu intervals merged into %zu regions",n_intervals,n_merged);
+
+	/* resolve the marker ranges. BED is 0-based, markers positions are compared like in parseRegion */
+	ranges=(MarkerRangePtr)safeCalloc(MAX(1,n_merged),sizeof(MarkerRange));
+	for(i=0;i< n_merged;++i)
+		{
+		Region rgn;
+		BedIntervalPtr interval=&intervals[i];
+		rgn.tid=interval->tid;
+		rgn.start=interval->start;
+		rgn.end=interval->end-1;
+		findMarkerRange(config,&rgn,&ranges[i].begin,&ranges[i].end);
+		if(interval->label!=NULL)
+			{
+			ranges[i].label=interval->label;
+			}
+		else
+			{
+			const char* cname=config->chromosomes[interval->tid].name;
+			ranges[i].label=(char*)safeMalloc(strlen(cname)+30);
+			sprintf(ranges[i].label,"%s:%d-%d",cname,interval->start,interval->end);
+			}
+		}
+	free(intervals);
+	*n_ranges=n_merged;
+	return ranges;
+	}
+
+/**
+ * build the list of the marker ranges to be scanned: the merged intervals of 'bed_filename',
+ * or the markers overlapping 'region', or all the markers.
+ */
+static MarkerRangePtr buildMarkerRanges(ContextPtr config,const RegionPtr region,const char* bed_filename,size_t* n_ranges)
+	{
+	size_t r;
+	MarkerRangePtr ranges;
+	if(bed_filename!=NULL)
+		{
+		ranges=readMarkerRangesFromBed(config,bed_filename,n_ranges);
+		}
+	else
+		{
+		ranges=(MarkerRangePtr)safeCalloc(1,sizeof(MarkerRange));
+		findMarkerRange(config,region,&ranges[0].begin,&ranges[0].end);
+		*n_ranges=1;
+		}
+	/* the chunk cache of '/ibd' is sized for the largest range */
+	config->query_range_markers=0UL;
+	for(r=0;r< *n_ranges;++r)
+		{
+		config->query_range_markers=MAX(config->query_range_markers,ranges[r].end-ranges[r].begin);
+		}
+	return ranges;
+	}
+
+static void MarkerRangesFree(MarkerRangePtr ranges,size_t n_ranges)
 	{
 	size_t i;
+	if(ranges==NULL) return;
+	for(i=0;i< n_ranges;++i)
+		{
+		free(ranges[i].label);
+		}
+	free(ranges);
+	}
+
+int main_markers(int argc,char** argv)
+	{
+	size_t i,r,n_ranges=0UL;
 	ContextPtr config=ContextNew(argc,argv);
 	config->on_read_load_dict = 1;
 	config->on_read_load_markers = 1;
+	config->on_read_lazy_markers = 1;
 	RegionPtr region=NULL;
 	char* rgn_str=NULL;
+	char* regions_filename=NULL;
+	MarkerRangePtr ranges=NULL;
 	for(;;)
 		{
 		struct option long_options[] =
 		     {
 		      // {"enable-self-self",  no_argument , &config->enable_self_self , 1},
 			{"region",    required_argument, 0, 'r'},
+			{"regions",    required_argument, 0, 'R'},
 		       {0, 0, 0, 0}
 		     };
 		 /* getopt_long stores the option index here. */
 		int option_index = 0;
-	     	int c = getopt_long (argc, argv, "r:",
+	     	int c = getopt_long (argc, argv, "r:R:",
 		                    long_options, &option_index);
 		if(c==-1) break;
 		switch(c)
 			{
 			case 'r': rgn_str = optarg ;break;
+			case 'R': regions_filename = optarg ;break;
 			
 			case 0: break;
 			case '?': break;
@@ -1323,6 +2354,11 @@ int main_markers(int argc,char** argv)
 		fprintf(stderr,"Illegal number of arguments.\n");
 		return EXIT_FAILURE;
 		}	
+	if(rgn_str!=NULL && regions_filename!=NULL)
+		{
+		fprintf(stderr,"options --region and --regions are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
 	config->hdf5_filename=argv[optind];
 	ContextOpenForRead(config);
 	
@@ -1332,28 +2368,30 @@ int main_markers(int argc,char** argv)
 		parseRegion(config,region,rgn_str);
 		DEBUG("region: tid=%d:%d-%d",region->tid,region->start,region->end);
 		};
-	
+	ranges = buildMarkerRanges(config,region,regions_filename,&n_ranges);
 
-	for(i=0;i< config->marker_count;++i)
+	for(r=0;r< n_ranges;++r)
 		{
-		MarkerPtr marker = &config->markers[i];
-		
-		if( region!=NULL)
+		for(i=ranges[r].begin;i< ranges[r].end;++i)
 			{
-			if( region->tid != marker->tid ) continue;
-			if( marker->position < region->start) continue;
-			if( marker->position > region->end) continue;
+			MarkerPtr marker = &config->markers[i];
+			
+			if(ranges[r].label!=NULL)
+				{
+				fputs( ranges[r].label , config->out);
+				fputc('\t', config->out);
+				}
+			fputs( config->chromosomes[ marker->tid ].name , config->out);
+			fputc('\t', config->out);
+			fprintf(config->out,"%d", marker->position);
+			fputc('\t', config->out);
+			fprintf(config->out,"%d", marker->position+1);
+			fputc('\t', config->out);
+			fputs( marker->name , config->out);
+			if( fputc('\n', config->out) < 0) break;
 			}
-		
-		fputs( config->chromosomes[ marker->tid ].name , config->out);
-		fputc('\t', config->out);
-		fprintf(config->out,"%d", marker->position);
-		fputc('\t', config->out);
-		fprintf(config->out,"%d", marker->position+1);
-		fputc('\t', config->out);
-		fputs( marker->name , config->out);
-		if( fputc('\n', config->out) < 0) break;
 		}
+	MarkerRangesFree(ranges,n_ranges);
 	if(region!=NULL)
 		{
 		free(region);
@@ -1442,6 +2480,7 @@ int main_pedigree(int argc,char** argv)
 int main_pairs(int argc,char** argv)
 	{
 	size_t i;
+	int print_kinship=FALSE;
 	ContextPtr config=ContextNew(argc,argv);
 	config->on_read_load_pedigree = 1;
 	config->on_read_load_pairs = 1;
@@ -1451,7 +2490,7 @@ int main_pairs(int argc,char** argv)
 		struct option long_options[] =
 		     {
 		      // {"enable-self-self",  no_argument , &config->enable_self_self , 1},
-
+			{"kinship",  no_argument, &print_kinship, 1},
 		       {0, 0, 0, 0}
 		     };
 		 /* getopt_long stores the option index here. */
@@ -1473,7 +2512,7 @@ int main_pairs(int argc,char** argv)
 		}	
 	config->hdf5_filename=argv[optind];
 	ContextOpenForRead(config);
-	
+	if(print_kinship) ensurePairKinship(config);
 
 	for(i=0;i< config->pair_count;++i)
 		{
@@ -1481,6 +2520,10 @@ int main_pairs(int argc,char** argv)
 		printIndividual(&config->individuals[pair->indi1idx],config->out);
 		fputc('\t', config->out);
 		printIndividual(&config->individuals[pair->indi2idx],config->out);
+		if(print_kinship)
+			{
+			fprintf(config->out,"\t%f\t%s",pair->kinship,RELATIONSHIP_NAMES[pair->relationship]);
+			}
 		if( fputc('\n', config->out) < 0) break;
 		}
 
@@ -1489,23 +2532,369 @@ int main_pairs(int argc,char** argv)
 	}
 
 
+/**
+ * map '/ibd' in memory when its raw data are stored as a contiguous array of native floats
+ * (no chunk, no filter). Returns 0 on success, -1 if the dataset must be read with H5Dread.
+ */
+static int IbdDataSetMap(ContextPtr config,IbdDataSetPtr ds)
+	{
+	float check[3];
+	hsize_t read_start[3] = {0,0,0};
+	hsize_t read_count[3] = {1,1,3};
+	hsize_t dims[3];
+	H5Sget_simple_extent_dims(ds->dataspace_id, dims, NULL);
+	ds->mapped=(const float*)mapContiguousDataset(config,ds->dataset_id,H5T_NATIVE_FLOAT,dims[0]*dims[1]*dims[2]*sizeof(float),&ds->mmap_base,&ds->mmap_length);
+	if(ds->mapped==NULL) return -1;
+	/* paranoid: the first cell must be the same with both methods */
+	VERIFY(H5Sselect_hyperslab(ds->dataspace_id,H5S_SELECT_SET,read_start,NULL,read_count,NULL));
+	VERIFY(H5Dread(ds->dataset_id,H5T_NATIVE_FLOAT,ds->memspace,ds->dataspace_id,H5P_DEFAULT,check));
+	if(memcmp((const void*)check,(const void*)ds->mapped,3*sizeof(float))!=0)
+		{
+		munmap(ds->mmap_base,ds->mmap_length);
+		ds->mmap_base=NULL;
+		ds->mmap_length=0UL;
+		ds->mapped=NULL;
+		return -1;
+		}
+	return 0;
+	}
+
+/** bounds of the automatic HDF5 chunk cache of '/ibd' */
+#define IBD_CHUNK_CACHE_MIN_BYTES (1024*1024)
+#define IBD_CHUNK_CACHE_MAX_BYTES (512*1024*1024)
+#define IBD_CHUNK_CACHE_MAX_SLOTS 1000000
+
+/**
+ * a model of the LRU chunk cache of HDF5, used to count the hits and the misses of a query
+ * (HDF5 has no public counter for the raw data chunk cache). Chunks are identified by
+ * their coordinates in the grid of chunks.
+ */
+typedef struct chunk_cache_model_t
+	{
+	size_t capacity;
+	size_t size;
+	unsigned long long* keys;
+	/* doubly-linked list, head is the most recently used */
+	size_t* prev;
+	size_t* next;
+	size_t head;
+	size_t tail;
+	/* hash table with chaining */
+	size_t n_buckets;
+	size_t* buckets;
+	size_t* chain;
+	unsigned long long hits;
+	unsigned long long misses;
+	} ChunkCacheModel;
+
+#define CHUNK_CACHE_NIL ((size_t)-1)
+
+static ChunkCacheModelPtr ChunkCacheModelNew(size_t capacity)
+	{
+	size_t i;
+	ChunkCacheModelPtr m=(ChunkCacheModelPtr)safeCalloc(1,sizeof(ChunkCacheModel));
+	m->capacity=MAX(1,capacity);
+	m->keys=(unsigned long long*)safeCalloc(m->capacity,sizeof(unsigned long long));
+	m->prev=(size_t*)safeCalloc(m->capacity,sizeof(size_t));
+	m->next=(size_t*)safeCalloc(m->capacity,sizeof(size_t));
+	m->chain=(size_t*)safeCalloc(m->capacity,sizeof(size_t));
+	m->n_buckets=m->capacity*2+1;
+	m->buckets=(size_t*)safeMalloc(m->n_buckets*sizeof(size_t));
+	for(i=0;i< m->n_buckets;++i) m->buckets[i]=CHUNK_CACHE_NIL;
+	m->head=CHUNK_CACHE_NIL;
+	m->tail=CHUNK_CACHE_NIL;
+	return m;
+	}
+
+static void ChunkCacheModelFree(ChunkCacheModelPtr m)
+	{
+	if(m==NULL) return;
+	free(m->keys);
+	free(m->prev);
+	free(m->next);
+	free(m->chain);
+	free(m->buckets);
+	free(m);
+	}
+
+static void chunkCacheModelUnlink(ChunkCacheModelPtr m,size_t slot)
+	{
+	if(m->prev[slot]!=CHUNK_CACHE_NIL) m->next[m->prev[slot]]=m->next[slot]; else m->head=m->next[slot];
+	if(m->next[slot]!=CHUNK_CACHE_NIL) m->prev[m->next[slot]]=m->prev[slot]; else m->tail=m->prev[slot];
+	}
+
+static void chunkCacheModelPushFront(ChunkCacheModelPtr m,size_t slot)
+	{
+	m->prev[slot]=CHUNK_CACHE_NIL;
+	m->next[slot]=m->head;
+	if(m->head!=CHUNK_CACHE_NIL) m->prev[m->head]=slot;
+	m->head=slot;
+	if(m->tail==CHUNK_CACHE_NIL) m->tail=slot;
+	}
+
+/** the chunk 'key' is accessed */
+static void ChunkCacheModelAccess(ChunkCacheModelPtr m,unsigned long long key)
+	{
+	size_t slot,bucket=(size_t)(key%m->n_buckets);
+	for(slot=m->buckets[bucket];slot!=CHUNK_CACHE_NIL;slot=m->chain[slot])
+		{
+		if(m->keys[slot]!=key) continue;
+		m->hits++;
+		chunkCacheModelUnlink(m,slot);
+		chunkCacheModelPushFront(m,slot);
+		return;
+		}
+	m->misses++;
+	if(m->size< m->capacity)
+		{
+		slot=m->size++;
+		}
+	else
+		{
+		/* evict the least recently used chunk */
+		size_t* p;
+		slot=m->tail;
+		chunkCacheModelUnlink(m,slot);
+		p=&m->buckets[(size_t)(m->keys[slot]%m->n_buckets)];
+		while(*p!=slot) p=&m->chain[*p];
+		*p=m->chain[slot];
+		}
+	m->keys[slot]=key;
+	m->chain[slot]=m->buckets[bucket];
+	m->buckets[bucket]=slot;
+	chunkCacheModelPushFront(m,slot);
+	}
+
+/** smallest prime >= n, for the number of slots of the chunk cache */
+static size_t nextPrime(size_t n)
+	{
+	for(n=MAX(n,2);;++n)
+		{
+		size_t d;
+		for(d=2;d*d<=n;++d) if(n%d==0) break;
+		if(d*d>n) return n;
+		}
+	}
+
+/**
+ * compute the chunk cache of a chunked '/ibd' from the shape of the chunks and the pairs of the query:
+ * a scan reads blocks of rows over the columns of the selected pairs, so the cache should hold the chunks of one block
+ * plus the band of chunks shared with the next block. A block never spans two ranges of markers, so it is not larger than
+ * config->query_range_markers. The values of config->chunk_cache_* override the computed ones.
+ */
+static void IbdDataSetChunkCache(ContextPtr config,IbdDataSetPtr ds,const hsize_t* chunk_dims,size_t* nslots,size_t* nbytes,double* w0)
+	{
+	size_t j,pair_start=0UL,pair_end=0UL,block_rows,rows_chunks,cols_chunks,chunk_bytes,n_chunks;
+	size_t n_markers=(config->query_range_markers>0?MIN(config->query_range_markers,config->marker_count):config->marker_count);
+	boolean_t query=FALSE;
+	for(j=0;j< config->pair_count;++j)
+		{
+		if(!config->pairs[j].selected) continue;
+		if(!query) pair_start=j;
+		pair_end=j+1;
+		query=TRUE;
+		}
+	/* no selected pair (e.g. R binding): random access to all the pairs */
+	if(!query) pair_end=config->pair_count;
+	chunk_bytes=(size_t)(chunk_dims[0]*chunk_dims[1]*chunk_dims[2]*sizeof(float));
+	block_rows=MIN(MAX(1,n_markers),MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,pair_end-pair_start)*3*sizeof(float))));
+	rows_chunks=(block_rows+chunk_dims[0]-1)/chunk_dims[0]+1;
+	cols_chunks=(MAX(1,pair_end-pair_start)+chunk_dims[1]-1)/chunk_dims[1]+1;
+	n_chunks=rows_chunks*cols_chunks;
+	if(!query) n_chunks=cols_chunks;
+	*nbytes=n_chunks*chunk_bytes;
+	if(*nbytes< IBD_CHUNK_CACHE_MIN_BYTES) *nbytes=IBD_CHUNK_CACHE_MIN_BYTES;
+	if(*nbytes> IBD_CHUNK_CACHE_MAX_BYTES) *nbytes=IBD_CHUNK_CACHE_MAX_BYTES;
+	/* a scan never reads a chunk again once it was fully read */
+	*w0=(query?1.0:0.75);
+	if(config->chunk_cache_bytes>0) *nbytes=config->chunk_cache_bytes;
+	if(config->chunk_cache_w0>=0.0) *w0=config->chunk_cache_w0;
+	/* HDF5 suggests ~100 times the number of chunks in the cache, a prime number */
+	*nslots=nextPrime(MIN(IBD_CHUNK_CACHE_MAX_SLOTS,100*MAX(1,*nbytes/MAX(1,chunk_bytes))));
+	if(config->chunk_cache_slots>0) *nslots=config->chunk_cache_slots;
+	}
+
 IbdDataSetPtr IbdDataSetOpen(ContextPtr config)
 	{
 	hsize_t  dims_memory[3]={1,1,3};
+	hid_t plist;
 	IbdDataSetPtr ds=(IbdDataSetPtr)safeCalloc(1,sizeof(IbdDataSet));
 	DEBUG("Loading " DATASET_IBD); 
 	ds->dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_IBD, H5P_DEFAULT)); 
+	plist=VERIFY(H5Dget_create_plist(ds->dataset_id));
+	if(H5Pget_layout(plist)==H5D_CHUNKED)
+		{
+		size_t nslots,nbytes;
+		double w0;
+		hid_t dapl=VERIFY(H5Pcreate(H5P_DATASET_ACCESS));
+		VERIFY(H5Pget_chunk(plist,3,ds->chunk_dims));
+		IbdDataSetChunkCache(config,ds,ds->chunk_dims,&nslots,&nbytes,&w0);
+		DEBUG(DATASET_IBD " chunks: %dx%dx%d, cache: %zu slots, %zu bytes, w0=%.2f",
+			(int)ds->chunk_dims[0],(int)ds->chunk_dims[1],(int)ds->chunk_dims[2],
+			nslots,nbytes,w0);
+		VERIFY(H5Pset_chunk_cache(dapl,nslots,nbytes,w0));
+		/* re-open the dataset with this cache */
+		VERIFY(H5Dclose(ds->dataset_id));
+		ds->dataset_id = VERIFY(H5Dopen2(config->file_id,DATASET_IBD, dapl));
+		VERIFY(H5Pclose(dapl));
+		ds->chunk_cache=ChunkCacheModelNew(nbytes/MAX(1,(size_t)(ds->chunk_dims[0]*ds->chunk_dims[1]*ds->chunk_dims[2]*sizeof(float))));
+		}
+	VERIFY(H5Pclose(plist));
 	ds->dataspace_id = VERIFY(H5Dget_space(ds->dataset_id)); 	
 	ds->memspace  = H5Screate_simple(3, dims_memory, NULL);
+	ds->row_size = config->pair_count*3;
+	if(IbdDataSetMap(config,ds)==0)
+		{
+		DEBUG(DATASET_IBD " is mapped in memory.");
+		IbdDataSetAdvise(ds,FALSE);
+		}
 	return ds;
 	}
 
+/** record the chunks read by a hyperslab in the model of the chunk cache */
+static void IbdDataSetCountChunks(IbdDataSetPtr ds,size_t marker_start,size_t n_markers,size_t pair_start,size_t n_pairs)
+	{
+	unsigned long long r,c,n_cols;
+	if(ds->chunk_cache==NULL) return;
+	n_cols=(unsigned long long)(ds->row_size/3+ds->chunk_dims[1]-1)/ds->chunk_dims[1];
+	for(r=marker_start/ds->chunk_dims[0];r<=(marker_start+n_markers-1)/ds->chunk_dims[0];++r)
+		{
+		for(c=pair_start/ds->chunk_dims[1];c<=(pair_start+n_pairs-1)/ds->chunk_dims[1];++c)
+			{
+			ChunkCacheModelAccess(ds->chunk_cache,r*n_cols+c);
+			}
+		}
+	}
+
 void IbdDataSetClose(IbdDataSetPtr ds)
 	{
 	if(ds==NULL) return;
+	if(ds->chunk_cache!=NULL)
+		{
+		unsigned long long total=ds->chunk_cache->hits+ds->chunk_cache->misses;
+		DEBUG(DATASET_IBD " modelled chunk cache: %llu hits, %llu misses (%.1f%% hits).",
+			ds->chunk_cache->hits,
+			ds->chunk_cache->misses,
+			(total==0?0.0:(100.0*ds->chunk_cache->hits)/total));
+		ChunkCacheModelFree(ds->chunk_cache);
+		}
+	if(ds->mmap_base!=NULL)
+		{
+		munmap(ds->mmap_base,ds->mmap_length);
+		}
 	VERIFY(H5Sclose(ds->memspace));
 	VERIFY(H5Sclose(ds->dataspace_id)); 
-	VERIFY(H5Dclose(ds->dataset_id)); 
+	VERIFY(H5Dclose(ds->dataset_id));
+	free(ds);
+	}
+
+void IbdDataSetAdvise(IbdDataSetPtr ds,boolean_t sequential)
+	{
+	if(ds->mmap_base==NULL) return;
+	madvise(ds->mmap_base,ds->mmap_length,(sequential?MADV_SEQUENTIAL:MADV_RANDOM));
+	}
+
+const float* IbdDataSetMappedRows(IbdDataSetPtr ds,size_t marker_start)
+	{
+	if(ds->mapped==NULL) return NULL;
+	return &ds->mapped[marker_start*ds->row_size];
+	}
+
+/**
+ * read a block of '/ibd': the rows [marker_start,marker_start+n_markers[ and the
+ * columns [pair_start,pair_start+n_pairs[ are copied into buffer (n_markers*n_pairs*3 floats)
+ * using a single hyperslab.
+ */
+void IbdDataSetReadBlock(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,size_t pair_start,size_t n_pairs,float* buffer)
+	{
+	hsize_t read_start[3] = {marker_start,pair_start,0};
+	hsize_t read_count[3] = {n_markers,n_pairs,3};
+	hid_t memspace;
+	assert(marker_start+n_markers <= config->marker_count);
+	assert(pair_start+n_pairs <= config->pair_count);
+	if(n_markers==0 || n_pairs==0) return;
+	if(ds->mapped!=NULL)
+		{
+		size_t i;
+		for(i=0;i< n_markers;++i)
+			{
+			memcpy((void*)&buffer[i*n_pairs*3],(const void*)&ds->mapped[(marker_start+i)*ds->row_size+pair_start*3],n_pairs*3*sizeof(float));
+			}
+		return;
+		}
+	IbdDataSetCountChunks(ds,marker_start,n_markers,pair_start,n_pairs);
+	memspace = VERIFY(H5Screate_simple(3, read_count, NULL));
+	VERIFY(H5Sselect_hyperslab(
+		ds->dataspace_id,
+		H5S_SELECT_SET,
+		read_start, NULL,
+		read_count, NULL
+		));
+	VERIFY(H5Dread(
+		ds->dataset_id,
+		H5T_NATIVE_FLOAT,
+		memspace,
+		ds->dataspace_id,
+		H5P_DEFAULT,
+		buffer
+		));
+	VERIFY(H5Sclose(memspace));
+	}
+
+/**
+ * read the rows [marker_start,marker_start+n_markers[ of the 'n_pairs' pairs whose indexes (sorted) are in 'pairs':
+ * the buffer is filled with n_markers*n_pairs*3 floats. The runs of consecutive pairs are merged in one selection.
+ */
+void IbdDataSetReadPairs(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,const size_t* pairs,size_t n_pairs,float* buffer)
+	{
+	size_t i,j;
+	hsize_t mem_count[3] = {n_markers,n_pairs,3};
+	hid_t memspace;
+	H5S_seloper_t op=H5S_SELECT_SET;
+	assert(marker_start+n_markers <= config->marker_count);
+	if(n_markers==0 || n_pairs==0) return;
+	if(ds->mapped!=NULL)
+		{
+		for(i=0;i< n_markers;++i)
+			{
+			for(j=0;j< n_pairs;++j)
+				{
+				memcpy((void*)&buffer[(i*n_pairs+j)*3],(const void*)&ds->mapped[(marker_start+i)*ds->row_size+pairs[j]*3],3*sizeof(float));
+				}
+			}
+		return;
+		}
+	for(i=0;i< n_pairs;i=j)
+		{
+		hsize_t read_start[3] = {marker_start,pairs[i],0};
+		hsize_t read_count[3] = {n_markers,0,3};
+		for(j=i+1;j< n_pairs && pairs[j]==pairs[j-1]+1;++j) {}
+		read_count[1]=j-i;
+		IbdDataSetCountChunks(ds,marker_start,n_markers,pairs[i],j-i);
+		VERIFY(H5Sselect_hyperslab(
+			ds->dataspace_id,
+			op,
+			read_start, NULL,
+			read_count, NULL
+			));
+		op=H5S_SELECT_OR;
+		}
+	memspace = VERIFY(H5Screate_simple(3, mem_count, NULL));
+	VERIFY(H5Dread(
+		ds->dataset_id,
+		H5T_NATIVE_FLOAT,
+		memspace,
+		ds->dataspace_id,
+		H5P_DEFAULT,
+		buffer
+		));
+	VERIFY(H5Sclose(memspace));
+	}
+
+/** read 'n_markers' complete rows (all the pairs) starting at 'marker_start' */
+void IbdDataSetReadMarkers(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,float* buffer)
+	{
+	IbdDataSetReadBlock(config,ds,marker_start,n_markers,0UL,config->pair_count,buffer);
 	}
 
 struct ArrayOfStrings
@@ -1610,182 +2999,128 @@ static void selectFamiliesFromFile(struct ArrayOfStrings* list,const char* filen
 	gzclose(in);
 	}
 
-static void ibd_usage(int argc,char** argv)
-	{
-	USAGE_PREAMBLE;
-	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
-	fputs("Options:\n\n",stderr);
-	fputs(" -r|--region (chr|chr:start-end) restrict to that region. Optional.\n",stderr);
-	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
-	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.n",stderr);
-	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
-	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
-	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
-	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
-	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
-	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
-	fprintf(stderr," --treshold (float) IBD TRESHOLD default:%f \n", DEFAULT_TRESHOLD_LIMIT);
-	fputs("\nTabular Options:\n\n",stderr);
-	fputs(" -noheader don't print data header.\n",stderr);
-	fputs(" -nopairsinheader don't print pairs in data header.\n",stderr);
-	fputs("\nImage Options:\n\n",stderr);
-	fputs(" -g|--image (filename.png) save as PNG picture.\n",stderr);
-	fputs(" --width (int) image-width.\n",stderr);
-	fputs(" --height (int) image-height.\n",stderr);
-	fputs("\n\n",stderr);
-	}
-
-int main_ibd(int argc,char** argv)
+/** the filters on the pairs shared by 'ibd' and 'segments' */
+typedef struct pair_filter_t
 	{
-	float ibd_values[3];
-	float treshold=DEFAULT_TRESHOLD_LIMIT;
-	int print_header=TRUE;
-	int print_pairs=TRUE;
-	int allow_self_self=TRUE;
-	size_t i,j;
-	ContextPtr config=ContextNew(argc,argv);
-	RegionPtr region=NULL;
-	char* rgn_str=NULL;
-	double min_reskin = -100000.0;
-	double max_reskin =  100000.0;
-	boolean_t check_reskin = FALSE;
-	
-	/** limit pedigree/pairs/family */
 	struct ArrayOfStrings limitIndividuals;
-	memset((void*)&limitIndividuals,0,sizeof(struct ArrayOfStrings));
 	struct ArrayOfStrings limitPairs;
-	memset((void*)&limitPairs,0,sizeof(struct ArrayOfStrings));
 	struct ArrayOfStrings limitFamilies;
-	memset((void*)&limitFamilies,0,sizeof(struct ArrayOfStrings));
-
-	config->on_read_load_pedigree = 1;
-	config->on_read_load_pairs = 1;
-	config->on_read_load_dict = 1;
-	config->on_read_load_markers = 1;
-	config->on_read_load_reskins = 0; /* will be set later */
-	
+	int allow_self_self;
+	boolean_t check_reskin;
+	double min_reskin;
+	double max_reskin;
+	/** if not 0, bit (1<<RELATIONSHIP_*) is set for the relationships to keep */
+	unsigned int relationships;
+	boolean_t check_kinship;
+	double min_kinship;
+	} PairFilter,*PairFilterPtr;
+
+static void PairFilterInit(PairFilterPtr filter)
+	{
+	memset((void*)filter,0,sizeof(PairFilter));
+	filter->allow_self_self=TRUE;
+	filter->min_reskin = -100000.0;
+	filter->max_reskin =  100000.0;
+	}
 
-	/** Graphics2D stuff */
-	long genome_size=0L;
-	Dimension imageDimension;	
-	imageDimension.width=2000;
-	imageDimension.height=500;
-	ExpData* expData=NULL;
-	size_t expData_count=0L;
-	double max_y=0.0;
-	char* image_filename=NULL;
-	
-	
-	if(argc==1)
+/** parse the option --reskin 'min/max' . returns 0 on success */
+static int PairFilterParseReskin(PairFilterPtr filter,const char* optarg)
+	{
+	char* p2;
+	char* slash = strchr(optarg,'/');
+	if(slash==NULL)
 		{
-		ibd_usage(argc,argv);
-		return EXIT_FAILURE;
+		fprintf(stderr,"slash (/) missing in option reskin %s\n",optarg);
+		return -1;
 		}
+	filter->min_reskin = strtod(optarg,&p2);
+	filter->max_reskin = strtod(slash+1,&p2);
+	if(filter->min_reskin > filter->max_reskin || filter->min_reskin<0.0 || filter->max_reskin>1.0)
+		{
+		fprintf(stderr,"bad min/max in option reskin %s\n",optarg);
+		return -1;
+		}
+	filter->check_reskin = TRUE;
+	return 0;
+	}
 
-
-	for(;;)
+/**
+ * parse the option --relationship : a comma-separated list of RELATIONSHIP_NAMES or 'first-degree'
+ * (parent-offspring and full-sibs) or 'related' (all but unrelated and self). returns 0 on success
+ */
+static int PairFilterParseRelationship(PairFilterPtr filter,const char* optarg)
+	{
+	const char* p=optarg;
+	while(*p!=0)
 		{
-		struct option long_options[] =
-		     {
-		      // {"enable-self-self",  no_argument , &config->enable_self_self , 1},
-			{"region",    required_argument, 0, 'r'},
-			{"noheader",  no_argument, &print_header, 0},
-			{"nopairsinheader",  no_argument, &print_pairs, 0},
-			{"image",  required_argument, 0, 'g'},
-			{"individual",  required_argument, 0, 'i'},
-			{"individualfile",  required_argument, 0, 'I'},
-			{"pair",  required_argument, 0, 'p'},
-			{"pairfile",  required_argument, 0, 'P'},
-			{"family",  required_argument, 0, 'F'},
-			{"familyfile",  required_argument, 0, 'Y'},
-			{"noselfself", no_argument, &allow_self_self, 0},
-			{"width",  required_argument, 0,1024},
-			{"height",  required_argument, 0,1025},
-			{"treshold",  required_argument, 0,1026},
-		    {"reskin",  required_argument, 0,1027},
-			{0, 0, 0, 0}
-		     };
-		 /* getopt_long stores the option index here. */
-		int option_index = 0;
-	     	int c = getopt_long (argc, argv, "r:g:i:p:F:I:P:Y:",
-		                    long_options, &option_index);
-		if(c==-1) break;
-		switch(c)
+		int r;
+		size_t len=strcspn(p,",");
+		for(r=0;r< RELATIONSHIP_COUNT;++r)
 			{
-			case 'r': rgn_str = optarg ;break;
-			case 'g': image_filename = optarg ;break;
-			case 'i': PUSH_STR_TO_ARRAY(limitIndividuals,optarg);break;
-			case 'I': selectIndividualsFromFile(&limitIndividuals,optarg); break;
-			case 'p': PUSH_STR_TO_ARRAY(limitPairs,optarg);break;
-			case 'P': selectPairsFromFile(&limitPairs,optarg); break;
-			case 'F': PUSH_STR_TO_ARRAY(limitFamilies,optarg);break;
-			case 'Y': selectFamiliesFromFile(&limitFamilies,optarg); break;
-			case 1024: imageDimension.width = atoi(optarg);break;
-			case 1025: imageDimension.height = atoi(optarg);break;
-			case 1026: treshold = atof(optarg);break;
-			case 1027:
-				{
-				char* p2;
-				char* slash = strchr(optarg,'/');
-				if(slash==NULL)
-					{
-					fprintf(stderr,"slash (/) missing in option reskin %s\n",optarg);
-					return EXIT_FAILURE;
-					}
-				min_reskin = strtod(optarg,&p2);
-				max_reskin = strtod(slash+1,&p2);
-				if(min_reskin > max_reskin || min_reskin<0.0 || max_reskin>1.0)
-					{
-					fprintf(stderr,"bad min/max in option reskin %s\n",optarg);
-					return EXIT_FAILURE;
-					}
-				check_reskin = TRUE;
-				config->on_read_load_reskins = 1;
-				break;
-				}
-			case 0: break;
-			case '?': break;
-			default: exit(EXIT_FAILURE); break;
+			if(strlen(RELATIONSHIP_NAMES[r])==len && strncmp(p,RELATIONSHIP_NAMES[r],len)==0) break;
 			}
-		}	
-	if(optind+1!=argc)
-		{
-		fprintf(stderr,"Illegal number of arguments.\n");
-		return EXIT_FAILURE;
-		}
-	
-	config->hdf5_filename = argv[optind];
-	ContextOpenForRead(config);
-	
-	
-	if(rgn_str!=NULL)
-		{
-		region=(RegionPtr)safeCalloc(1,sizeof(Region));
-		parseRegion(config,region,rgn_str);
-		genome_size=1+(region->end -  region->start);
-		}
-	else
-		{
-		for(i=0;i< config->chromosome_count;++i)
+		if(r< RELATIONSHIP_COUNT)
 			{
-			config->chromosomes[i].cumulative_start = genome_size;
-			genome_size += config->chromosomes[i].length;
+			filter->relationships|=(1U<<r);
 			}
-		}
-	//enable all pairs
-	for(i=0;i< config->pair_count;++i)
-		{
-		
-		PairIndiPtr pair = &config->pairs[i];
-		pair->selected=TRUE;
-		if(!allow_self_self && pair->indi1idx==pair->indi2idx)
+		else if(len==12 && strncmp(p,"first-degree",len)==0)
 			{
-			pair->selected=FALSE;
-			continue;
+			filter->relationships|=(1U<<RELATIONSHIP_PARENT_OFFSPRING)|(1U<<RELATIONSHIP_FULL_SIBS);
+			}
+		else if(len==7 && strncmp(p,"related",len)==0)
+			{
+			for(r=RELATIONSHIP_PARENT_OFFSPRING;r< RELATIONSHIP_COUNT;++r) filter->relationships|=(1U<<r);
+			}
+		else
+			{
+			fprintf(stderr,"unknown relationship in %s\n",optarg);
+			return -1;
+			}
+		p+=len;
+		if(*p==',') ++p;
+		}
+	return 0;
+	}
+
+/** parse the option --kinship-min (float). returns 0 on success */
+static int PairFilterParseKinship(PairFilterPtr filter,const char* optarg)
+	{
+	char* p2;
+	filter->min_kinship = strtod(optarg,&p2);
+	if(*p2!=0 || filter->min_kinship<0.0 || filter->min_kinship>1.0)
+		{
+		fprintf(stderr,"bad kinship %s\n",optarg);
+		return -1;
+		}
+	filter->check_kinship = TRUE;
+	return 0;
+	}
+
+/** set the flag 'selected' of the pairs according to the filter */
+static void selectPairs(ContextPtr config,PairFilterPtr filter)
+	{
+	size_t i,j;
+	if(filter->relationships!=0 || filter->check_kinship) ensurePairKinship(config);
+	for(i=0;i< config->pair_count;++i)
+		{
+		
+		PairIndiPtr pair = &config->pairs[i];
+		pair->selected=TRUE;
+		if(!filter->allow_self_self && pair->indi1idx==pair->indi2idx)
+			{
+			pair->selected=FALSE;
+			continue;
+			}
+		/* relationship computed from the pedigree */
+		if((filter->relationships!=0 && (filter->relationships & (1U<<pair->relationship))==0) ||
+			(filter->check_kinship && pair->kinship < filter->min_kinship))
+			{
+			pair->selected=FALSE;
+			continue;
 			}
 		
 		/* ask to check reskin data */
-		if( check_reskin )
+		if( filter->check_reskin )
 			{
 			int j;
 			ReskinPtr reskin = NULL;
@@ -1800,8 +3135,8 @@ int main_ibd(int argc,char** argv)
 				}
 			/* pair not found or reskin_ibd0 out of bound */
 			if( reskin == NULL ||
-				reskin->data[RESKIN_COLUMN_IBD0] < min_reskin ||
-				reskin->data[RESKIN_COLUMN_IBD0] > max_reskin
+				reskin->data[RESKIN_COLUMN_IBD0] < filter->min_reskin ||
+				reskin->data[RESKIN_COLUMN_IBD0] > filter->max_reskin
 				) {
 				pair->selected=FALSE;
 				continue;
@@ -1811,18 +3146,18 @@ int main_ibd(int argc,char** argv)
 		
 		
 		//check families
-		if(limitFamilies.size>0)
+		if(filter->limitFamilies.size>0)
 			{
 			int side;
 			//search on both side if families limites 
 			for(side=0;side<2;++side)
 				{
 				IndividualPtr indi=&config->individuals[(side==0?pair->indi1idx:pair->indi2idx)];
-				for(j=0;j< limitFamilies.size;++j)
+				for(j=0;j< filter->limitFamilies.size;++j)
 					{
-					if(strcmp(indi->family,limitFamilies.data[j])==0) break;
+					if(strcmp(indi->family,filter->limitFamilies.data[j])==0) break;
 					}
-				if(j==limitFamilies.size) break;//family[side] not found in limitFamilies
+				if(j==filter->limitFamilies.size) break;//family[side] not found in limitFamilies
 				}
 			if(side!=2)
 				{
@@ -1831,7 +3166,7 @@ int main_ibd(int argc,char** argv)
 				}
 			}
 		//check individual
-		if(limitIndividuals.size>0)
+		if(filter->limitIndividuals.size>0)
 			{
 			int side;
 			//search on both side if individual 
@@ -1840,13 +3175,13 @@ int main_ibd(int argc,char** argv)
 				IndividualPtr indi=&config->individuals[(side==0?pair->indi1idx:pair->indi2idx)];
 				char* qName=safeMalloc(strlen(indi->family)+strlen(indi->name)+10);
 				sprintf(qName,"%s:%s",indi->family,indi->name);
-				for(j=0;j< limitIndividuals.size;++j)
+				for(j=0;j< filter->limitIndividuals.size;++j)
 					{
 					//ok, in list of limitIndividuals
-					if(strcmp(qName,limitIndividuals.data[j])==0) break;
+					if(strcmp(qName,filter->limitIndividuals.data[j])==0) break;
 					}
 				free(qName);
-				if(j!=limitIndividuals.size) break;//individual[side] found in limitIndividuals
+				if(j!=filter->limitIndividuals.size) break;//individual[side] found in limitIndividuals
 					
 				}
 			if(side==2)
@@ -1856,7 +3191,7 @@ int main_ibd(int argc,char** argv)
 				}
 			}
 		//check pairs
-		if(limitPairs.size>0)
+		if(filter->limitPairs.size>0)
 			{
 			
 			//search if pair defined
@@ -1875,337 +3210,5771 @@ int main_ibd(int argc,char** argv)
 				indi2->family,indi2->name,
 				indi1->family,indi1->name);
 
-			for(j=0;j< limitPairs.size;++j)
+			for(j=0;j< filter->limitPairs.size;++j)
 				{
 				//ok, in list of limitPairs
-				if(strcmp(qName1,limitPairs.data[j])==0) break;
-				if(strcmp(qName2,limitPairs.data[j])==0) break;
+				if(strcmp(qName1,filter->limitPairs.data[j])==0) break;
+				if(strcmp(qName2,filter->limitPairs.data[j])==0) break;
 				}
 			free(qName1);
 			free(qName2);
 			
-			if(j==limitPairs.size)
+			if(j==filter->limitPairs.size)
 				{
 				pair->selected=FALSE;
 				continue;
 				}
 			}
 		}
+	}
 
-	
-	IbdDataSetPtr ibdds= IbdDataSetOpen(config);
-	
-	
-	
-	
+/** output formats for 'ibd' */
+#define IBD_FORMAT_TSV 0
+#define IBD_FORMAT_F32 1
+#define IBD_FORMAT_NPY 2
 
+static int isLittleEndian()
+	{
+	const unsigned short one=1;
+	return *((const unsigned char*)&one)==1;
+	}
 
-	if(print_header && image_filename==NULL)
+/** write a float array as little-endian float32 */
+static void fwriteFloat32LE(float* array,size_t n,FILE* out,const char* filename)
+	{
+	if(!isLittleEndian())
 		{
-		fputs("CHROM\tPOS\tNAME",config->out);
-		for(i=0;i< config->pair_count && print_pairs!=0;++i)
+		size_t i;
+		for(i=0;i< n;++i)
 			{
-			PairIndiPtr pair = &config->pairs[i];
-			if(!pair->selected) continue;
-			IndividualPtr indi1=&config->individuals[pair->indi1idx];
-			IndividualPtr indi2=&config->individuals[pair->indi2idx];		
-			fprintf(config->out,"\t%s:%s|%s:%s",
-				indi1->family,indi1->name,
-				indi2->family,indi2->name
-				);
-
+			unsigned char* p=(unsigned char*)&array[i];
+			unsigned char c;
+			c=p[0];p[0]=p[3];p[3]=c;
+			c=p[1];p[1]=p[2];p[2]=c;
 			}
-		fputs("\tCOUNT_IBD",config->out);
-		fputc('\n',config->out);
 		}
+	if(fwrite((void*)array,sizeof(float),n,out)!=n)
+		{
+		DIE_FAILURE("Cannot write %s : %s.",filename,strerror(errno));
+		}
+	}
 
-	for(i=0;i< config->marker_count;++i)
+/** print a JSON quoted string */
+static void fputJsonString(const char* s,FILE* out)
+	{
+	fputc('\"',out);
+	while(*s!=0)
 		{
-		MarkerPtr marker = &config->markers[i];
-		int count_pairs=0;
-		if( region!=NULL)
-			{
-			if( region->tid != marker->tid ) continue;
-			if( marker->position < region->start) continue;
-			if( marker->position > region->end) continue;
-			}
-		
-		if(image_filename==NULL)
-			{
-			fputs( config->chromosomes[ marker->tid ].name , config->out);
-			fputc('\t', config->out);
-			fprintf(config->out,"%d", marker->position);
-			fputc('\t', config->out);
-			fputs( marker->name , config->out);
-			}
-		for(j=0;j< config->pair_count ;++j)
+		switch(*s)
 			{
-			PairIndiPtr pair = &config->pairs[j];
-			if(!pair->selected) continue;
-			
-
-			hsize_t read_start[3] = {marker->index,pair->index,0};
-			hsize_t read_count[3] = {1,1,3};
-			
-			
-			VERIFY(H5Sselect_hyperslab(
-				ibdds->dataspace_id,
-				H5S_SELECT_SET,
-				read_start, NULL, 
-				read_count, NULL
-				));
-			
-			VERIFY(H5Dread(
-				ibdds->dataset_id,
-				H5T_NATIVE_FLOAT,
-				ibdds->memspace,
-				ibdds->dataspace_id,
-				H5P_DEFAULT,
-				ibd_values
-				));
-
-			if(print_pairs && image_filename==NULL)
-				{
-				fputc('\t', config->out);
-				if(ibd_values[0]> IBD_UNDEFINED)
+			case '\"': fputs("\\\"",out);break;
+			case '\\': fputs("\\\\",out);break;
+			case '\n': fputs("\\n",out);break;
+			case '\t': fputs("\\t",out);break;
+			default: if((unsigned char)*s < 32)
 					{
-					fprintf(config->out,"%f",ibd_values[0]);
+					fprintf(out,"\\u%04x",(unsigned char)*s);
 					}
 				else
 					{
-					fputs("NA",config->out);
+					fputc(*s,out);
 					}
-				}
-			if( ibd_values[0] < treshold && ibd_values[0]> IBD_UNDEFINED) 
-				{
-				count_pairs++;
-				} 
-			}
-		if(image_filename==NULL)
-			{
-			fprintf(config->out,"\t%d",count_pairs);
-			if( fputc('\n', config->out) < 0) break;
+				break;
 			}
-		else
+		++s;
+		}
+	fputc('\"',out);
+	}
+
+/** count the number of selected pairs */
+static size_t countSelectedPairs(ContextPtr config)
+	{
+	size_t i,n=0;
+	for(i=0;i< config->pair_count;++i)
+		{
+		if(config->pairs[i].selected) n++;
+		}
+	return n;
+	}
+
+/**
+ * write the JSON sidecar 'filename.json' describing the rows (markers)
+ * and the columns (selected pairs) of a binary matrix
+ */
+static void writeIbdMatrixSidecar(ContextPtr config,const MarkerRangePtr ranges,size_t n_ranges,const char* filename,int format)
+	{
+	size_t i,r,n_markers=0UL;
+	int first=TRUE;
+	FILE* out;
+	char* json_filename=(char*)safeMalloc(strlen(filename)+10);
+	const char* basename=strrchr(filename,'/');
+	basename=(basename==NULL?filename:basename+1);
+	sprintf(json_filename,"%s.json",filename);
+	for(r=0;r< n_ranges;++r) n_markers+=(ranges[r].end-ranges[r].begin);
+	out=fopen(json_filename,"w");
+	if(out==NULL) DIE_FAILURE("Cannot open %s : %s.",json_filename,strerror(errno));
+	fputs("{\n\"format\":",out);
+	fputJsonString(format==IBD_FORMAT_NPY?"npy":"f32",out);
+	fputs(",\n\"data\":",out);
+	fputJsonString(basename,out);
+	fprintf(out,",\n\"offset\":0,\n\"dtype\":\"<f4\",\n\"order\":\"C\",\n\"shape\":[%zu,%zu,3],\n",
+		n_markers,
+		countSelectedPairs(config)
+		);
+	fputs("\"dimensions\":[\"marker\",\"pair\",\"ibd\"],\n\"ibd\":[\"IBD0\",\"IBD1\",\"IBD2\"],\n\"undefined\":\"NaN\",\n",out);
+	fputs("\"markers\":[",out);
+	for(r=0;r< n_ranges;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;++i)
 			{
-			if(count_pairs>0)
+			MarkerPtr marker=&config->markers[i];
+			if(!first) fputc(',',out);
+			first=FALSE;
+			fputs("\n{\"chrom\":",out);
+			fputJsonString(config->chromosomes[marker->tid].name,out);
+			fprintf(out,",\"position\":%d,\"name\":",marker->position);
+			fputJsonString(marker->name,out);
+			fprintf(out,",\"index\":%d",marker->index);
+			if(ranges[r].label!=NULL)
 				{
-				expData=(ExpDataPtr)safeRealloc(expData,(expData_count+1)*sizeof(ExpData));
-				expData[expData_count].marker_index = marker->index;
-				expData[expData_count].value = count_pairs;
-				expData_count++;
-				if( count_pairs > max_y) max_y=count_pairs;
+				fputs(",\"region\":",out);
+				fputJsonString(ranges[r].label,out);
 				}
+			fputc('}',out);
 			}
 		}
+	fputs("\n],\n\"pairs\":[",out);
+	first=TRUE;
+	for(i=0;i< config->pair_count;++i)
+		{
+		PairIndiPtr pair = &config->pairs[i];
+		IndividualPtr indi1,indi2;
+		if(!pair->selected) continue;
+		indi1=&config->individuals[pair->indi1idx];
+		indi2=&config->individuals[pair->indi2idx];
+		if(!first) fputc(',',out);
+		first=FALSE;
+		fputs("\n{\"family1\":",out);
+		fputJsonString(indi1->family,out);
+		fputs(",\"name1\":",out);
+		fputJsonString(indi1->name,out);
+		fputs(",\"family2\":",out);
+		fputJsonString(indi2->family,out);
+		fputs(",\"name2\":",out);
+		fputJsonString(indi2->name,out);
+		fprintf(out,",\"index\":%d}",pair->index);
+		}
+	fputs("\n]\n}\n",out);
+	if(fclose(out)!=0) DIE_FAILURE("Cannot close %s : %s.",json_filename,strerror(errno));
+	free(json_filename);
+	}
 
-#define COLOR_BLACK 0,0,0
-#define COLOR_WHITE 1,1,1
-#define COLOR_GRAY(g) g,g,g
-#define COLOR_INT_RGB(r,g,b) r/255.0,g/255.0,b/255.0
-	
-	if(image_filename!=NULL)
+/** write the header of a NumPy '.npy' file (version 1.0) for a float32 array [n_markers][n_pairs][3] */
+static void writeNpyHeader(size_t n_markers,size_t n_pairs,FILE* out)
+	{
+	char header[256];
+	size_t len;
+	unsigned char preamble[10]={0x93,'N','U','M','P','Y',1,0,0,0};
+	sprintf(header,"{'descr': '<f4', 'fortran_order': False, 'shape': (%zu, %zu, 3), }",n_markers,n_pairs);
+	len=strlen(header);
+	/* total header size must be a multiple of 64, the dict ends with a '\n' */
+	while((sizeof(preamble)+len+1)%64!=0)
 		{
-		HersheyPtr hershey=HersheyNew();
-		if(hershey==NULL) DIE_FAILURE("Cannot create hershey");
-		Rectangle drawingArea;
- 		cairo_surface_t *surface=NULL;
-  		cairo_t *cr=NULL;
-		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-				imageDimension.width, imageDimension.height);
-		if(surface==NULL) DIE_FAILURE("Cannot create image");
-  		cr = cairo_create(surface);
-		if(cr==NULL) DIE_FAILURE("Cannot create image context");
-		
+		header[len++]=' ';
+		}
+	header[len++]='\n';
+	header[len]=0;
+	preamble[8]=(unsigned char)(len & 0xFF);
+	preamble[9]=(unsigned char)((len>>8) & 0xFF);
+	fwrite((void*)preamble,sizeof(unsigned char),sizeof(preamble),out);
+	fwrite((void*)header,sizeof(char),len,out);
+	}
 
-		if(max_y==0) max_y=1;
-		drawingArea.x=	100;
-		drawingArea.width= imageDimension.width-200;
-		drawingArea.y=	50;
-		drawingArea.height= imageDimension.height-100;		
-		//draw background
-		cairo_set_source_rgb (cr, COLOR_WHITE);
-		cairo_rectangle(cr,0,0,imageDimension.width,imageDimension.height);
-		cairo_fill(cr);		
+/**
+ * export the selected pairs for the markers of each range
+ * as a binary float32 matrix [marker][pair][3]. '/ibd' is read by blocks of
+ * complete marker rows, undefined values are written as NaN.
+ */
+static void exportIbdMatrix(ContextPtr config,IbdDataSetPtr ds,const MarkerRangePtr ranges,size_t n_ranges,int format,const char* filename)
+	{
+	size_t i,j,k,r,n_markers_total=0UL;
+	size_t n_selected=countSelectedPairs(config);
+	size_t row_size=MAX(1,config->pair_count*3);
+	size_t block_markers=MAX(1,IBD_READ_BLOCK_SIZE/(row_size*sizeof(float)));
+	float* block=(float*)safeMalloc(sizeof(float)*row_size*block_markers);
+	float* selected=(float*)safeMalloc(sizeof(float)*MAX(1,n_selected*3));
+	FILE* out=fopen(filename,"wb");
+	if(out==NULL) DIE_FAILURE("Cannot open %s : %s.",filename,strerror(errno));
+
+	for(r=0;r< n_ranges;++r) n_markers_total+=(ranges[r].end-ranges[r].begin);
+	DEBUG("exporting %zu markers x %zu pairs to %s",n_markers_total,n_selected,filename);
+	if(format==IBD_FORMAT_NPY)
+		{
+		writeNpyHeader(n_markers_total,n_selected,out);
+		}
 
-		//draw y axis
-		int n_log10=(int)floor(log10(max_y));
-		double max_y2 = 0;
-		while(max_y2 < max_y)
+	for(r=0;r< n_ranges;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;i+=block_markers)
 			{
-			max_y2+=pow(10, n_log10);
+			size_t n_markers=MIN(block_markers,ranges[r].end-i);
+			IbdDataSetReadMarkers(config,ds,i,n_markers,block);
+			for(j=0;j< n_markers;++j)
+				{
+				float* row=&block[j*row_size];
+				size_t n=0;
+				for(k=0;k< config->pair_count;++k)
+					{
+					int s;
+					if(!config->pairs[k].selected) continue;
+					for(s=0;s<3;++s)
+						{
+						float v=row[k*3+s];
+						selected[n++]=(v > IBD_UNDEFINED ? v : NAN);
+						}
+					}
+				fwriteFloat32LE(selected,n,out,filename);
+				}
 			}
-		int max_y=max_y2;
+		}
+	if(fclose(out)!=0) DIE_FAILURE("Cannot close %s : %s.",filename,strerror(errno));
+	writeIbdMatrixSidecar(config,ranges,n_ranges,filename,format);
+	free(selected);
+	free(block);
+	}
 
+/**
+ * Query cache.
+ * The text output of a query is saved in 'cache_dir/(hash).ibdcache' where 'hash' is computed from
+ * the identity of the database (real path, device, inode, size, mtime, git hash of ibddb) and from the normalized
+ * parameters of the query. Cached files are touched when used, and the least recently used
+ * files are removed when the size of the directory exceeds 'max_size'.
+ * The output is first written in '(hash).ibdcache.(pid).tmp', renamed at the end of the query.
+ */
+#define QUERY_CACHE_SUFFIX ".ibdcache"
+#define QUERY_CACHE_TMP_SUFFIX ".tmp"
+/** a temporary file older than this (seconds) is an orphan, even if its pid is alive */
+#define QUERY_CACHE_TMP_MAX_AGE (24*60*60)
+#define QUERY_CACHE_DEFAULT_SIZE_MB 1024
+#define QUERY_CACHE_ENV "IBDDB_CACHE_DIR"
+
+typedef struct query_hash_t
+	{
+	uint64_t h1;
+	uint64_t h2;
+	} QueryHash,*QueryHashPtr;
 
-		for(i=0;i<= 10;++i)
-			{
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
-			double cy = drawingArea.y + drawingArea.height -(i/10.0)*drawingArea.height ;
-			
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
-			cairo_move_to (cr, drawingArea.x-5, cy);
-			cairo_line_to (cr, drawingArea.x, cy);
-			cairo_stroke (cr);
-			
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.5));
-			cairo_move_to (cr, drawingArea.x, cy);
-			cairo_line_to (cr, drawingArea.x+drawingArea.width, cy);
-			cairo_stroke (cr);
+/** FNV-1a on two different offsets */
+static void QueryHashUpdate(QueryHashPtr h,const void* data,size_t n)
+	{
+	size_t i;
+	const unsigned char* p=(const unsigned char*)data;
+	for(i=0;i< n;++i)
+		{
+		h->h1 = (h->h1 ^ p[i]) * 1099511628211ULL;
+		h->h2 = (h->h2 ^ p[i]) * 1099511628211ULL;
+		}
+	}
 
-			char* label=safeMalloc(100);
-			sprintf(label,"%.2f", (i/10.0)*max_y);
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.2));
-			HersheyPaint(hershey,
-				cr,label,
-				drawingArea.x - strlen(label)*7,
-				cy-5,
-				strlen(label)*7 -10,
-				10);
-			cairo_stroke (cr);
-			free(label);
-			}
+static void QueryHashString(QueryHashPtr h,const char* s)
+	{
+	if(s==NULL) s="\\0(null)";
+	QueryHashUpdate(h,s,strlen(s)+1);
+	}
 
+static void QueryHashLong(QueryHashPtr h,long long v)
+	{
+	char tmp[30];
+	sprintf(tmp,"%lld",v);
+	QueryHashString(h,tmp);
+	}
 
+static void QueryHashDouble(QueryHashPtr h,double v)
+	{
+	char tmp[50];
+	sprintf(tmp,"%.9g",v);
+	QueryHashString(h,tmp);
+	}
 
+/** hash the identity of a file: real path, device, inode, size and modification time (in ns) */
+static void QueryHashFile(QueryHashPtr h,const char* filename)
+	{
+	char resolved[PATH_MAX];
+	struct stat st;
+	if(realpath(filename,resolved)==NULL || stat(resolved,&st)!=0)
+		{
+		DIE_FAILURE("Cannot stat %s : %s.",filename,strerror(errno));
+		}
+	QueryHashString(h,resolved);
+	QueryHashLong(h,(long long)st.st_dev);
+	QueryHashLong(h,(long long)st.st_ino);
+	QueryHashLong(h,(long long)st.st_size);
+	QueryHashLong(h,(long long)st.st_mtim.tv_sec);
+	QueryHashLong(h,(long long)st.st_mtim.tv_nsec);
+	}
 
-#define BASE2PIXEL(chrom,POS)  (drawingArea.x+((region!=NULL?POS:config->chromosomes[chrom].cumulative_start+POS)/(double)genome_size)*drawingArea.width)
+static int strPtrCompare(const void* a,const void *b)
+	{
+	return strcmp(*(char* const*)a,*(char* const*)b);
+	}
 
-		if(region==NULL)
-			{
-			
-			for(i=0;i< config->chromosome_count;++i)
-				{
+/** hash a list of strings, the order of the strings doesn't matter */
+static void QueryHashStrings(QueryHashPtr h,char** data,size_t n)
+	{
+	size_t i;
+	char** sorted=(char**)safeMalloc(sizeof(char*)*MAX(1,n));
+	memcpy((void*)sorted,(void*)data,sizeof(char*)*n);
+	qsort((void*)sorted,n,sizeof(char*),strPtrCompare);
+	QueryHashLong(h,(long long)n);
+	for(i=0;i< n;++i)
+		{
+		QueryHashString(h,sorted[i]);
+		}
+	free(sorted);
+	}
 
-				double chrom_x1=BASE2PIXEL(i,0);
-				double chrom_x2=BASE2PIXEL(i,config->chromosomes[i].length);
-				
-				if(i%2==0)
-					{
-					cairo_set_source_rgb (cr, COLOR_GRAY(0.95));
-					}
-				else
-					{
-					cairo_set_source_rgb (cr,  COLOR_GRAY(0.90));
-					}
-				cairo_rectangle(cr,
-					chrom_x1,
-					drawingArea.y,
-					chrom_x2-chrom_x1,
-					drawingArea.height
-					);
+/** create the path of the cached file from the hash */
+static char* QueryCacheFilename(const char* cache_dir,const QueryHashPtr h)
+	{
+	char* filename=(char*)safeMalloc(strlen(cache_dir)+strlen(QUERY_CACHE_SUFFIX)+40);
+	sprintf(filename,"%s/%016"PRIx64"%016"PRIx64 QUERY_CACHE_SUFFIX,cache_dir,h->h1,h->h2);
+	return filename;
+	}
 
-				cairo_fill(cr);
+/** the temporary file of the running query, removed if the query fails */
+static char* query_cache_tmp_filename = NULL;
+/** the process writing it: the forked workers (--threads) must not remove it */
+static pid_t query_cache_tmp_pid = 0;
 
-			
-				
-				cairo_set_source_rgb (cr, COLOR_BLACK);
-				double chrom_name_len = MIN( strlen(config->chromosomes[i].name)*7, chrom_x2-chrom_x1 );
-				 
-				HersheyPaint(
-					hershey,
-					cr,config->chromosomes[i].name,
-					(chrom_x1+chrom_x2)/2.0 - chrom_name_len/2.0,
-					drawingArea.y/2.0-5,
-					chrom_name_len,
-					10);
-				
-				cairo_stroke(cr); 
+static void QueryCacheRemoveTmp(void)
+	{
+	if(query_cache_tmp_filename==NULL || query_cache_tmp_pid!=getpid()) return;
+	unlink(query_cache_tmp_filename);
+	query_cache_tmp_filename=NULL;
+	}
 
-				//draw x-axis
-				int x;
-				for(x=1;x<10 && x< config->chromosomes[i].length &&
-					(chrom_x2-chrom_x1)>100
-					;++x)
-					{
-					int pos=(int)(config->chromosomes[i].length/10.0)*x;
-					double ticks_x=BASE2PIXEL(i,pos);
-					double ticks_y=drawingArea.y+drawingArea.height;
-					cairo_move_to (cr, ticks_x, ticks_y);
-					cairo_line_to (cr, ticks_x, ticks_y+5);
-					cairo_stroke (cr);
-					
-					cairo_save (cr);
-					cairo_set_line_width (cr, 0.5);
-					cairo_translate(cr, ticks_x+5, ticks_y+6);
-					cairo_rotate(cr,  1.57079632679);
-					char* label=safeMalloc(20);
-					sprintf(label,"%d",pos);
-					HersheyPaint(
-						hershey,cr,label,
-						0,0,
-						MIN(strlen(label)*7,(imageDimension.height-(drawingArea.y+drawingArea.height+10))),10
-						);
-					
-					cairo_stroke (cr);
-					cairo_restore (cr);
-					free(label);
-					} 
-				}
-			}
-		else
-			{
-			assert(rgn_str!=NULL);
-			
-			double chrom_name_len = MIN( strlen(rgn_str)*7, drawingArea.width );
-			
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
-			HersheyPaint(hershey,
-				cr,rgn_str,
-				drawingArea.x + drawingArea.width/2.0 - chrom_name_len/2.0,
-				drawingArea.height/2.0-5,
-				chrom_name_len,
-				10);
-			
-			cairo_stroke(cr);
-			}
-		
-		
-		//draw data points
-		cairo_set_line_width (cr, 0.2);
-		for(i=0;i< expData_count;++i)
-			{
-			MarkerPtr marker=&config->markers[expData[i].marker_index];
-			double cx = BASE2PIXEL(marker->tid,marker->position);
-			double cy = drawingArea.y + drawingArea.height - (expData[i].value/max_y)*drawingArea.height ;
-			cairo_set_source_rgb (cr, COLOR_GRAY(0.3));
-			cairo_new_path (cr);
-			cairo_move_to (cr, cx-5, cy);
-			cairo_line_to (cr, cx+5, cy);
-			cairo_move_to (cr, cx, cy-5);
-			cairo_line_to (cr, cx, cy+5);
-			cairo_close_path (cr);
-			cairo_stroke (cr);
-			}
+/** create the temporary file of 'cache_filename'. It is removed at exit unless QueryCacheCommit is called */
+static FILE* QueryCacheCreateTmp(const char* cache_filename)
+	{
+	static int atexit_registered=0;
+	FILE* out;
+	if(!atexit_registered)
+		{
+		atexit(QueryCacheRemoveTmp);
+		atexit_registered=1;
+		}
+	query_cache_tmp_filename=(char*)safeMalloc(strlen(cache_filename)+30);
+	query_cache_tmp_pid=getpid();
+	sprintf(query_cache_tmp_filename,"%s.%d" QUERY_CACHE_TMP_SUFFIX,cache_filename,(int)query_cache_tmp_pid);
+	out=fopen(query_cache_tmp_filename,"w");
+	if(out==NULL)
+		{
+		char* tmp=query_cache_tmp_filename;
+		query_cache_tmp_filename=NULL;
+		DIE_FAILURE("Cannot open %s : %s.",tmp,strerror(errno));
+		}
+	return out;
+	}
 
-		//frame
-		cairo_set_source_rgb (cr,COLOR_BLACK);
-		cairo_rectangle (cr, drawingArea.x, drawingArea.y,drawingArea.width,drawingArea.height);
-		cairo_stroke (cr);
-		
-		DEBUG("saving image as %s.",image_filename);
-		if(!(strEndsWith(image_filename,".png") ||
-			strEndsWith(image_filename,".PNG")))
-			{
-			fprintf(stderr,"#WARNING. Image filename should ends with '.png'\n");
-			}
-		
-		cairo_surface_write_to_png(surface, image_filename);
-			
-  		cairo_destroy(cr);
-  		cairo_surface_destroy(surface);
-		HersheyFree(hershey);
-		free(expData);
-		}//end of image
-	
-	IbdDataSetClose(ibdds);
-	
-	if(region!=NULL)
+/** close the temporary file and rename it to 'cache_filename' */
+static void QueryCacheCommit(FILE* out,const char* cache_filename)
+	{
+	char* tmp=query_cache_tmp_filename;
+	if(fclose(out)!=0)
 		{
-		free(region);
+		DIE_FAILURE("Cannot close %s : %s.",tmp,strerror(errno));
+		}
+	if(rename(tmp,cache_filename)!=0)
+		{
+		DIE_FAILURE("Cannot rename %s : %s.",tmp,strerror(errno));
 		}
+	query_cache_tmp_filename=NULL;
+	free(tmp);
+	}
 
-	ContextFree(config);
-	return EXIT_SUCCESS;
+/** copy a file to 'out'. Returns 0 on success */
+static int QueryCacheCopy(const char* filename,FILE* out)
+	{
+	char buffer[BUFSIZ];
+	size_t n;
+	FILE* in=fopen(filename,"rb");
+	if(in==NULL) return -1;
+	while((n=fread(buffer,1,BUFSIZ,in))>0)
+		{
+		if(fwrite(buffer,1,n,out)!=n) break;
+		}
+	fclose(in);
+	return 0;
+	}
+
+typedef struct query_cache_entry_t
+	{
+	char* filename;
+	off_t size;
+	time_t mtime;
+	} QueryCacheEntry,*QueryCacheEntryPtr;
+
+static int QueryCacheEntryCompareByTime(const void* a,const void *b)
+	{
+	const QueryCacheEntryPtr i=(const QueryCacheEntryPtr)a;
+	const QueryCacheEntryPtr j=(const QueryCacheEntryPtr)b;
+	if(i->mtime < j->mtime) return -1;
+	if(i->mtime > j->mtime) return 1;
+	return 0;
+	}
+
+/**
+ * is 'name' the temporary file of a query that is gone ? The pid in its name doesn't exist
+ * on this host, or the file is too old (another host sharing the directory).
+ */
+static int QueryCacheIsOrphanTmp(const char* name,const struct stat* st)
+	{
+	const char* p=strstr(name,QUERY_CACHE_SUFFIX ".");
+	long pid;
+	char* endptr=NULL;
+	if(p==NULL || !strEndsWith(name,QUERY_CACHE_TMP_SUFFIX)) return 0;
+	if(time(NULL)-st->st_mtime > QUERY_CACHE_TMP_MAX_AGE) return 1;
+	p+=strlen(QUERY_CACHE_SUFFIX)+1;
+	pid=strtol(p,&endptr,10);
+	if(endptr==p || strcmp(endptr,QUERY_CACHE_TMP_SUFFIX)!=0 || pid<=0) return 0;
+	return kill((pid_t)pid,0)!=0 && errno==ESRCH;
 	}
 
+/**
+ * remove the least recently used files until the size of the cache is lower than max_size.
+ * The temporary files left by the queries that failed are removed.
+ */
+static void QueryCacheEvict(const char* cache_dir,long long max_size)
+	{
+	size_t i,n_entries=0UL;
+	long long total=0LL;
+	QueryCacheEntryPtr entries=NULL;
+	struct dirent* entry;
+	DIR* dir=opendir(cache_dir);
+	if(dir==NULL) return;
+	while((entry=readdir(dir))!=NULL)
+		{
+		struct stat st;
+		char* filename;
+		int is_cache=strEndsWith(entry->d_name,QUERY_CACHE_SUFFIX);
+		if(!is_cache && !strEndsWith(entry->d_name,QUERY_CACHE_TMP_SUFFIX)) continue;
+		filename=(char*)safeMalloc(strlen(cache_dir)+strlen(entry->d_name)+2);
+		sprintf(filename,"%s/%s",cache_dir,entry->d_name);
+		if(stat(filename,&st)!=0)
+			{
+			free(filename);
+			continue;
+			}
+		if(!is_cache)
+			{
+			if(QueryCacheIsOrphanTmp(entry->d_name,&st))
+				{
+				DEBUG("cache: removing orphan %s",filename);
+				unlink(filename);
+				}
+			free(filename);
+			continue;
+			}
+		entries=(QueryCacheEntryPtr)safeRealloc(entries,sizeof(QueryCacheEntry)*(n_entries+1));
+		entries[n_entries].filename=filename;
+		entries[n_entries].size=st.st_size;
+		entries[n_entries].mtime=st.st_mtime;
+		total+=(long long)st.st_size;
+		n_entries++;
+		}
+	closedir(dir);
+	qsort((void*)entries,n_entries,sizeof(QueryCacheEntry),QueryCacheEntryCompareByTime);
+	for(i=0;i< n_entries;++i)
+		{
+		if(total > max_size)
+			{
+			DEBUG("cache: removing %s",entries[i].filename);
+			if(unlink(entries[i].filename)==0) total-=(long long)entries[i].size;
+			}
+		free(entries[i].filename);
+		}
+	free(entries);
+	}
+
+/** a window of markers and its COUNT_IBD */
+typedef struct ibd_window_t
+	{
+	size_t first_marker;
+	size_t n_markers;
+	int start;
+	int end;
+	double mean;
+	int max;
+	} IbdWindow,*IbdWindowPtr;
+
+/** callback to sort the windows on decreasing mean, max and then on position */
+static int IbdWindowCompareByScore(const void* a,const void *b)
+	{
+	const IbdWindow* i=(const IbdWindow*)a;
+	const IbdWindow* j=(const IbdWindow*)b;
+	if(i->mean != j->mean) return (i->mean > j->mean ? -1 : 1);
+	if(i->max != j->max) return (i->max > j->max ? -1 : 1);
+	if(i->first_marker != j->first_marker) return (i->first_marker < j->first_marker ? -1 : 1);
+	if(i->n_markers != j->n_markers) return (i->n_markers < j->n_markers ? -1 : 1);
+	/* windows of bases having the same markers */
+	return (i->start < j->start ? -1 : (i->start > j->start ? 1 : 0));
+	}
+
+/**
+ * bounded heap of the K best windows: heap[0] is the worst of the best windows,
+ * so a new window is compared to heap[0] only.
+ */
+typedef struct window_heap_t
+	{
+	IbdWindowPtr heap;
+	size_t size;
+	size_t capacity;
+	/** number of windows offered to the heap */
+	size_t offered;
+	} WindowHeap,*WindowHeapPtr;
+
+static void WindowHeapSwap(WindowHeapPtr h,size_t i,size_t j)
+	{
+	IbdWindow tmp=h->heap[i];
+	h->heap[i]=h->heap[j];
+	h->heap[j]=tmp;
+	}
+
+static void WindowHeapOffer(WindowHeapPtr h,const IbdWindowPtr w)
+	{
+	size_t i;
+	h->offered++;
+	if(h->capacity==0) return;
+	if(h->size < h->capacity)
+		{
+		/* sift up */
+		i=h->size++;
+		h->heap[i]=*w;
+		while(i>0 && IbdWindowCompareByScore(&h->heap[i],&h->heap[(i-1)/2])>0)
+			{
+			WindowHeapSwap(h,i,(i-1)/2);
+			i=(i-1)/2;
+			}
+		return;
+		}
+	/* not better than the worst of the heap */
+	if(IbdWindowCompareByScore(w,&h->heap[0])>=0) return;
+	/* replace the root and sift down */
+	h->heap[0]=*w;
+	i=0;
+	for(;;)
+		{
+		size_t left=2*i+1,right=2*i+2,worst=i;
+		if(left< h->size && IbdWindowCompareByScore(&h->heap[left],&h->heap[worst])>0) worst=left;
+		if(right< h->size && IbdWindowCompareByScore(&h->heap[right],&h->heap[worst])>0) worst=right;
+		if(worst==i) break;
+		WindowHeapSwap(h,i,worst);
+		i=worst;
+		}
+	}
+
+/**
+ * select the K best non-overlapping windows of one chromosome: the windows are sorted by score
+ * and a window is kept if it doesn't overlap a better window. The 'n_selected' best windows are moved
+ * at the beginning of the array, by decreasing score.
+ */
+static size_t selectNonOverlappingWindows(IbdWindowPtr windows,size_t n,size_t top_k)
+	{
+	size_t i,j,n_selected=0UL;
+	qsort(windows,n,sizeof(IbdWindow),IbdWindowCompareByScore);
+	for(i=0;i< n && n_selected< top_k;++i)
+		{
+		for(j=0;j< n_selected;++j)
+			{
+			if(windows[i].start < windows[j].end && windows[j].start < windows[i].end) break;
+			}
+		if(j< n_selected) continue;
+		windows[n_selected++]=windows[i];
+		}
+	return n_selected;
+	}
+
+/**
+ * the COUNT_IBD plotted by '--image', aggregated while the markers are scanned
+ * into the min, the max and the number of the values of each column of pixels
+ */
+typedef struct image_bins_t
+	{
+	/** number of columns of the drawing area */
+	size_t width;
+	/** if not NULL, the region plotted, else the whole genome using the cumulative_start of the chromosomes */
+	RegionPtr region;
+	double genome_size;
+	double* min;
+	double* max;
+	size_t* count;
+	double max_y;
+	/** title of the panel (--image-per), or NULL */
+	char* title;
+	} ImageBins,*ImageBinsPtr;
+
+/** --image-per: one image for all the markers, one panel per chromosome or per group of pairs of the same family */
+#define IMAGE_PER_NONE 0
+#define IMAGE_PER_CHROM 1
+#define IMAGE_PER_FAMILY 2
+
+static ImageBinsPtr ImageBinsNew(size_t width,RegionPtr region,long genome_size)
+	{
+	ImageBinsPtr bins=(ImageBinsPtr)safeCalloc(1,sizeof(ImageBins));
+	bins->width=MAX(1,width);
+	bins->region=region;
+	bins->genome_size=(double)MAX(1,genome_size);
+	bins->min=(double*)safeCalloc(bins->width,sizeof(double));
+	bins->max=(double*)safeCalloc(bins->width,sizeof(double));
+	bins->count=(size_t*)safeCalloc(bins->width,sizeof(size_t));
+	return bins;
+	}
+
+static void ImageBinsFree(ImageBinsPtr bins)
+	{
+	if(bins==NULL) return;
+	free(bins->min);
+	free(bins->max);
+	free(bins->count);
+	free(bins->title);
+	free(bins);
+	}
+
+/** the column of pixels of a marker */
+static size_t ImageBinsColumn(ContextPtr config,const ImageBinsPtr bins,const MarkerPtr marker)
+	{
+	double pos=(bins->region!=NULL?
+		(double)(marker->position-bins->region->start):
+		(double)(config->chromosomes[marker->tid].cumulative_start+marker->position));
+	double x=floor((pos/bins->genome_size)*bins->width);
+	if(x< 0.0) return 0UL;
+	if(x>=(double)bins->width) return bins->width-1;
+	return (size_t)x;
+	}
+
+static void ImageBinsAdd(ImageBinsPtr bins,size_t column,double value)
+	{
+	if(bins->count[column]==0 || value< bins->min[column]) bins->min[column]=value;
+	if(bins->count[column]==0 || value> bins->max[column]) bins->max[column]=value;
+	bins->count[column]++;
+	if(value> bins->max_y) bins->max_y=value;
+	}
+
+/** add the bins min/max/count (e.g. computed by another process) to 'bins' */
+static void ImageBinsMerge(ImageBinsPtr bins,const double* min,const double* max,const size_t* count)
+	{
+	size_t i;
+	for(i=0;i< bins->width;++i)
+		{
+		if(count[i]==0) continue;
+		if(bins->count[i]==0 || min[i]< bins->min[i]) bins->min[i]=min[i];
+		if(bins->count[i]==0 || max[i]> bins->max[i]) bins->max[i]=max[i];
+		bins->count[i]+=count[i];
+		if(max[i]> bins->max_y) bins->max_y=max[i];
+		}
+	}
+
+/** write the min/max/count of the bins, returns 0 on success */
+static int ImageBinsWrite(const ImageBinsPtr bins,FILE* out)
+	{
+	if(fwrite((void*)bins->min,sizeof(double),bins->width,out)!=bins->width ||
+		fwrite((void*)bins->max,sizeof(double),bins->width,out)!=bins->width ||
+		fwrite((void*)bins->count,sizeof(size_t),bins->width,out)!=bins->width)
+		{
+		return -1;
+		}
+	return 0;
+	}
+
+/** read the min/max/count written by ImageBinsWrite and merge them into 'bins', returns 0 on success */
+static int ImageBinsReadMerge(ImageBinsPtr bins,FILE* in)
+	{
+	int ret=0;
+	ImageBinsPtr tmp=ImageBinsNew(bins->width,NULL,1L);
+	if(fread((void*)tmp->min,sizeof(double),tmp->width,in)!=tmp->width ||
+		fread((void*)tmp->max,sizeof(double),tmp->width,in)!=tmp->width ||
+		fread((void*)tmp->count,sizeof(size_t),tmp->width,in)!=tmp->width)
+		{
+		ret=-1;
+		}
+	else
+		{
+		ImageBinsMerge(bins,tmp->min,tmp->max,tmp->count);
+		}
+	ImageBinsFree(tmp);
+	return ret;
+	}
+
+/**
+ * '--heatmap': the IBD0/IBD1/IBD2 of the selected pairs (rows) x the markers (columns), downsampled
+ * while the markers are scanned into a grid no larger than the pixels of the drawing area
+ */
+typedef struct heatmap_t
+	{
+	/** size of the grid */
+	size_t n_columns;
+	size_t n_rows;
+	/** number of markers of the scanned ranges, the k-th marker is in the column k*n_columns/n_markers */
+	size_t n_markers;
+	/** the selected pairs in the order of the rows (grouped by pair_group if any) */
+	size_t* ranked_pairs;
+	size_t n_pairs;
+	/** if there are some groups of pairs, group g is ranked_pairs[group_offsets[g],group_offsets[g+1][ */
+	size_t* group_offsets;
+	size_t n_groups;
+	/** row of the grid of each pair (pair_count items), -1 if the pair is not selected */
+	int* pair_row;
+	/** sum of IBD0,IBD1,IBD2 [row][column][3] and number of defined values [row][column] of the cells */
+	double* sums;
+	size_t* count;
+	} Heatmap,*HeatmapPtr;
+
+/** create a heatmap of the selected pairs of 'config', ordered by 'pair_group' if not NULL */
+static HeatmapPtr HeatmapNew(ContextPtr config,size_t max_columns,size_t max_rows,size_t n_markers,const int* pair_group,size_t n_groups)
+	{
+	size_t i,g;
+	HeatmapPtr h=(HeatmapPtr)safeCalloc(1,sizeof(Heatmap));
+	h->pair_row=(int*)safeMalloc(MAX(1,config->pair_count)*sizeof(int));
+	h->ranked_pairs=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	for(i=0;i< config->pair_count;++i)
+		{
+		h->pair_row[i]=-1;
+		if(config->pairs[i].selected) h->n_pairs++;
+		}
+	h->n_groups=(pair_group==NULL?1UL:n_groups);
+	h->group_offsets=(size_t*)safeCalloc(h->n_groups+1,sizeof(size_t));
+	/* counting sort of the selected pairs on their group */
+	for(i=0;i< config->pair_count;++i)
+		{
+		if(!config->pairs[i].selected) continue;
+		h->group_offsets[(pair_group==NULL?0:pair_group[i])+1]++;
+		}
+	for(g=0;g< h->n_groups;++g) h->group_offsets[g+1]+=h->group_offsets[g];
+	for(i=0;i< config->pair_count;++i)
+		{
+		if(!config->pairs[i].selected) continue;
+		h->ranked_pairs[h->group_offsets[(pair_group==NULL?0:pair_group[i])]++]=i;
+		}
+	for(g=h->n_groups;g>0;--g) h->group_offsets[g]=h->group_offsets[g-1];
+	h->group_offsets[0]=0UL;
+	
+	h->n_markers=MAX(1,n_markers);
+	h->n_columns=MAX(1,MIN(max_columns,n_markers));
+	h->n_rows=MAX(1,MIN(max_rows,h->n_pairs));
+	for(i=0;i< h->n_pairs;++i)
+		{
+		h->pair_row[h->ranked_pairs[i]]=(int)((i*h->n_rows)/h->n_pairs);
+		}
+	h->sums=(double*)safeCalloc(h->n_rows*h->n_columns*3,sizeof(double));
+	h->count=(size_t*)safeCalloc(h->n_rows*h->n_columns,sizeof(size_t));
+	return h;
+	}
+
+static void HeatmapFree(HeatmapPtr h)
+	{
+	if(h==NULL) return;
+	free(h->pair_row);
+	free(h->ranked_pairs);
+	free(h->group_offsets);
+	free(h->sums);
+	free(h->count);
+	free(h);
+	}
+
+/** add the k-th scanned marker. The IBD0,IBD1,IBD2 of the pair selected[i] are row[columns[i]+0,1,2] */
+static void HeatmapAdd(HeatmapPtr h,size_t marker_rank,const float* row,const size_t* columns,const size_t* selected,size_t n_selected)
+	{
+	size_t i,column=(marker_rank*h->n_columns)/h->n_markers;
+	for(i=0;i< n_selected;++i)
+		{
+		const float* ibd=&row[columns[i]];
+		size_t cell;
+		if(!(ibd[0] > IBD_UNDEFINED)) continue;
+		cell=(size_t)h->pair_row[selected[i]]*h->n_columns+column;
+		h->sums[cell*3+0]+=ibd[0];
+		h->sums[cell*3+1]+=ibd[1];
+		h->sums[cell*3+2]+=ibd[2];
+		h->count[cell]++;
+		}
+	}
+
+/** write the cells of the heatmap, returns 0 on success */
+static int HeatmapWrite(const HeatmapPtr h,FILE* out)
+	{
+	size_t n=h->n_rows*h->n_columns;
+	if(fwrite((void*)h->sums,sizeof(double),n*3,out)!=n*3 ||
+		fwrite((void*)h->count,sizeof(size_t),n,out)!=n)
+		{
+		return -1;
+		}
+	return 0;
+	}
+
+/** read the cells written by HeatmapWrite and add them to 'h', returns 0 on success */
+static int HeatmapReadMerge(HeatmapPtr h,FILE* in)
+	{
+	size_t i,n=h->n_rows*h->n_columns;
+	int ret=0;
+	double* sums=(double*)safeMalloc(n*3*sizeof(double));
+	size_t* count=(size_t*)safeMalloc(n*sizeof(size_t));
+	if(fread((void*)sums,sizeof(double),n*3,in)!=n*3 ||
+		fread((void*)count,sizeof(size_t),n,in)!=n)
+		{
+		ret=-1;
+		}
+	else
+		{
+		for(i=0;i< n*3;++i) h->sums[i]+=sums[i];
+		for(i=0;i< n;++i) h->count[i]+=count[i];
+		}
+	free(sums);
+	free(count);
+	return ret;
+	}
+
+/** parameters and results of a scan of the markers in 'ibd' */
+typedef struct ibd_scan_t
+	{
+	float treshold;
+	int print_pairs;
+	/** if true, collect the COUNT_IBD in 'panels' instead of printing the rows */
+	boolean_t image;
+	/** one of IMAGE_PER_*. The panel of a marker is panels[0], panels[marker->tid] or one panel per group of pair_group */
+	int image_per;
+	ImageBinsPtr* panels;
+	size_t n_panels;
+	/** if not NULL, the COUNT_IBD of the i-th marker of the concatenated ranges is stored in counts[i] */
+	int* counts;
+	/** if not NULL, the windows of windowIbdCounts are offered to this heap of the best windows ('peaks') */
+	WindowHeapPtr peaks;
+	/** if not NULL, pair_group[pair index] is the group of the selected pair (--group-by) and a count per group is printed */
+	int* pair_group;
+	size_t n_groups;
+	/** how '/ibd' is read: one of IBD_PLAN_*. IBD_PLAN_AUTO: chosen by planIbdRead */
+	int read_plan;
+	/** if not NULL, the IBD of the selected pairs are also collected in this heatmap (--heatmap) */
+	HeatmapPtr heatmap;
+	} IbdScan,*IbdScanPtr;
+
+/** the panel of the image where the COUNT_IBD of all the selected pairs at 'marker' is plotted */
+static ImageBinsPtr scanImagePanel(IbdScanPtr scan,const MarkerPtr marker)
+	{
+	return scan->panels[scan->image_per==IMAGE_PER_CHROM?(size_t)marker->tid:0UL];
+	}
+
+static size_t countMarkersInRanges(const MarkerRangePtr ranges,size_t n_ranges)
+	{
+	size_t r,n=0UL;
+	for(r=0;r< n_ranges;++r) n+=(ranges[r].end-ranges[r].begin);
+	return n;
+	}
+
+/**
+ * the selected pairs are read as a block [pair_start,pair_end[ of columns of '/ibd'.
+ * Fills 'columns' with the offset of the IBD0 of each selected pair in a row of this block.
+ * returns the number of selected pairs.
+ */
+static size_t selectedPairColumns(ContextPtr config,size_t* columns,size_t* pair_start,size_t* pair_end)
+	{
+	size_t j,n_selected=0UL;
+	*pair_start=0UL;
+	*pair_end=0UL;
+	for(j=0;j< config->pair_count ;++j)
+		{
+		if(!config->pairs[j].selected) continue;
+		if(n_selected==0) *pair_start=j;
+		*pair_end=j+1;
+		columns[n_selected++]=j;
+		}
+	for(j=0;j< n_selected;++j) columns[j]=(columns[j]-(*pair_start))*3;
+	return n_selected;
+	}
+
+/** the strategies to read the selected pairs of '/ibd' */
+#define IBD_PLAN_AUTO 0
+/* use the rows of the mapped dataset in place */
+#define IBD_PLAN_MMAP 1
+/* one hyperslab per block: the markers x the bounding box of the selected pairs */
+#define IBD_PLAN_BBOX 2
+/* one hyperslab per block: the markers x all the pairs */
+#define IBD_PLAN_ROWS 3
+/* one selection per block: the union of the runs of consecutive selected pairs */
+#define IBD_PLAN_GATHER 4
+#define IBD_PLAN_COUNT 5
+static const char* IBD_PLAN_NAMES[IBD_PLAN_COUNT]={"auto","mmap","bbox","rows","gather"};
+/** cost of a call to H5Dread (selection, type conversion...) in bytes */
+#define IBD_PLAN_CALL_COST (64.0*1024.0)
+/** cost of a non-contiguous piece of the file (a seek or a chunk lookup) in bytes */
+#define IBD_PLAN_PIECE_COST (4.0*1024.0)
+/** size of a page of the mapped dataset */
+#define IBD_PLAN_PAGE_SIZE 4096.0
+
+/** the estimated cost of each strategy, see planIbdRead */
+typedef struct ibd_read_plan_t
+	{
+	size_t n_markers;
+	size_t n_selected;
+	/** number of pairs in the bounding box of the selected pairs */
+	size_t span;
+	/** number of runs of consecutive selected pairs */
+	size_t n_runs;
+	boolean_t available[IBD_PLAN_COUNT];
+	/** bytes read from the file (or from the mapped pages) */
+	double bytes[IBD_PLAN_COUNT];
+	/** calls to H5Dread */
+	double calls[IBD_PLAN_COUNT];
+	/** non-contiguous pieces of the file or chunks */
+	double pieces[IBD_PLAN_COUNT];
+	double cost[IBD_PLAN_COUNT];
+	int chosen;
+	} IbdReadPlan,*IbdReadPlanPtr;
+
+/** number of blocks of IBD_READ_BLOCK_SIZE needed to read the ranges with 'row_width' pairs per marker */
+static double planBlockCount(const MarkerRangePtr ranges,size_t n_ranges,size_t row_width)
+	{
+	size_t r,block_markers=MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,row_width)*3*sizeof(float)));
+	double n=0.0;
+	for(r=0;r< n_ranges;++r)
+		{
+		n+=(double)((ranges[r].end-ranges[r].begin+block_markers-1)/block_markers);
+		}
+	return n;
+	}
+
+/**
+ * estimate the bytes and the HDF5 calls needed by each strategy to read the selected pairs of the ranges,
+ * from the layout of '/ibd' (mapped, contiguous or chunked) and the distribution of the selected pairs.
+ * If 'forced' is not IBD_PLAN_AUTO and available, it is chosen, else the cheapest strategy is chosen.
+ * returns the chosen strategy
+ */
+static int planIbdRead(ContextPtr config,IbdDataSetPtr ds,const MarkerRangePtr ranges,size_t n_ranges,int forced,IbdReadPlanPtr plan)
+	{
+	size_t j,pair_start=0UL,pair_end=0UL;
+	int p;
+	const double cell=3.0*sizeof(float);
+	double n;
+	memset((void*)plan,0,sizeof(IbdReadPlan));
+	plan->n_markers=countMarkersInRanges(ranges,n_ranges);
+	for(j=0;j< config->pair_count;++j)
+		{
+		if(!config->pairs[j].selected) continue;
+		if(plan->n_selected==0) pair_start=j;
+		if(plan->n_selected==0 || j!=pair_end) plan->n_runs++;
+		pair_end=j+1;
+		plan->n_selected++;
+		}
+	plan->span=pair_end-pair_start;
+	n=(double)plan->n_markers;
+	
+	plan->available[IBD_PLAN_MMAP]=(ds->mapped!=NULL);
+	plan->available[IBD_PLAN_BBOX]=TRUE;
+	plan->available[IBD_PLAN_ROWS]=TRUE;
+	plan->available[IBD_PLAN_GATHER]=TRUE;
+	
+	if(plan->n_selected>0)
+		{
+		/* the pages touched in each mapped row */
+		plan->bytes[IBD_PLAN_MMAP]=n*MIN(plan->span*cell,plan->n_runs*IBD_PLAN_PAGE_SIZE+plan->n_selected*cell);
+		plan->calls[IBD_PLAN_BBOX]=planBlockCount(ranges,n_ranges,plan->span);
+		plan->calls[IBD_PLAN_ROWS]=planBlockCount(ranges,n_ranges,config->pair_count);
+		plan->calls[IBD_PLAN_GATHER]=planBlockCount(ranges,n_ranges,plan->n_selected);
+		if(ds->chunk_cache==NULL)
+			{
+			/* contiguous: a piece of file per block of rows, or per row and per run */
+			plan->bytes[IBD_PLAN_BBOX]=n*plan->span*cell;
+			plan->bytes[IBD_PLAN_ROWS]=n*config->pair_count*cell;
+			plan->bytes[IBD_PLAN_GATHER]=n*plan->n_selected*cell;
+			plan->pieces[IBD_PLAN_BBOX]=(plan->span==config->pair_count?plan->calls[IBD_PLAN_BBOX]:n);
+			plan->pieces[IBD_PLAN_ROWS]=plan->calls[IBD_PLAN_ROWS];
+			plan->pieces[IBD_PLAN_GATHER]=n*plan->n_runs;
+			}
+		else
+			{
+			/* chunked: whole chunks are read and decompressed, the rows of chunks are kept in the chunk cache between two blocks */
+			size_t c0=(size_t)ds->chunk_dims[0],c1=(size_t)ds->chunk_dims[1];
+			double chunk_bytes=(double)(ds->chunk_dims[0]*ds->chunk_dims[1]*ds->chunk_dims[2]*sizeof(float));
+			double chunk_rows=0.0,cols_gather=0.0;
+			size_t r,last_col=(size_t)-1;
+			for(r=0;r< n_ranges;++r)
+				{
+				if(ranges[r].end==ranges[r].begin) continue;
+				chunk_rows+=(double)((ranges[r].end-1)/c0-ranges[r].begin/c0+1);
+				}
+			for(j=pair_start;j< pair_end;++j)
+				{
+				if(!config->pairs[j].selected || j/c1==last_col) continue;
+				last_col=j/c1;
+				cols_gather++;
+				}
+			plan->pieces[IBD_PLAN_BBOX]=chunk_rows*(double)((pair_end-1)/c1-pair_start/c1+1);
+			plan->pieces[IBD_PLAN_ROWS]=chunk_rows*(double)((config->pair_count+c1-1)/c1);
+			plan->pieces[IBD_PLAN_GATHER]=chunk_rows*cols_gather;
+			for(p=IBD_PLAN_BBOX;p<=IBD_PLAN_GATHER;++p) plan->bytes[p]=plan->pieces[p]*chunk_bytes;
+			}
+		}
+	plan->chosen=IBD_PLAN_AUTO;
+	for(p=IBD_PLAN_MMAP;p< IBD_PLAN_COUNT;++p)
+		{
+		if(!plan->available[p]) continue;
+		plan->cost[p]=plan->bytes[p]+plan->calls[p]*IBD_PLAN_CALL_COST+plan->pieces[p]*IBD_PLAN_PIECE_COST;
+		if(plan->chosen==IBD_PLAN_AUTO || plan->cost[p] < plan->cost[plan->chosen]) plan->chosen=p;
+		}
+	if(forced!=IBD_PLAN_AUTO)
+		{
+		if(plan->available[forced])
+			{
+			plan->chosen=forced;
+			}
+		else
+			{
+			fprintf(stderr,"[WARN] read plan '%s' is not available, using '%s'.\n",IBD_PLAN_NAMES[forced],IBD_PLAN_NAMES[plan->chosen]);
+			}
+		}
+	DEBUG("read plan: %s (%zu markers, %zu/%zu pairs, span %zu, %zu runs)",
+		IBD_PLAN_NAMES[plan->chosen],plan->n_markers,plan->n_selected,config->pair_count,plan->span,plan->n_runs);
+	return plan->chosen;
+	}
+
+/** print the estimates of planIbdRead (--explain) */
+static void explainIbdRead(ContextPtr config,IbdDataSetPtr ds,const IbdReadPlanPtr plan)
+	{
+	int p;
+	fprintf(config->out,"#layout\t%s\n",(ds->mapped!=NULL?"mapped":(ds->chunk_cache!=NULL?"chunked":"contiguous")));
+	if(ds->chunk_cache!=NULL)
+		{
+		fprintf(config->out,"#chunk\t%dx%dx%d\n",(int)ds->chunk_dims[0],(int)ds->chunk_dims[1],(int)ds->chunk_dims[2]);
+		}
+	fprintf(config->out,"#markers\t%zu\n",plan->n_markers);
+	fprintf(config->out,"#pairs\t%zu/%zu\n",plan->n_selected,config->pair_count);
+	fprintf(config->out,"#span\t%zu\n",plan->span);
+	fprintf(config->out,"#runs\t%zu\n",plan->n_runs);
+	fputs("STRATEGY\tAVAILABLE\tBYTES\tCALLS\tPIECES\tCOST\tCHOSEN\n",config->out);
+	for(p=IBD_PLAN_MMAP;p< IBD_PLAN_COUNT;++p)
+		{
+		fprintf(config->out,"%s\t%s\t%.0f\t%.0f\t%.0f\t",
+			IBD_PLAN_NAMES[p],
+			(plan->available[p]?"yes":"no"),
+			plan->bytes[p],
+			plan->calls[p],
+			plan->pieces[p]
+			);
+		if(plan->available[p])
+			{
+			fprintf(config->out,"%.0f",plan->cost[p]);
+			}
+		else
+			{
+			fputc('.',config->out);
+			}
+		fprintf(config->out,"\t%s\n",(p==plan->chosen?"*":"."));
+		}
+	}
+
+/**
+ * scan the markers [first,last[ of the concatenated ranges for the selected pairs:
+ * print the rows to config->out or collect the data for the image
+ */
+static void scanMarkerRanges(ContextPtr config,IbdDataSetPtr ds,IbdScanPtr scan,const MarkerRangePtr ranges,size_t n_ranges,size_t first,size_t last)
+	{
+	size_t i,j,k,r,offset=0UL;
+	size_t n_selected,pair_start=0UL,pair_end=0UL,row_size,row_offset=0UL,block_markers;
+	size_t* columns=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	/* index of the selected pairs */
+	size_t* selected=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	int read_plan=scan->read_plan;
+	float* block=NULL;
+	/* the selected pairs are consecutive in a row: their IBD0 are row[columns[0]+3*k] */
+	boolean_t consecutive;
+	/* --group-by: the columns of the selected pairs sorted on group, group g is [group_offsets[g],group_offsets[g+1][ */
+	size_t* group_columns=NULL;
+	size_t* group_offsets=NULL;
+	
+	n_selected=selectedPairColumns(config,columns,&pair_start,&pair_end);
+	for(k=0;k< n_selected;++k) selected[k]=pair_start+columns[k]/3;
+	if(read_plan==IBD_PLAN_AUTO || (read_plan==IBD_PLAN_MMAP && ds->mapped==NULL))
+		{
+		IbdReadPlan plan;
+		read_plan=planIbdRead(config,ds,ranges,n_ranges,read_plan,&plan);
+		}
+	/* layout of a row: the IBD0 of the k-th selected pair is row[columns[k]] */
+	switch(read_plan)
+		{
+		case IBD_PLAN_MMAP:
+		case IBD_PLAN_ROWS:
+			row_size=config->pair_count*3;
+			row_offset=pair_start*3;
+			break;
+		case IBD_PLAN_GATHER:
+			row_size=n_selected*3;
+			for(k=0;k< n_selected;++k) columns[k]=k*3;
+			break;
+		default:
+			row_size=(pair_end-pair_start)*3;
+			break;
+		}
+	consecutive=(n_selected>0);
+	for(k=1;k< n_selected && consecutive;++k) consecutive=(columns[k]==columns[0]+3*k);
+	if(scan->pair_group!=NULL)
+		{
+		size_t g;
+		group_columns=(size_t*)safeCalloc(MAX(1,n_selected),sizeof(size_t));
+		group_offsets=(size_t*)safeCalloc(scan->n_groups+1,sizeof(size_t));
+		for(k=0;k< n_selected;++k) group_offsets[scan->pair_group[selected[k]]+1]++;
+		for(g=0;g< scan->n_groups;++g) group_offsets[g+1]+=group_offsets[g];
+		/* counting sort, group_offsets[g] is the next free slot of group g */
+		for(k=0;k< n_selected;++k) group_columns[group_offsets[scan->pair_group[selected[k]]]++]=columns[k];
+		for(g=scan->n_groups;g>0;--g) group_offsets[g]=group_offsets[g-1];
+		group_offsets[0]=0UL;
+		}
+	block_markers=MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,row_size)*sizeof(float)));
+	if(n_selected>0 && read_plan!=IBD_PLAN_MMAP)
+		{
+		block=(float*)safeMalloc(MIN(block_markers,config->marker_count)*row_size*sizeof(float));
+		}
+	
+	for(r=0;r< n_ranges;++r)
+		{
+		size_t range_size=ranges[r].end-ranges[r].begin;
+		size_t range_first,range_last,range_offset,n;
+		/* intersection of this range with the slice [first,last[ */
+		if(offset+range_size <= first || offset >= last)
+			{
+			offset+=range_size;
+			continue;
+			}
+		range_first=ranges[r].begin+(first>offset?first-offset:0);
+		range_last=ranges[r].begin+MIN(range_size,last-offset);
+		range_offset=offset;
+		offset+=range_size;
+		for(i=range_first;i< range_last;i+=n)
+			{
+			const float* rows=block;
+			n=MIN(block_markers,range_last-i);
+			if(n_selected>0)
+				{
+				switch(read_plan)
+					{
+					/* mapped '/ibd': the rows are used in place */
+					case IBD_PLAN_MMAP: rows=IbdDataSetMappedRows(ds,i); break;
+					case IBD_PLAN_ROWS: IbdDataSetReadMarkers(config,ds,i,n,block); break;
+					case IBD_PLAN_GATHER: IbdDataSetReadPairs(config,ds,i,n,selected,n_selected,block); break;
+					default: IbdDataSetReadBlock(config,ds,i,n,pair_start,pair_end-pair_start,block); break;
+					}
+				}
+			for(j=0;j< n;++j)
+				{
+				MarkerPtr marker = &config->markers[i+j];
+				const float* row= (rows==NULL?NULL:&rows[j*row_size+row_offset]);
+				size_t count_pairs;
+				
+				/* IBD0 of the selected pairs, counted in place */
+				count_pairs=(consecutive?
+					IbdCountBelowStrided(&row[columns[0]],3,n_selected,scan->treshold,IBD_UNDEFINED):
+					IbdCountBelowGather(row,columns,n_selected,scan->treshold,IBD_UNDEFINED));
+				if(scan->heatmap!=NULL)
+					{
+					HeatmapAdd(scan->heatmap,range_offset+(i+j-ranges[r].begin),row,columns,selected,n_selected);
+					}
+				
+				if(scan->counts!=NULL)
+					{
+					scan->counts[range_offset+(i+j-ranges[r].begin)]=(int)count_pairs;
+					}
+				else if(!scan->image && scan->heatmap==NULL)
+					{
+					if(ranges[r].label!=NULL)
+						{
+						fputs( ranges[r].label , config->out);
+						fputc('\t', config->out);
+						}
+					fputs( config->chromosomes[ marker->tid ].name , config->out);
+					fputc('\t', config->out);
+					fprintf(config->out,"%d", marker->position);
+					fputc('\t', config->out);
+					fputs( marker->name , config->out);
+					for(k=0;k< n_selected && scan->print_pairs;++k)
+						{
+						fputc('\t', config->out);
+						if(row[columns[k]]> IBD_UNDEFINED)
+							{
+							fprintf(config->out,"%f",row[columns[k]]);
+							}
+						else
+							{
+							fputs("NA",config->out);
+							}
+						}
+					fprintf(config->out,"\t%d",(int)count_pairs);
+					if(scan->pair_group!=NULL)
+						{
+						size_t g;
+						for(g=0;g< scan->n_groups;++g)
+							{
+							fprintf(config->out,"\t%d",(int)IbdCountBelowGather(row,&group_columns[group_offsets[g]],group_offsets[g+1]-group_offsets[g],scan->treshold,IBD_UNDEFINED));
+							}
+						}
+					if( fputc('\n', config->out) < 0) break;
+					}
+				else if(!scan->image)
+					{
+					/* only the heatmap */
+					}
+				else if(scan->image_per==IMAGE_PER_FAMILY)
+					{
+					/* one panel per group of pairs */
+					size_t g;
+					for(g=0;g< scan->n_groups;++g)
+						{
+						size_t n_ibd=IbdCountBelowGather(row,&group_columns[group_offsets[g]],group_offsets[g+1]-group_offsets[g],scan->treshold,IBD_UNDEFINED);
+						if(n_ibd==0) continue;
+						ImageBinsAdd(scan->panels[g],ImageBinsColumn(config,scan->panels[g],marker),(double)n_ibd);
+						}
+					}
+				else if(count_pairs>0)
+					{
+					ImageBinsPtr bins=scanImagePanel(scan,marker);
+					ImageBinsAdd(bins,ImageBinsColumn(config,bins,marker),(double)count_pairs);
+					}
+				}
+			}
+		}
+	free(group_offsets);
+	free(group_columns);
+	free(block);
+	free(selected);
+	free(columns);
+	}
+
+/**
+ * same as scanMarkerRanges, but the markers are split into 'n_workers' consecutive slices
+ * scanned by forked processes reading '/ibd' concurrently. Each process writes in a temporary file,
+ * the files are merged in order, so the output is the same as the serial scan.
+ */
+static void scanMarkerRangesParallel(ContextPtr config,IbdDataSetPtr ds,IbdScanPtr scan,const MarkerRangePtr ranges,size_t n_ranges,int n_workers)
+	{
+	int w;
+	size_t total=countMarkersInRanges(ranges,n_ranges);
+	FILE** outputs=(FILE**)safeCalloc(n_workers,sizeof(FILE*));
+	pid_t* pids=(pid_t*)safeCalloc(n_workers,sizeof(pid_t));
+	/* the children must not inherit unflushed buffers */
+	fflush(config->out);
+	fflush(stderr);
+	for(w=0;w< n_workers;++w)
+		{
+		size_t first=(total*(size_t)w)/(size_t)n_workers;
+		size_t last=(total*(size_t)(w+1))/(size_t)n_workers;
+		outputs[w]=tmpfile();
+		if(outputs[w]==NULL) DIE_FAILURE("Cannot create temporary file : %s.",strerror(errno));
+		pids[w]=fork();
+		if(pids[w]<0) DIE_FAILURE("fork failed : %s.",strerror(errno));
+		if(pids[w]==0)
+			{
+			/* the hits and the misses of the modelled chunk cache in this worker, sent after the results */
+			unsigned long long cache_counters[2]={0ULL,0ULL};
+			if(ds->chunk_cache!=NULL)
+				{
+				cache_counters[0]=ds->chunk_cache->hits;
+				cache_counters[1]=ds->chunk_cache->misses;
+				}
+			config->out=outputs[w];
+			if(scan->image)
+				{
+				size_t p;
+				for(p=0;p< scan->n_panels;++p)
+					{
+					if(scan->panels[p]==NULL) continue;
+					scan->panels[p]=ImageBinsNew(scan->panels[p]->width,scan->panels[p]->region,(long)scan->panels[p]->genome_size);
+					}
+				}
+			scanMarkerRanges(config,ds,scan,ranges,n_ranges,first,last);
+			if(scan->counts!=NULL && last>first &&
+				fwrite((void*)&scan->counts[first],sizeof(int),last-first,outputs[w])!=last-first)
+				{
+				_exit(EXIT_FAILURE);
+				}
+			if(scan->image)
+				{
+				size_t p;
+				for(p=0;p< scan->n_panels;++p)
+					{
+					if(scan->panels[p]!=NULL && ImageBinsWrite(scan->panels[p],outputs[w])!=0) _exit(EXIT_FAILURE);
+					}
+				}
+			if(scan->heatmap!=NULL && HeatmapWrite(scan->heatmap,outputs[w])!=0)
+				{
+				_exit(EXIT_FAILURE);
+				}
+			if(ds->chunk_cache!=NULL)
+				{
+				cache_counters[0]=ds->chunk_cache->hits-cache_counters[0];
+				cache_counters[1]=ds->chunk_cache->misses-cache_counters[1];
+				}
+			if(fwrite((void*)cache_counters,sizeof(unsigned long long),2,outputs[w])!=2) _exit(EXIT_FAILURE);
+			_exit(fflush(outputs[w])==0?EXIT_SUCCESS:EXIT_FAILURE);
+			}
+		}
+	/* ordered merge */
+	for(w=0;w< n_workers;++w)
+		{
+		int wstatus=0;
+		long results_size;
+		unsigned long long cache_counters[2];
+		if(waitpid(pids[w],&wstatus,0)!=pids[w] || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus)!=EXIT_SUCCESS)
+			{
+			DIE_FAILURE("worker %d failed.",w);
+			}
+		if(fseek(outputs[w],-(long)sizeof(cache_counters),SEEK_END)!=0 ||
+			(results_size=ftell(outputs[w]))<0 ||
+			fread((void*)cache_counters,sizeof(unsigned long long),2,outputs[w])!=2)
+			{
+			DIE_FAILURE("Cannot read the chunk cache counters of worker %d.",w);
+			}
+		if(ds->chunk_cache!=NULL)
+			{
+			ds->chunk_cache->hits+=cache_counters[0];
+			ds->chunk_cache->misses+=cache_counters[1];
+			}
+		rewind(outputs[w]);
+		if(scan->counts!=NULL)
+			{
+			size_t first=(total*(size_t)w)/(size_t)n_workers;
+			size_t last=(total*(size_t)(w+1))/(size_t)n_workers;
+			if(last>first && fread((void*)&scan->counts[first],sizeof(int),last-first,outputs[w])!=last-first)
+				{
+				DIE_FAILURE("Cannot read the counts of worker %d.",w);
+				}
+			}
+		else if(scan->image || scan->heatmap!=NULL)
+			{
+			size_t p;
+			for(p=0;p< scan->n_panels && scan->image;++p)
+				{
+				if(scan->panels[p]!=NULL && ImageBinsReadMerge(scan->panels[p],outputs[w])!=0)
+					{
+					DIE_FAILURE("Cannot read the image of worker %d.",w);
+					}
+				}
+			if(scan->heatmap!=NULL && HeatmapReadMerge(scan->heatmap,outputs[w])!=0)
+				{
+				DIE_FAILURE("Cannot read the heatmap of worker %d.",w);
+				}
+			}
+		else
+			{
+			char buffer[BUFSIZ];
+			size_t n;
+			while(results_size>0 && (n=fread(buffer,1,MIN((size_t)BUFSIZ,(size_t)results_size),outputs[w]))>0)
+				{
+				if(fwrite(buffer,1,n,config->out)!=n) break;
+				results_size-=(long)n;
+				}
+			}
+		fclose(outputs[w]);
+		}
+	free(outputs);
+	free(pids);
+	}
+
+/** print a window of 'windowIbdCounts' , or collect it for the image or for 'peaks' */
+static void emitIbdWindow(ContextPtr config,IbdScanPtr scan,const char* label,size_t first_marker,size_t n_markers,int start,int end,double mean,int max)
+	{
+	if(scan->peaks!=NULL)
+		{
+		IbdWindow w;
+		w.first_marker=first_marker;
+		w.n_markers=n_markers;
+		w.start=start;
+		w.end=end;
+		w.mean=mean;
+		w.max=max;
+		WindowHeapOffer(scan->peaks,&w);
+		return;
+		}
+	if(scan->image)
+		{
+		if(max<=0) return;
+		/* plotted at the middle marker of the window */
+		MarkerPtr middle=&config->markers[first_marker+n_markers/2];
+		ImageBinsPtr bins=scanImagePanel(scan,middle);
+		ImageBinsAdd(bins,ImageBinsColumn(config,bins,middle),mean);
+		return;
+		}
+	if(label!=NULL)
+		{
+		fputs(label,config->out);
+		fputc('\t', config->out);
+		}
+	fprintf(config->out,"%s\t%d\t%d\t%d\t%f\t%d\n",
+		config->chromosomes[config->markers[first_marker].tid].name,
+		start,end,
+		(int)n_markers,
+		mean,
+		max
+		);
+	}
+
+/**
+ * sliding windows over scan->counts: windows of 'window_markers' markers or of 'window_bp' bases,
+ * moving by 'step' markers or bases. A window never spans two chromosomes. The mean uses the prefix sums
+ * of the counts, the max a monotonic queue, so each range is read once.
+ */
+static void windowIbdCounts(ContextPtr config,IbdScanPtr scan,const MarkerRangePtr ranges,size_t n_ranges,size_t window_markers,int window_bp,size_t step)
+	{
+	size_t r,offset=0UL;
+	for(r=0;r< n_ranges;++r)
+		{
+		size_t range_size=ranges[r].end-ranges[r].begin;
+		const int* cnt=&scan->counts[offset];
+		const MarkerPtr markers=&config->markers[ranges[r].begin];
+		long long* prefix=(long long*)safeCalloc(range_size+1,sizeof(long long));
+		size_t* queue=(size_t*)safeCalloc(MAX(1,range_size),sizeof(size_t));
+		size_t x,sb,se;
+		offset+=range_size;
+		for(x=0;x< range_size;++x) prefix[x+1]=prefix[x]+cnt[x];
+		/* [sb,se[ : markers of the same chromosome */
+		for(sb=0;sb< range_size;sb=se)
+			{
+			size_t lo=sb,hi=sb,head=0,tail=0;
+			long long wstart=0LL;
+			for(se=sb+1;se< range_size && markers[se].tid==markers[sb].tid;++se) {}
+			if(window_bp>0) wstart=(markers[sb].position/(long long)step)*(long long)step;
+			for(;;)
+				{
+				size_t hi_target;
+				if(window_markers>0)
+					{
+					hi_target=MIN(lo+window_markers,se);
+					}
+				else
+					{
+					while(lo< se && markers[lo].position < wstart) ++lo;
+					hi_target=lo;
+					while(hi_target< se && markers[hi_target].position < wstart+window_bp) ++hi_target;
+					}
+				if(hi< lo)
+					{
+					hi=lo;
+					head=tail=0;
+					}
+				/* monotonic queue of the max */
+				for(;hi< hi_target;++hi)
+					{
+					while(tail>head && cnt[queue[tail-1]]<=cnt[hi]) --tail;
+					queue[tail++]=hi;
+					}
+				while(head<tail && queue[head]< lo) ++head;
+				if(hi_target>lo)
+					{
+					size_t n=hi_target-lo;
+					emitIbdWindow(config,scan,ranges[r].label,ranges[r].begin+lo,n,
+						(window_markers>0?markers[lo].position:(int)wstart),
+						(window_markers>0?markers[hi_target-1].position+1:(int)(wstart+window_bp)),
+						(double)(prefix[hi_target]-prefix[lo])/n,
+						cnt[queue[head]]);
+					}
+				if(window_markers>0)
+					{
+					if(hi_target>=se) break;
+					lo+=step;
+					if(lo>=se) break;
+					}
+				else
+					{
+					if(wstart+window_bp > markers[se-1].position) break;
+					wstart+=step;
+					}
+				}
+			}
+		free(queue);
+		free(prefix);
+		}
+	}
+
+/** values of --group-by */
+#define GROUP_BY_NONE 0
+#define GROUP_BY_FAMILY 1
+#define GROUP_BY_STATUS 2
+#define GROUP_BY_SEXPAIR 3
+
+/**
+ * assign a group to each selected pair: the family, the status or the sex of the two individuals.
+ * e.g. 'F1' or 'F1|F2' for two families, '1|2' for status or sex; the two values are sorted.
+ * returns pair_group[pair_count] (-1 for the pairs not selected); the names are in '*group_names'.
+ */
+/** FNV-1a hash of a group name */
+static size_t groupNameHash(const char* s)
+	{
+	uint64_t h=UINT64_C(14695981039346656037);
+	while(*s!=0)
+		{
+		h^=(unsigned char)*s++;
+		h*=UINT64_C(1099511628211);
+		}
+	return (size_t)h;
+	}
+
+static int* groupSelectedPairs(ContextPtr config,int group_by,char*** group_names,size_t* n_groups)
+	{
+	size_t i,g,names_capacity=0UL;
+	int* pair_group=(int*)safeMalloc(MAX(1,config->pair_count)*sizeof(int));
+	/* open addressing hash table of the index of the groups, -1 for an empty slot. Less than half full */
+	size_t n_slots=64UL;
+	int* slots=(int*)safeMalloc(n_slots*sizeof(int));
+	for(i=0;i< n_slots;++i) slots[i]=-1;
+	*group_names=NULL;
+	*n_groups=0UL;
+	for(i=0;i< config->pair_count;++i)
+		{
+		PairIndiPtr pair = &config->pairs[i];
+		IndividualPtr indi1=&config->individuals[pair->indi1idx];
+		IndividualPtr indi2=&config->individuals[pair->indi2idx];
+		char* name;
+		pair_group[i]=-1;
+		if(!pair->selected) continue;
+		switch(group_by)
+			{
+			case GROUP_BY_FAMILY:
+				{
+				const char* f1=indi1->family;
+				const char* f2=indi2->family;
+				name=(char*)safeMalloc(strlen(f1)+strlen(f2)+2);
+				if(strcmp(f1,f2)==0) strcpy(name,f1);
+				else if(strcmp(f1,f2)<0) sprintf(name,"%s|%s",f1,f2);
+				else sprintf(name,"%s|%s",f2,f1);
+				break;
+				}
+			case GROUP_BY_STATUS:
+				name=(char*)safeMalloc(30);
+				sprintf(name,"%d|%d",MIN(indi1->status,indi2->status),MAX(indi1->status,indi2->status));
+				break;
+			case GROUP_BY_SEXPAIR:
+				name=(char*)safeMalloc(30);
+				sprintf(name,"%d|%d",MIN(indi1->sex,indi2->sex),MAX(indi1->sex,indi2->sex));
+				break;
+			default: DIE_FAILURE("bad group-by %d",group_by); break;
+			}
+		for(g=groupNameHash(name)&(n_slots-1);slots[g]!=-1;g=(g+1)&(n_slots-1))
+			{
+			if(strcmp((*group_names)[slots[g]],name)==0) break;
+			}
+		if(slots[g]!=-1)
+			{
+			free(name);
+			pair_group[i]=slots[g];
+			continue;
+			}
+		/* new group */
+		if(*n_groups==names_capacity)
+			{
+			names_capacity=MAX(16,names_capacity*2);
+			*group_names=(char**)safeRealloc(*group_names,names_capacity*sizeof(char*));
+			}
+		pair_group[i]=(int)*n_groups;
+		(*group_names)[(*n_groups)++]=name;
+		slots[g]=pair_group[i];
+		if(*n_groups*2 > n_slots)
+			{
+			/* rehash in a table twice as large */
+			n_slots*=2;
+			slots=(int*)safeRealloc(slots,n_slots*sizeof(int));
+			for(g=0;g< n_slots;++g) slots[g]=-1;
+			for(g=0;g< *n_groups;++g)
+				{
+				size_t k=groupNameHash((*group_names)[g])&(n_slots-1);
+				while(slots[k]!=-1) k=(k+1)&(n_slots-1);
+				slots[k]=(int)g;
+				}
+			}
+		}
+	free(slots);
+	return pair_group;
+	}
+
+#define COLOR_BLACK 0,0,0
+#define COLOR_WHITE 1,1,1
+#define COLOR_GRAY(g) g,g,g
+#define COLOR_INT_RGB(r,g,b) r/255.0,g/255.0,b/255.0
+
+/**
+ * paint the COUNT_IBD of 'bins' in 'cr'. If bins->region is NULL, the whole genome is plotted
+ * and the title, if any, is written in the top-left corner. Else the title is the region.
+ */
+static void paintIbdImage(ContextPtr config,HersheyPtr hershey,cairo_t *cr,const Dimension imageDimension,const Rectangle drawingArea,const ImageBinsPtr bins)
+	{
+	size_t i;
+	RegionPtr region=bins->region;
+	double max_y=bins->max_y;
+	if(max_y==0) max_y=1;
+	//draw background
+	cairo_set_source_rgb (cr, COLOR_WHITE);
+	cairo_rectangle(cr,0,0,imageDimension.width,imageDimension.height);
+	cairo_fill(cr);		
+
+	//draw y axis
+	int n_log10=(int)floor(log10(max_y));
+	double max_y2 = 0;
+	while(max_y2 < max_y)
+		{
+		max_y2+=pow(10, n_log10);
+		}
+	max_y=(int)max_y2;
+
+
+	for(i=0;i<= 10;++i)
+		{
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
+		double cy = drawingArea.y + drawingArea.height -(i/10.0)*drawingArea.height ;
+		
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
+		cairo_move_to (cr, drawingArea.x-5, cy);
+		cairo_line_to (cr, drawingArea.x, cy);
+		cairo_stroke (cr);
+		
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.5));
+		cairo_move_to (cr, drawingArea.x, cy);
+		cairo_line_to (cr, drawingArea.x+drawingArea.width, cy);
+		cairo_stroke (cr);
+
+		char* label=safeMalloc(100);
+		sprintf(label,"%.2f", (i/10.0)*max_y);
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.2));
+		HersheyPaint(hershey,
+			cr,label,
+			drawingArea.x - strlen(label)*7,
+			cy-5,
+			strlen(label)*7 -10,
+			10);
+		cairo_stroke (cr);
+		free(label);
+		}
+
+
+
+
+#define BASE2PIXEL(chrom,POS)  (drawingArea.x+((region!=NULL?POS-region->start:config->chromosomes[chrom].cumulative_start+POS)/bins->genome_size)*drawingArea.width)
+
+	if(region==NULL)
+		{
+		
+		for(i=0;i< config->chromosome_count;++i)
+			{
+
+			double chrom_x1=BASE2PIXEL(i,0);
+			double chrom_x2=BASE2PIXEL(i,config->chromosomes[i].length);
+			
+			if(i%2==0)
+				{
+				cairo_set_source_rgb (cr, COLOR_GRAY(0.95));
+				}
+			else
+				{
+				cairo_set_source_rgb (cr,  COLOR_GRAY(0.90));
+				}
+			cairo_rectangle(cr,
+				chrom_x1,
+				drawingArea.y,
+				chrom_x2-chrom_x1,
+				drawingArea.height
+				);
+
+			cairo_fill(cr);
+
+		
+			
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			double chrom_name_len = MIN( strlen(config->chromosomes[i].name)*7, chrom_x2-chrom_x1 );
+			 
+			HersheyPaint(
+				hershey,
+				cr,config->chromosomes[i].name,
+				(chrom_x1+chrom_x2)/2.0 - chrom_name_len/2.0,
+				drawingArea.y/2.0-5,
+				chrom_name_len,
+				10);
+			
+			cairo_stroke(cr); 
+
+			//draw x-axis
+			int x;
+			for(x=1;x<10 && x< config->chromosomes[i].length &&
+				(chrom_x2-chrom_x1)>100
+				;++x)
+				{
+				int pos=(int)(config->chromosomes[i].length/10.0)*x;
+				double ticks_x=BASE2PIXEL(i,pos);
+				double ticks_y=drawingArea.y+drawingArea.height;
+				cairo_move_to (cr, ticks_x, ticks_y);
+				cairo_line_to (cr, ticks_x, ticks_y+5);
+				cairo_stroke (cr);
+				
+				cairo_save (cr);
+				cairo_set_line_width (cr, 0.5);
+				cairo_translate(cr, ticks_x+5, ticks_y+6);
+				cairo_rotate(cr,  1.57079632679);
+				char* label=safeMalloc(20);
+				sprintf(label,"%d",pos);
+				HersheyPaint(
+					hershey,cr,label,
+					0,0,
+					MIN(strlen(label)*7,(imageDimension.height-(drawingArea.y+drawingArea.height+10))),10
+					);
+				
+				cairo_stroke (cr);
+				cairo_restore (cr);
+				free(label);
+				} 
+			}
+		if(bins->title!=NULL)
+			{
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			HersheyPaint(hershey,
+				cr,bins->title,
+				5,
+				5,
+				strlen(bins->title)*7,
+				10);
+			cairo_stroke(cr);
+			}
+		}
+	else
+		{
+		assert(bins->title!=NULL);
+		
+		double chrom_name_len = MIN( strlen(bins->title)*7, drawingArea.width );
+		
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.1));
+		HersheyPaint(hershey,
+			cr,bins->title,
+			drawingArea.x + drawingArea.width/2.0 - chrom_name_len/2.0,
+			drawingArea.height/2.0-5,
+			chrom_name_len,
+			10);
+		
+		cairo_stroke(cr);
+		}
+#undef BASE2PIXEL
+	
+	
+	//draw data points: a column of pixels is a vertical span from its min to its max with a cross at both ends, all in one path
+	cairo_set_line_width (cr, 0.2);
+	cairo_set_source_rgb (cr, COLOR_GRAY(0.3));
+	cairo_new_path (cr);
+	for(i=0;i< bins->width;++i)
+		{
+		double cx,cy_min,cy_max;
+		if(bins->count[i]==0) continue;
+		cx = drawingArea.x + i + 0.5;
+		cy_min = drawingArea.y + drawingArea.height - (bins->min[i]/max_y)*drawingArea.height ;
+		cy_max = drawingArea.y + drawingArea.height - (bins->max[i]/max_y)*drawingArea.height ;
+		cairo_move_to (cr, cx-5, cy_min);
+		cairo_line_to (cr, cx+5, cy_min);
+		if(cy_max!=cy_min)
+			{
+			cairo_move_to (cr, cx-5, cy_max);
+			cairo_line_to (cr, cx+5, cy_max);
+			}
+		cairo_move_to (cr, cx, cy_max-5);
+		cairo_line_to (cr, cx, cy_min+5);
+		}
+	cairo_stroke (cr);
+
+	//frame
+	cairo_set_source_rgb (cr,COLOR_BLACK);
+	cairo_rectangle (cr, drawingArea.x, drawingArea.y,drawingArea.width,drawingArea.height);
+	cairo_stroke (cr);
+	}
+
+/** format of '--image', from the suffix of the filename */
+#define IMAGE_FORMAT_PNG 0
+#define IMAGE_FORMAT_SVG 1
+#define IMAGE_FORMAT_PDF 2
+#define IMAGE_FORMAT_COUNT 3
+static const char* IMAGE_FORMAT_SUFFIXES[IMAGE_FORMAT_COUNT]={".png",".svg",".pdf"};
+
+/** the IMAGE_FORMAT_* of 'filename', or -1 */
+static int imageFormat(const char* filename)
+	{
+	int format;
+	size_t len=strlen(filename);
+	for(format=0;format< IMAGE_FORMAT_COUNT;++format)
+		{
+		if(len>=4 && strcasecmp(&filename[len-4],IMAGE_FORMAT_SUFFIXES[format])==0) return format;
+		}
+	return -1;
+	}
+
+/**
+ * create the surface of an image. The SVG and PDF surfaces are streamed into 'filename' while
+ * they are painted: no pixel is allocated.
+ */
+static cairo_surface_t* createImageSurface(int format,const char* filename,int width,int height)
+	{
+	cairo_surface_t *surface=NULL;
+	switch(format)
+		{
+		case IMAGE_FORMAT_SVG: surface=cairo_svg_surface_create(filename,width,height); break;
+		case IMAGE_FORMAT_PDF: surface=cairo_pdf_surface_create(filename,width,height); break;
+		default: surface=cairo_image_surface_create(CAIRO_FORMAT_ARGB32,width,height); break;
+		}
+	if(surface==NULL || cairo_surface_status(surface)!=CAIRO_STATUS_SUCCESS)
+		{
+		DIE_FAILURE("Cannot create image %s (%dx%d).",filename,width,height);
+		}
+	return surface;
+	}
+
+/** save 'surface' created by createImageSurface in 'filename' and dispose it */
+static void closeImageSurface(int format,cairo_surface_t* surface,const char* filename)
+	{
+	if(format==IMAGE_FORMAT_PNG)
+		{
+		if(cairo_surface_write_to_png(surface,filename)!=CAIRO_STATUS_SUCCESS)
+			{
+			DIE_FAILURE("Cannot save %s.",filename);
+			}
+		}
+	else
+		{
+		/* flush the end of the vector document */
+		cairo_surface_finish(surface);
+		if(cairo_surface_status(surface)!=CAIRO_STATUS_SUCCESS)
+			{
+			DIE_FAILURE("Cannot save %s.",filename);
+			}
+		}
+	cairo_surface_destroy(surface);
+	}
+
+/** the panels rendered by one thread of renderIbdImages */
+typedef struct ibd_render_t
+	{
+	ContextPtr config;
+	HersheyPtr hershey;
+	/** one of IMAGE_FORMAT_* */
+	int format;
+	Dimension imageDimension;
+	Rectangle drawingArea;
+	ImageBinsPtr* panels;
+	size_t n_panels;
+	/** if not NULL, the panel 'p' is saved in filenames[p] , else it is kept in surfaces[p] */
+	char** filenames;
+	cairo_surface_t** surfaces;
+	/** this thread renders the panels thread_index, thread_index+n_threads, ... */
+	size_t thread_index;
+	size_t n_threads;
+	} IbdRender,*IbdRenderPtr;
+
+static void* renderIbdImagesThread(void* arg)
+	{
+	IbdRenderPtr render=(IbdRenderPtr)arg;
+	size_t p;
+	for(p=render->thread_index;p< render->n_panels;p+=render->n_threads)
+		{
+		cairo_surface_t *surface;
+		cairo_t *cr;
+		if(render->panels[p]==NULL) continue;
+		surface = createImageSurface(
+				(render->filenames!=NULL?render->format:IMAGE_FORMAT_PNG),
+				(render->filenames!=NULL?render->filenames[p]:"tile"),
+				render->imageDimension.width, render->imageDimension.height);
+		cr = cairo_create(surface);
+		if(cr==NULL) DIE_FAILURE("Cannot create image context");
+		paintIbdImage(render->config,render->hershey,cr,render->imageDimension,render->drawingArea,render->panels[p]);
+		cairo_destroy(cr);
+		if(render->filenames!=NULL)
+			{
+			closeImageSurface(render->format,surface,render->filenames[p]);
+			}
+		else
+			{
+			render->surfaces[p]=surface;
+			}
+		}
+	return NULL;
+	}
+
+/**
+ * render the panels of '--image' on separate surfaces by MIN(panels,CPUs) threads.
+ * If n_columns is 0, the panel 'p' is saved in filenames[p], else the panels are tiled in 'n_columns' columns
+ * and saved in 'image_filename'.
+ */
+static void renderIbdImages(ContextPtr config,int format,const Dimension imageDimension,const Rectangle drawingArea,ImageBinsPtr* panels,size_t n_panels,char** filenames,int n_columns,const char* image_filename)
+	{
+	size_t t,p,n_threads,n_visible=0UL;
+	long n_cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t* threads;
+	IbdRenderPtr renders;
+	cairo_surface_t** surfaces=NULL;
+	HersheyPtr hershey=HersheyNew();
+	if(hershey==NULL) DIE_FAILURE("Cannot create hershey");
+	
+	for(p=0;p< n_panels;++p) if(panels[p]!=NULL) n_visible++;
+	
+	if(n_columns>0 && format!=IMAGE_FORMAT_PNG)
+		{
+		/* a tiled vector image: the panels are painted in the streamed document, one after the other */
+		size_t n_rows=(n_visible+n_columns-1)/n_columns;
+		size_t k=0UL;
+		cairo_surface_t *surface = createImageSurface(format,image_filename,
+			imageDimension.width*n_columns,
+			imageDimension.height*MAX(1,n_rows));
+		cairo_t *cr = cairo_create(surface);
+		if(cr==NULL) DIE_FAILURE("Cannot create image context");
+		for(p=0;p< n_panels;++p)
+			{
+			if(panels[p]==NULL) continue;
+			cairo_save(cr);
+			cairo_translate(cr,
+				(double)((k%n_columns)*imageDimension.width),
+				(double)((k/n_columns)*imageDimension.height));
+			cairo_rectangle(cr,0,0,imageDimension.width,imageDimension.height);
+			cairo_clip(cr);
+			paintIbdImage(config,hershey,cr,imageDimension,drawingArea,panels[p]);
+			cairo_restore(cr);
+			k++;
+			}
+		DEBUG("saving image as %s.",image_filename);
+		cairo_destroy(cr);
+		closeImageSurface(format,surface,image_filename);
+		HersheyFree(hershey);
+		return;
+		}
+	
+	n_threads=MAX(1UL,MIN(n_visible,(size_t)MAX(1L,n_cpus)));
+	if(n_columns>0) surfaces=(cairo_surface_t**)safeCalloc(MAX(1,n_panels),sizeof(cairo_surface_t*));
+	threads=(pthread_t*)safeCalloc(n_threads,sizeof(pthread_t));
+	renders=(IbdRenderPtr)safeCalloc(n_threads,sizeof(IbdRender));
+	for(t=0;t< n_threads;++t)
+		{
+		renders[t].config=config;
+		renders[t].hershey=hershey;
+		renders[t].format=format;
+		renders[t].imageDimension=imageDimension;
+		renders[t].drawingArea=drawingArea;
+		renders[t].panels=panels;
+		renders[t].n_panels=n_panels;
+		renders[t].filenames=(n_columns>0?NULL:filenames);
+		renders[t].surfaces=surfaces;
+		renders[t].thread_index=t;
+		renders[t].n_threads=n_threads;
+		}
+	DEBUG("rendering %d panel(s) with %d thread(s).",(int)n_visible,(int)n_threads);
+	if(n_threads==1)
+		{
+		renderIbdImagesThread(&renders[0]);
+		}
+	else
+		{
+		for(t=0;t< n_threads;++t)
+			{
+			if(pthread_create(&threads[t],NULL,renderIbdImagesThread,&renders[t])!=0)
+				{
+				DIE_FAILURE("Cannot create thread.");
+				}
+			}
+		for(t=0;t< n_threads;++t) pthread_join(threads[t],NULL);
+		}
+	
+	if(n_columns>0)
+		{
+		/* tile the visible panels, row by row */
+		size_t n_rows=(n_visible+n_columns-1)/n_columns;
+		size_t k=0UL;
+		cairo_surface_t *surface = createImageSurface(format,image_filename,
+			imageDimension.width*n_columns,
+			imageDimension.height*MAX(1,n_rows));
+		cairo_t *cr = cairo_create(surface);
+		if(cr==NULL) DIE_FAILURE("Cannot create image context");
+		cairo_set_source_rgb (cr, COLOR_WHITE);
+		cairo_paint(cr);
+		for(p=0;p< n_panels;++p)
+			{
+			if(surfaces[p]==NULL) continue;
+			cairo_set_source_surface(cr,surfaces[p],
+				(double)((k%n_columns)*imageDimension.width),
+				(double)((k/n_columns)*imageDimension.height));
+			cairo_paint(cr);
+			cairo_surface_destroy(surfaces[p]);
+			k++;
+			}
+		DEBUG("saving image as %s.",image_filename);
+		cairo_destroy(cr);
+		closeImageSurface(format,surface,image_filename);
+		}
+	free(surfaces);
+	free(renders);
+	free(threads);
+	HersheyFree(hershey);
+	}
+
+/** the name of the image of a panel: 'prefix.title.png' where 'prefix.png' is the filename of '--image' (or .svg, .pdf) */
+static char* panelImageFilename(const char* image_filename,int format,const char* title)
+	{
+	size_t i,len=strlen(image_filename);
+	char* filename=(char*)safeMalloc(len+strlen(title)+10);
+	if(imageFormat(image_filename)==format) len-=4;
+	memcpy((void*)filename,image_filename,len);
+	filename[len++]='.';
+	for(i=0;title[i]!=0;++i)
+		{
+		/* e.g. 'F1|F2' or a region 'chr1:1-100' */
+		filename[len++]=(isalnum(title[i]) || title[i]=='-' || title[i]=='_'?title[i]:'_');
+		}
+	strcpy(&filename[len],IMAGE_FORMAT_SUFFIXES[format]);
+	return filename;
+	}
+
+/** the drawing area of '--heatmap': the left margin holds the names of the pairs or of the groups */
+static Rectangle heatmapDrawingArea(const Dimension imageDimension)
+	{
+	Rectangle area;
+	area.x=200;
+	area.y=50;
+	area.width=imageDimension.width-250;
+	area.height=imageDimension.height-100;
+	return area;
+	}
+
+/** color of IBD0, IBD1 and IBD2 in the heatmap */
+static const double HEATMAP_COLORS[3][3]={{0.92,0.92,0.92},{0.20,0.45,0.95},{0.90,0.10,0.10}};
+
+/**
+ * save the heatmap 'h' of the markers of the ranges in 'filename'. The cells are a small image surface
+ * (one pixel per cell) scaled to the drawing area without interpolation.
+ */
+static void renderHeatmap(ContextPtr config,int format,const char* filename,const Dimension imageDimension,const HeatmapPtr h,const MarkerRangePtr ranges,size_t n_ranges,char** group_names)
+	{
+	size_t i,r,g,rank=0UL;
+	int x,y,stride;
+	unsigned char* pixels;
+	const Rectangle area=heatmapDrawingArea(imageDimension);
+	double row_height=area.height/(double)MAX(1,h->n_pairs);
+	HersheyPtr hershey=HersheyNew();
+	if(hershey==NULL) DIE_FAILURE("Cannot create hershey");
+	cairo_surface_t *surface=createImageSurface(format,filename,imageDimension.width,imageDimension.height);
+	cairo_surface_t *cells=createImageSurface(IMAGE_FORMAT_PNG,"heatmap",(int)h->n_columns,(int)h->n_rows);
+	cairo_t *cr = cairo_create(surface);
+	if(cr==NULL) DIE_FAILURE("Cannot create image context");
+	
+	//draw background
+	cairo_set_source_rgb (cr, COLOR_WHITE);
+	cairo_rectangle(cr,0,0,imageDimension.width,imageDimension.height);
+	cairo_fill(cr);
+	
+	/* the mean IBD0,IBD1,IBD2 of a cell is the mix of their colors. Empty cells are transparent */
+	cairo_surface_flush(cells);
+	pixels=cairo_image_surface_get_data(cells);
+	stride=cairo_image_surface_get_stride(cells);
+	for(y=0;y< (int)h->n_rows;++y)
+		{
+		uint32_t* line=(uint32_t*)&pixels[y*stride];
+		for(x=0;x< (int)h->n_columns;++x)
+			{
+			size_t cell=(size_t)y*h->n_columns+x;
+			double rgb[3]={0,0,0},total=0.0;
+			int c,k;
+			if(h->count[cell]==0)
+				{
+				line[x]=0U;
+				continue;
+				}
+			for(k=0;k< 3;++k) total+=MAX(0.0,h->sums[cell*3+k]);
+			for(k=0;k< 3 && total>0.0;++k)
+				{
+				for(c=0;c< 3;++c) rgb[c]+=(MAX(0.0,h->sums[cell*3+k])/total)*HEATMAP_COLORS[k][c];
+				}
+			line[x]=0xFF000000U|
+				((uint32_t)(rgb[0]*255.0)<<16)|
+				((uint32_t)(rgb[1]*255.0)<<8)|
+				((uint32_t)(rgb[2]*255.0));
+			}
+		}
+	cairo_surface_mark_dirty(cells);
+	cairo_save(cr);
+	cairo_translate(cr,area.x,area.y);
+	cairo_scale(cr,area.width/(double)h->n_columns,area.height/(double)h->n_rows);
+	cairo_set_source_surface(cr,cells,0,0);
+	cairo_pattern_set_filter(cairo_get_source(cr),CAIRO_FILTER_NEAREST);
+	cairo_rectangle(cr,0,0,h->n_columns,h->n_rows);
+	cairo_fill(cr);
+	cairo_restore(cr);
+	cairo_surface_destroy(cells);
+	
+	/* the chromosomes (or the regions) above the columns */
+#define RANK2PIXEL(R) (area.x+((R)/(double)h->n_markers)*area.width)
+	cairo_set_line_width (cr, 0.5);
+	for(r=0;r< n_ranges;++r)
+		{
+		size_t begin=ranges[r].begin;
+		while(begin< ranges[r].end)
+			{
+			size_t end=begin+1;
+			int tid=ContextGetMarker(config,begin)->tid;
+			while(end< ranges[r].end && ContextGetMarker(config,end)->tid==tid) ++end;
+			double x1=RANK2PIXEL(rank);
+			double x2=RANK2PIXEL(rank+(end-begin));
+			const char* label=(ranges[r].label!=NULL?ranges[r].label:config->chromosomes[tid].name);
+			double label_len=MIN(strlen(label)*7,x2-x1);
+			
+			cairo_set_source_rgb (cr, COLOR_GRAY(0.5));
+			cairo_move_to (cr, x1, area.y-5);
+			cairo_line_to (cr, x1, area.y+area.height);
+			cairo_stroke (cr);
+			
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			HersheyPaint(hershey,
+				cr,label,
+				(x1+x2)/2.0 - label_len/2.0,
+				area.y/2.0-5,
+				label_len,
+				10);
+			cairo_stroke(cr);
+			rank+=(end-begin);
+			begin=end;
+			}
+		}
+#undef RANK2PIXEL
+	
+	/* the pairs, or the groups of pairs, at the left of the rows */
+	if(row_height>=8.0)
+		{
+		for(i=0;i< h->n_pairs;++i)
+			{
+			PairIndiPtr pair=&config->pairs[h->ranked_pairs[i]];
+			IndividualPtr indi1=&config->individuals[pair->indi1idx];
+			IndividualPtr indi2=&config->individuals[pair->indi2idx];
+			char* label=(char*)safeMalloc(strlen(indi1->family)+strlen(indi1->name)+strlen(indi2->family)+strlen(indi2->name)+5);
+			double label_len;
+			sprintf(label,"%s:%s|%s:%s",indi1->family,indi1->name,indi2->family,indi2->name);
+			label_len=MIN(strlen(label)*7,area.x-10);
+			cairo_set_source_rgb (cr, COLOR_GRAY(0.2));
+			HersheyPaint(hershey,
+				cr,label,
+				area.x-5-label_len,
+				area.y+i*row_height+row_height/2.0-4,
+				label_len,
+				8);
+			cairo_stroke(cr);
+			free(label);
+			}
+		}
+	for(g=0;g< h->n_groups && group_names!=NULL;++g)
+		{
+		double y1=area.y+h->group_offsets[g]*row_height;
+		double y2=area.y+h->group_offsets[g+1]*row_height;
+		if(g>0)
+			{
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			cairo_move_to (cr, area.x-5, y1);
+			cairo_line_to (cr, area.x+area.width, y1);
+			cairo_stroke (cr);
+			}
+		if(row_height< 8.0 && y2-y1>=10.0)
+			{
+			double label_len=MIN(strlen(group_names[g])*7,area.x-10);
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			HersheyPaint(hershey,
+				cr,group_names[g],
+				area.x-5-label_len,
+				(y1+y2)/2.0-5,
+				label_len,
+				10);
+			cairo_stroke(cr);
+			}
+		}
+	
+	/* legend */
+	for(i=0;i< 3;++i)
+		{
+		char label[10];
+		double lx=area.x+i*80;
+		double ly=area.y+area.height+25;
+		sprintf(label,"IBD%d",(int)i);
+		cairo_set_source_rgb (cr, HEATMAP_COLORS[i][0],HEATMAP_COLORS[i][1],HEATMAP_COLORS[i][2]);
+		cairo_rectangle(cr,lx,ly,15,15);
+		cairo_fill(cr);
+		cairo_set_source_rgb (cr, COLOR_BLACK);
+		HersheyPaint(hershey,cr,label,lx+20,ly+2,strlen(label)*7,10);
+		cairo_stroke(cr);
+		}
+	
+	//frame
+	cairo_set_source_rgb (cr,COLOR_BLACK);
+	cairo_rectangle (cr, area.x, area.y,area.width,area.height);
+	cairo_stroke (cr);
+	
+	DEBUG("saving heatmap as %s.",filename);
+	cairo_destroy(cr);
+	closeImageSurface(format,surface,filename);
+	HersheyFree(hershey);
+	}
+
+static void ibd_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Options:\n\n",stderr);
+	fputs(" -r|--region (chr|chr:start-end) restrict to that region. Optional.\n",stderr);
+	fputs(" -R|--regions (file.bed) restrict to the intervals of that BED file. Intervals are sorted and merged and a REGION column is added. Optional.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
+	fputs(" --relationship (list) restrict to the pairs having one of those comma-separated relationships computed from the pedigree: self, parent-offspring, full-sibs, first-degree, second-degree, third-degree, distant, related, unrelated.\n",stderr);
+	fputs(" --kinship-min (float) restrict to the pairs having a pedigree kinship coefficient >= this value (e.g. 0.125).\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs(" --threads (int) split the markers into N slices scanned by N processes. The output is the same. Default: 1.\n",stderr);
+	fputs(" --group-by (family|status|sexpair) add a COUNT_IBD column for each group of pairs: same family (or the two families), the status or the sex of the two individuals.\n",stderr);
+	fputs("\nWindow Options:\n\n",stderr);
+	fputs(" --window-markers (int) print the mean and the max of COUNT_IBD in sliding windows of N markers.\n",stderr);
+	fputs(" --window-bp (int) print the mean and the max of COUNT_IBD in sliding windows of N bases.\n",stderr);
+	fputs(" --window-step (int) move the windows by N markers or N bases. Default: the size of the window.\n",stderr);
+	fputs("\nTabular Options:\n\n",stderr);
+	fputs(" -noheader don't print data header.\n",stderr);
+	fputs(" -nopairsinheader don't print pairs in data header.\n",stderr);
+	fputs("\nCache Options:\n\n",stderr);
+	fprintf(stderr," --cache-dir (dir) save/reuse the tabular output of the queries in this directory. Default: $%s if defined.\n",QUERY_CACHE_ENV);
+	fprintf(stderr," --cache-size (int) max size of the cache directory in Mb. Default: %d.\n",QUERY_CACHE_DEFAULT_SIZE_MB);
+	fputs(" --chunk-cache-mb (int) size of the HDF5 chunk cache of a chunked '/ibd' in Mb. Default: computed from the chunks and the selected pairs.\n",stderr);
+	fputs(" --chunk-cache-slots (int) number of slots of the HDF5 chunk cache. Default: computed.\n",stderr);
+	fputs(" --chunk-cache-w0 (float) HDF5 chunk preemption policy in [0,1]. Default: computed.\n",stderr);
+	fputs("\nPlanner Options:\n\n",stderr);
+	fputs(" --explain print the estimated bytes and HDF5 calls of each strategy to read '/ibd' and the chosen one, and exit.\n",stderr);
+	fputs(" --plan (auto|mmap|bbox|rows|gather) force the strategy to read '/ibd'. Default: auto, the cheapest estimated strategy.\n",stderr);
+	fputs("\nImage Options:\n\n",stderr);
+	fputs(" -g|--image (filename.png|.svg|.pdf) save as PNG picture, or as a SVG or PDF vector image streamed without allocating the pixels.\n",stderr);
+	fputs(" --width (int) image-width.\n",stderr);
+	fputs(" --height (int) image-height.\n",stderr);
+	fputs(" --image-per (chrom|family) one panel per chromosome or per family (the pairs of the same family, or of the same two families). All the panels are computed in one scan of the markers and rendered by parallel threads. The panels are saved as 'prefix.(name).png' where 'prefix.png' is the filename of --image.\n",stderr);
+	fputs(" --image-columns (int) with --image-per: tile the panels in N columns in the --image file instead of saving separate files.\n",stderr);
+	fputs(" --heatmap (filename.png|.svg|.pdf) save the IBD0/IBD1/IBD2 of the selected pairs (rows, grouped with --group-by) x the markers (columns). The cells are averaged while the markers are scanned, so the size of the grid is at most --width x --height.\n",stderr);
+	fputs("\nBinary Options:\n\n",stderr);
+	fputs(" --format (tsv|f32|npy) output format. 'f32': raw little-endian float32 matrix [marker][pair][3] ; 'npy': NumPy array. Default: tsv.\n",stderr);
+	fputs(" -o|--out (filename) output file for the binary formats. A JSON sidecar (filename.json) describes the markers and the pairs.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+/**
+ * run an 'ibd' query. If 'shared' is not NULL, it is a context already opened by 'serve':
+ * the database is not re-opened, and the context is not disposed at the end.
+ */
+static int ibdQuery(ContextPtr shared,int argc,char** argv)
+	{
+	float treshold=DEFAULT_TRESHOLD_LIMIT;
+	int print_header=TRUE;
+	int print_pairs=TRUE;
+	size_t i;
+	ContextPtr config=(shared==NULL?ContextNew(argc,argv):shared);
+	RegionPtr region=NULL;
+	char* rgn_str=NULL;
+	
+	/** limit pedigree/pairs/family */
+	PairFilter filter;
+	PairFilterInit(&filter);
+
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_lazy_markers = 1;
+	config->on_read_load_reskins = 0; /* will be set later */
+	
+
+	/** Graphics2D stuff */
+	long genome_size=0L;
+	Dimension imageDimension;	
+	imageDimension.width=2000;
+	imageDimension.height=500;
+	Rectangle drawingArea;
+	char* image_filename=NULL;
+	/** one image per chromosome or family, saved in separate files or tiled in 'image_columns' columns */
+	int image_per=IMAGE_PER_NONE;
+	int image_columns=0;
+	RegionPtr chrom_regions=NULL;
+	/** pairs x markers heatmap */
+	char* heatmap_filename=NULL;
+	/** binary output */
+	int format=IBD_FORMAT_TSV;
+	char* out_filename=NULL;
+	/** batch of regions */
+	char* regions_filename=NULL;
+	MarkerRangePtr ranges=NULL;
+	size_t n_ranges=0UL;
+	/** query cache */
+	char* cache_dir=getenv(QUERY_CACHE_ENV);
+	long long cache_max_size=QUERY_CACHE_DEFAULT_SIZE_MB*1024LL*1024LL;
+	char* cache_filename=NULL;
+	FILE* cache_real_out=NULL;
+	/** parallel scan */
+	int n_threads=1;
+	IbdScan scan;
+	/** sliding windows */
+	long window_markers=0L;
+	long window_bp=0L;
+	long window_step=0L;
+	/** count by group of pairs */
+	int group_by=GROUP_BY_NONE;
+	char* group_by_str=NULL;
+	char** group_names=NULL;
+	/** read strategy of '/ibd' */
+	int read_plan=IBD_PLAN_AUTO;
+	int explain=FALSE;
+	
+	
+	if(argc==1)
+		{
+		ibd_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+
+
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+		      // {"enable-self-self",  no_argument , &config->enable_self_self , 1},
+			{"region",    required_argument, 0, 'r'},
+			{"regions",    required_argument, 0, 'R'},
+			{"noheader",  no_argument, &print_header, 0},
+			{"nopairsinheader",  no_argument, &print_pairs, 0},
+			{"image",  required_argument, 0, 'g'},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"width",  required_argument, 0,1024},
+			{"height",  required_argument, 0,1025},
+			{"image-per",  required_argument, 0,1043},
+			{"image-columns",  required_argument, 0,1044},
+			{"heatmap",  required_argument, 0,1045},
+			{"treshold",  required_argument, 0,1026},
+		    {"reskin",  required_argument, 0,1027},
+			{"relationship",  required_argument, 0,1041},
+			{"kinship-min",  required_argument, 0,1042},
+			{"format",  required_argument, 0,1028},
+			{"cache-dir",  required_argument, 0,1029},
+			{"cache-size",  required_argument, 0,1030},
+			{"threads",  required_argument, 0,1031},
+			{"window-markers",  required_argument, 0,1032},
+			{"window-bp",  required_argument, 0,1033},
+			{"window-step",  required_argument, 0,1034},
+			{"group-by",  required_argument, 0,1035},
+			{"chunk-cache-mb",  required_argument, 0,1036},
+			{"chunk-cache-slots",  required_argument, 0,1037},
+			{"chunk-cache-w0",  required_argument, 0,1038},
+			{"explain",  no_argument, 0,1039},
+			{"plan",  required_argument, 0,1040},
+			{"out",  required_argument, 0,'o'},
+			{0, 0, 0, 0}
+		     };
+		 /* getopt_long stores the option index here. */
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "r:R:g:i:p:F:I:P:Y:o:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'r': rgn_str = optarg ;break;
+			case 'g': image_filename = optarg ;break;
+			case 'o': out_filename = optarg ;break;
+			case 'R': regions_filename = optarg ;break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 1024: imageDimension.width = atoi(optarg);break;
+			case 1025: imageDimension.height = atoi(optarg);break;
+			case 1043:
+				if(strcmp(optarg,"chrom")==0) image_per=IMAGE_PER_CHROM;
+				else if(strcmp(optarg,"family")==0) image_per=IMAGE_PER_FAMILY;
+				else
+					{
+					fprintf(stderr,"unknown image-per %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1044: image_columns = atoi(optarg);
+				if(image_columns<1)
+					{
+					fprintf(stderr,"bad number of columns %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1045: heatmap_filename = optarg; break;
+			case 1026: treshold = atof(optarg);break;
+			case 1027:
+				if(PairFilterParseReskin(&filter,optarg)!=0) return EXIT_FAILURE;
+				config->on_read_load_reskins = 1;
+				break;
+			case 1041: if(PairFilterParseRelationship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1042: if(PairFilterParseKinship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1028:
+				{
+				if(strcmp(optarg,"tsv")==0) format=IBD_FORMAT_TSV;
+				else if(strcmp(optarg,"f32")==0) format=IBD_FORMAT_F32;
+				else if(strcmp(optarg,"npy")==0) format=IBD_FORMAT_NPY;
+				else
+					{
+					fprintf(stderr,"unknown format %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+				}
+			case 1029: cache_dir = optarg; break;
+			case 1030: cache_max_size = atoll(optarg)*1024LL*1024LL; break;
+			case 1031: n_threads = atoi(optarg);
+				if(n_threads<1)
+					{
+					fprintf(stderr,"bad number of threads %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1032: window_markers = atol(optarg); break;
+			case 1033: window_bp = atol(optarg); break;
+			case 1034: window_step = atol(optarg); break;
+			case 1035:
+				group_by_str = optarg;
+				if(strcmp(optarg,"family")==0) group_by=GROUP_BY_FAMILY;
+				else if(strcmp(optarg,"status")==0) group_by=GROUP_BY_STATUS;
+				else if(strcmp(optarg,"sexpair")==0) group_by=GROUP_BY_SEXPAIR;
+				else
+					{
+					fprintf(stderr,"unknown group-by %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1036:
+				if(atol(optarg)<1)
+					{
+					fprintf(stderr,"bad chunk cache size %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				config->chunk_cache_bytes = (size_t)atol(optarg)*1024UL*1024UL;
+				break;
+			case 1037:
+				if(atol(optarg)<1)
+					{
+					fprintf(stderr,"bad number of chunk slots %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				config->chunk_cache_slots = (size_t)atol(optarg);
+				break;
+			case 1038:
+				config->chunk_cache_w0 = atof(optarg);
+				if(config->chunk_cache_w0<0.0 || config->chunk_cache_w0>1.0)
+					{
+					fprintf(stderr,"bad chunk w0 %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1039: explain=TRUE; break;
+			case 1040:
+				{
+				for(read_plan=IBD_PLAN_AUTO;read_plan< IBD_PLAN_COUNT;++read_plan)
+					{
+					if(strcmp(optarg,IBD_PLAN_NAMES[read_plan])==0) break;
+					}
+				if(read_plan==IBD_PLAN_COUNT)
+					{
+					fprintf(stderr,"unknown plan %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+				}
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}	
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(rgn_str!=NULL && regions_filename!=NULL)
+		{
+		fprintf(stderr,"options --region and --regions are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_markers<0 || window_bp<0 || window_step<0 || window_bp>INT_MAX)
+		{
+		fprintf(stderr,"bad window size or step.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_markers>0 && window_bp>0)
+		{
+		fprintf(stderr,"options --window-markers and --window-bp are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_step==0) window_step=(window_markers>0?window_markers:window_bp);
+	if(group_by!=GROUP_BY_NONE && (window_markers>0 || window_bp>0 || image_filename!=NULL || format!=IBD_FORMAT_TSV))
+		{
+		fprintf(stderr,"option --group-by is only available for the tabular output and --heatmap.\n");
+		return EXIT_FAILURE;
+		}
+	if(heatmap_filename!=NULL && (window_markers>0 || window_bp>0 || format!=IBD_FORMAT_TSV))
+		{
+		fprintf(stderr,"option --heatmap cannot be used with --window-* or --format.\n");
+		return EXIT_FAILURE;
+		}
+	if((image_per!=IMAGE_PER_NONE || image_columns>0) && image_filename==NULL)
+		{
+		fprintf(stderr,"options --image-per and --image-columns require --image.\n");
+		return EXIT_FAILURE;
+		}
+	if(image_columns>0 && image_per==IMAGE_PER_NONE)
+		{
+		fprintf(stderr,"option --image-columns requires --image-per.\n");
+		return EXIT_FAILURE;
+		}
+	if(image_per==IMAGE_PER_FAMILY && (window_markers>0 || window_bp>0))
+		{
+		fprintf(stderr,"options --image-per family and --window-* are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if((window_markers>0 || window_bp>0) && format!=IBD_FORMAT_TSV)
+		{
+		fprintf(stderr,"options --window-* and --format are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if(format!=IBD_FORMAT_TSV)
+		{
+		if(out_filename==NULL)
+			{
+			fprintf(stderr,"option --out is required for binary formats.\n");
+			return EXIT_FAILURE;
+			}
+		if(image_filename!=NULL)
+			{
+			fprintf(stderr,"options --format and --image are mutually exclusive.\n");
+			return EXIT_FAILURE;
+			}
+		}
+	
+	/* only the tabular output is cached */
+	if(cache_dir!=NULL && cache_dir[0]!=0 && image_filename==NULL && heatmap_filename==NULL && format==IBD_FORMAT_TSV && !explain)
+		{
+		QueryHash h;
+		h.h1=14695981039346656037ULL;
+		h.h2=14695981039346656037ULL ^ 0x5bd1e995ULL;
+		QueryHashString(&h,GIT_HASH);
+		QueryHashFile(&h,argv[optind]);
+		QueryHashString(&h,rgn_str);
+		if(regions_filename!=NULL) QueryHashFile(&h,regions_filename);
+		QueryHashStrings(&h,filter.limitIndividuals.data,filter.limitIndividuals.size);
+		QueryHashStrings(&h,filter.limitPairs.data,filter.limitPairs.size);
+		QueryHashStrings(&h,filter.limitFamilies.data,filter.limitFamilies.size);
+		QueryHashLong(&h,filter.allow_self_self);
+		QueryHashLong(&h,filter.check_reskin);
+		QueryHashDouble(&h,filter.min_reskin);
+		QueryHashDouble(&h,filter.max_reskin);
+		QueryHashLong(&h,(long)filter.relationships);
+		QueryHashLong(&h,filter.check_kinship);
+		QueryHashDouble(&h,filter.min_kinship);
+		QueryHashDouble(&h,treshold);
+		QueryHashLong(&h,print_header);
+		QueryHashLong(&h,print_pairs);
+		QueryHashLong(&h,window_markers);
+		QueryHashLong(&h,window_bp);
+		QueryHashLong(&h,window_step);
+		QueryHashString(&h,group_by_str);
+		cache_filename=QueryCacheFilename(cache_dir,&h);
+		if(QueryCacheCopy(cache_filename,config->out)==0)
+			{
+			DEBUG("cache: using %s",cache_filename);
+			/* last recently used */
+			utime(cache_filename,NULL);
+			free(cache_filename);
+			fflush(config->out);
+			if(shared==NULL) ContextFree(config);
+			return EXIT_SUCCESS;
+			}
+		/* write the output in a temporary file and copy it to the output at the end */
+		cache_real_out=config->out;
+		config->out=QueryCacheCreateTmp(cache_filename);
+		}
+	
+	if(shared==NULL)
+		{
+		config->hdf5_filename = argv[optind];
+		ContextOpenForRead(config);
+		}
+	
+	
+	if(rgn_str!=NULL)
+		{
+		region=(RegionPtr)safeCalloc(1,sizeof(Region));
+		parseRegion(config,region,rgn_str);
+		genome_size=1+(region->end -  region->start);
+		}
+	else
+		{
+		for(i=0;i< config->chromosome_count;++i)
+			{
+			config->chromosomes[i].cumulative_start = genome_size;
+			genome_size += config->chromosomes[i].length;
+			}
+		}
+	selectPairs(config,&filter);
+
+	memset((void*)&scan,0,sizeof(IbdScan));
+	if(group_by!=GROUP_BY_NONE)
+		{
+		scan.pair_group=groupSelectedPairs(config,group_by,&group_names,&scan.n_groups);
+		}
+	else if(image_per==IMAGE_PER_FAMILY)
+		{
+		/* the groups of pairs are the panels */
+		scan.pair_group=groupSelectedPairs(config,GROUP_BY_FAMILY,&group_names,&scan.n_groups);
+		}
+	
+	ranges = buildMarkerRanges(config,region,regions_filename,&n_ranges);
+	IbdDataSetPtr ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	
+	if(explain || format==IBD_FORMAT_TSV)
+		{
+		IbdReadPlan plan;
+		scan.read_plan=planIbdRead(config,ibdds,ranges,n_ranges,read_plan,&plan);
+		if(explain)
+			{
+			explainIbdRead(config,ibdds,&plan);
+			IbdDataSetClose(ibdds);
+			MarkerRangesFree(ranges,n_ranges);
+			for(i=0;i< scan.n_groups;++i) free(group_names[i]);
+			free(group_names);
+			free(scan.pair_group);
+			free(region);
+			if(shared==NULL) ContextFree(config);
+			return EXIT_SUCCESS;
+			}
+		}
+	
+	if(format!=IBD_FORMAT_TSV)
+		{
+		exportIbdMatrix(config,ibdds,ranges,n_ranges,format,out_filename);
+		IbdDataSetClose(ibdds);
+		MarkerRangesFree(ranges,n_ranges);
+		free(region);
+		if(shared==NULL) ContextFree(config);
+		return EXIT_SUCCESS;
+		}
+	
+
+
+	if(print_header && image_filename==NULL && heatmap_filename==NULL && (window_markers>0 || window_bp>0))
+		{
+		if(regions_filename!=NULL) fputs("REGION\t",config->out);
+		fputs("CHROM\tSTART\tEND\tN_MARKERS\tMEAN_COUNT_IBD\tMAX_COUNT_IBD\n",config->out);
+		}
+	else if(print_header && image_filename==NULL && heatmap_filename==NULL)
+		{
+		if(regions_filename!=NULL) fputs("REGION\t",config->out);
+		fputs("CHROM\tPOS\tNAME",config->out);
+		for(i=0;i< config->pair_count && print_pairs!=0;++i)
+			{
+			PairIndiPtr pair = &config->pairs[i];
+			if(!pair->selected) continue;
+			IndividualPtr indi1=&config->individuals[pair->indi1idx];
+			IndividualPtr indi2=&config->individuals[pair->indi2idx];		
+			fprintf(config->out,"\t%s:%s|%s:%s",
+				indi1->family,indi1->name,
+				indi2->family,indi2->name
+				);
+
+			}
+		fputs("\tCOUNT_IBD",config->out);
+		for(i=0;i< scan.n_groups;++i)
+			{
+			fprintf(config->out,"\tCOUNT_IBD:%s",group_names[i]);
+			}
+		fputc('\n',config->out);
+		}
+
+	scan.treshold=treshold;
+	scan.print_pairs=print_pairs;
+	scan.image=(image_filename!=NULL);
+	drawingArea.x=	100;
+	drawingArea.width= imageDimension.width-200;
+	drawingArea.y=	50;
+	drawingArea.height= imageDimension.height-100;
+	scan.image_per=image_per;
+	if(heatmap_filename!=NULL)
+		{
+		Rectangle area=heatmapDrawingArea(imageDimension);
+		if(area.width<1 || area.height<1) DIE_FAILURE("image is too small.");
+		scan.heatmap=HeatmapNew(config,(size_t)area.width,(size_t)area.height,countMarkersInRanges(ranges,n_ranges),scan.pair_group,scan.n_groups);
+		}
+	if(scan.image)
+		{
+		if(drawingArea.width<1 || drawingArea.height<1) DIE_FAILURE("image is too small.");
+		switch(image_per)
+			{
+			case IMAGE_PER_CHROM:
+				{
+				/* a panel for each chromosome having a marker in the ranges */
+				size_t r;
+				scan.n_panels=config->chromosome_count;
+				scan.panels=(ImageBinsPtr*)safeCalloc(MAX(1,scan.n_panels),sizeof(ImageBinsPtr));
+				chrom_regions=(RegionPtr)safeCalloc(MAX(1,config->chromosome_count),sizeof(Region));
+				for(r=0;r< n_ranges;++r)
+					{
+					int tid;
+					if(ranges[r].end<=ranges[r].begin) continue;
+					for(tid=ContextGetMarker(config,ranges[r].begin)->tid;tid<=ContextGetMarker(config,ranges[r].end-1)->tid;++tid)
+						{
+						ChromPtr chrom=&config->chromosomes[tid];
+						if(scan.panels[tid]!=NULL) continue;
+						if(region!=NULL && region->tid==tid)
+							{
+							chrom_regions[tid]=*region;
+							}
+						else
+							{
+							chrom_regions[tid].tid=tid;
+							chrom_regions[tid].start=0;
+							chrom_regions[tid].end=chrom->length;
+							}
+						scan.panels[tid]=ImageBinsNew((size_t)drawingArea.width,&chrom_regions[tid],1L+(chrom_regions[tid].end-chrom_regions[tid].start));
+						scan.panels[tid]->title=(region!=NULL && region->tid==tid?safeStrDup(rgn_str):safeStrDup(chrom->name));
+						}
+					}
+				break;
+				}
+			case IMAGE_PER_FAMILY:
+				scan.n_panels=scan.n_groups;
+				scan.panels=(ImageBinsPtr*)safeCalloc(MAX(1,scan.n_panels),sizeof(ImageBinsPtr));
+				for(i=0;i< scan.n_groups;++i)
+					{
+					scan.panels[i]=ImageBinsNew((size_t)drawingArea.width,region,genome_size);
+					scan.panels[i]->title=safeStrDup(group_names[i]);
+					}
+				break;
+			default:
+				scan.n_panels=1;
+				scan.panels=(ImageBinsPtr*)safeCalloc(1,sizeof(ImageBinsPtr));
+				scan.panels[0]=ImageBinsNew((size_t)drawingArea.width,region,genome_size);
+				if(rgn_str!=NULL) scan.panels[0]->title=safeStrDup(rgn_str);
+				break;
+			}
+		}
+	if(window_markers>0 || window_bp>0)
+		{
+		scan.counts=(int*)safeCalloc(MAX(1,countMarkersInRanges(ranges,n_ranges)),sizeof(int));
+		}
+	if(n_threads>1)
+		{
+		scanMarkerRangesParallel(config,ibdds,&scan,ranges,n_ranges,n_threads);
+		}
+	else
+		{
+		scanMarkerRanges(config,ibdds,&scan,ranges,n_ranges,0,countMarkersInRanges(ranges,n_ranges));
+		}
+	if(scan.counts!=NULL)
+		{
+		windowIbdCounts(config,&scan,ranges,n_ranges,(size_t)window_markers,(int)window_bp,(size_t)window_step);
+		free(scan.counts);
+		}
+	if(image_filename!=NULL)
+		{
+		char** filenames=NULL;
+		int image_format=imageFormat(image_filename);
+		if(image_format<0)
+			{
+			fprintf(stderr,"#WARNING. Image filename should ends with '.png', '.svg' or '.pdf'. Saved as PNG.\n");
+			image_format=IMAGE_FORMAT_PNG;
+			}
+		if(scan.image_per!=IMAGE_PER_NONE && image_columns==0)
+			{
+			filenames=(char**)safeCalloc(scan.n_panels,sizeof(char*));
+			for(i=0;i< scan.n_panels;++i)
+				{
+				if(scan.panels[i]==NULL) continue;
+				filenames[i]=panelImageFilename(image_filename,image_format,scan.panels[i]->title);
+				DEBUG("saving image as %s.",filenames[i]);
+				}
+			}
+		else
+			{
+			DEBUG("saving image as %s.",image_filename);
+			if(scan.image_per==IMAGE_PER_NONE) filenames=&image_filename;
+			}
+		renderIbdImages(config,image_format,imageDimension,drawingArea,scan.panels,scan.n_panels,filenames,image_columns,image_filename);
+		if(filenames!=&image_filename)
+			{
+			for(i=0;i< scan.n_panels && filenames!=NULL;++i) free(filenames[i]);
+			free(filenames);
+			}
+		}//end of image
+	if(scan.heatmap!=NULL)
+		{
+		int heatmap_format=imageFormat(heatmap_filename);
+		if(heatmap_format<0)
+			{
+			fprintf(stderr,"#WARNING. Heatmap filename should ends with '.png', '.svg' or '.pdf'. Saved as PNG.\n");
+			heatmap_format=IMAGE_FORMAT_PNG;
+			}
+		renderHeatmap(config,heatmap_format,heatmap_filename,imageDimension,scan.heatmap,ranges,n_ranges,(scan.pair_group!=NULL?group_names:NULL));
+		HeatmapFree(scan.heatmap);
+		}
+	for(i=0;i< scan.n_panels;++i) ImageBinsFree(scan.panels[i]);
+	free(scan.panels);
+	free(chrom_regions);
+	
+	IbdDataSetClose(ibdds);
+	MarkerRangesFree(ranges,n_ranges);
+	for(i=0;i< scan.n_groups;++i) free(group_names[i]);
+	free(group_names);
+	free(scan.pair_group);
+	
+	if(region!=NULL)
+		{
+		free(region);
+		}
+
+	if(cache_real_out!=NULL)
+		{
+		QueryCacheCommit(config->out,cache_filename);
+		config->out=cache_real_out;
+		QueryCacheCopy(cache_filename,config->out);
+		QueryCacheEvict(cache_dir,cache_max_size);
+		free(cache_filename);
+		}
+
+	if(shared==NULL)
+		{
+		ContextFree(config);
+		}
+	else
+		{
+		fflush(config->out);
+		}
+	return EXIT_SUCCESS;
+	}
+
+int main_ibd(int argc,char** argv)
+	{
+	return ibdQuery(NULL,argc,argv);
+	}
+
+
+/** current run of consecutive IBD markers for one pair in 'segments' */
+typedef struct ibd_run_t
+	{
+	size_t first;
+	size_t n_markers;
+	double sum;
+	} IbdRun,*IbdRunPtr;
+
+/** where the segments found for one treshold go: printed to config->out or collected */
+typedef struct segment_sink_t
+	{
+	float treshold;
+	size_t min_markers;
+	boolean_t collect;
+	IbdSegmentPtr segments;
+	size_t segment_count;
+	size_t segment_capacity;
+	} SegmentSink,*SegmentSinkPtr;
+
+static void printSegment(ContextPtr config,const IbdSegmentPtr seg)
+	{
+	PairIndiPtr pair = &config->pairs[seg->pair_index];
+	IndividualPtr indi1=&config->individuals[pair->indi1idx];
+	IndividualPtr indi2=&config->individuals[pair->indi2idx];
+	fprintf(config->out,"%s\t%d\t%d\t%s:%s|%s:%s\t%d\t%f\n",
+		config->chromosomes[seg->tid].name,
+		seg->start,
+		seg->end,
+		indi1->family,indi1->name,
+		indi2->family,indi2->name,
+		seg->n_markers,
+		seg->mean_ibd0
+		);
+	}
+
+/** print or collect the segment of this run (if long enough) and reset the run */
+static void flushIbdRun(ContextPtr config,SegmentSinkPtr sink,size_t pair_index,IbdRunPtr run)
+	{
+	if(run->n_markers>0 && run->n_markers>=sink->min_markers)
+		{
+		IbdSegment seg;
+		MarkerPtr first = &config->markers[run->first];
+		MarkerPtr last = &config->markers[run->first+run->n_markers-1];
+		seg.tid = first->tid;
+		/* same coordinates as 'markers': BED [start,end[ */
+		seg.start = first->position;
+		seg.end = last->position+1;
+		seg.pair_index = (int)pair_index;
+		seg.n_markers = (int)run->n_markers;
+		seg.mean_ibd0 = (float)(run->sum/run->n_markers);
+		seg.max_end = seg.end;
+		if(sink->collect)
+			{
+			if(sink->segment_count==sink->segment_capacity)
+				{
+				sink->segment_capacity=MAX(1024,sink->segment_capacity*2);
+				sink->segments=(IbdSegmentPtr)safeRealloc(sink->segments,sink->segment_capacity*sizeof(IbdSegment));
+				}
+			sink->segments[sink->segment_count++]=seg;
+			}
+		else
+			{
+			printSegment(config,&seg);
+			}
+		}
+	run->n_markers=0UL;
+	run->sum=0.0;
+	}
+
+/**
+ * stream '/ibd' in the order of the markers of the ranges and find the runs of consecutive markers
+ * where the selected pairs are IBD (IBD0 < treshold) , for each of the 'n_sinks' tresholds
+ */
+static void scanIbdSegments(ContextPtr config,IbdDataSetPtr ds,const MarkerRangePtr ranges,size_t n_ranges,SegmentSinkPtr sinks,size_t n_sinks)
+	{
+	size_t i,j,k,t,r,n;
+	size_t n_selected,pair_start,pair_end,row_size,block_markers;
+	size_t* columns=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	size_t* pair_indexes=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	float* block=NULL;
+	IbdRunPtr runs=NULL;
+	
+	n_selected=selectedPairColumns(config,columns,&pair_start,&pair_end);
+	for(j=0,k=0;j< config->pair_count;++j)
+		{
+		if(config->pairs[j].selected) pair_indexes[k++]=j;
+		}
+	/* runs[t*n_selected+k] : run of the k-th selected pair for the t-th treshold */
+	runs=(IbdRunPtr)safeCalloc(MAX(1,n_selected*n_sinks),sizeof(IbdRun));
+	row_size=(pair_end-pair_start)*3;
+	block_markers=MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,row_size)*sizeof(float)));
+	if(n_selected>0)
+		{
+		block=(float*)safeMalloc(MIN(block_markers,MAX(1,config->marker_count))*row_size*sizeof(float));
+		}
+	
+#define FLUSH_ALL_RUNS for(t=0;t< n_sinks;++t) for(k=0;k< n_selected;++k) \
+		flushIbdRun(config,&sinks[t],pair_indexes[k],&runs[t*n_selected+k])
+	
+	for(r=0;r< n_ranges && n_selected>0;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;i+=n)
+			{
+			n=MIN(block_markers,ranges[r].end-i);
+			IbdDataSetReadBlock(config,ds,i,n,pair_start,pair_end-pair_start,block);
+			for(j=0;j< n;++j)
+				{
+				const float* row= &block[j*row_size];
+				/* a segment doesn't span two chromosomes */
+				if(i+j>ranges[r].begin && config->markers[i+j].tid!=config->markers[i+j-1].tid)
+					{
+					FLUSH_ALL_RUNS;
+					}
+				for(t=0;t< n_sinks;++t)
+					{
+					IbdRunPtr sink_runs=&runs[t*n_selected];
+					for(k=0;k< n_selected;++k)
+						{
+						float ibd0=row[columns[k]];
+						if(ibd0 < sinks[t].treshold && ibd0 > IBD_UNDEFINED)
+							{
+							if(sink_runs[k].n_markers==0) sink_runs[k].first=i+j;
+							sink_runs[k].n_markers++;
+							sink_runs[k].sum+=ibd0;
+							}
+						else if(sink_runs[k].n_markers>0)
+							{
+							flushIbdRun(config,&sinks[t],pair_indexes[k],&sink_runs[k]);
+							}
+						}
+					}
+				}
+			}
+		FLUSH_ALL_RUNS;
+		}
+#undef FLUSH_ALL_RUNS
+	free(block);
+	free(runs);
+	free(columns);
+	free(pair_indexes);
+	}
+
+static void segments_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Prints the segments of consecutive markers where a pair is IBD (IBD0 < treshold) as a BED-like file:\n",stderr);
+	fputs("CHROM, START (position of the first marker), END (position of the last marker + 1, like 'markers'), PAIR, N_MARKERS, MEAN_IBD0.\n",stderr);
+	fputs("A segment is interrupted by a marker with an undefined IBD or a change of chromosome/region.\n",stderr);
+	fputs("Segments are printed when they end, use 'sort -k1,1 -k2,2n' to get a sorted BED.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -r|--region (chr|chr:start-end) restrict to that region. Optional.\n",stderr);
+	fputs(" -R|--regions (file.bed) restrict to the intervals of that BED file. Optional.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.\n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
+	fputs(" --relationship (list) restrict to the pairs having one of those comma-separated relationships computed from the pedigree: self, parent-offspring, full-sibs, first-degree, second-degree, third-degree, distant, related, unrelated.\n",stderr);
+	fputs(" --kinship-min (float) restrict to the pairs having a pedigree kinship coefficient >= this value (e.g. 0.125).\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs(" --min-markers (int) only print the segments with at least N markers. Default: 1.\n",stderr);
+	fputs(" --noheader don't print header.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_segments(int argc,char** argv)
+	{
+	int print_header=TRUE;
+	SegmentSink sink;
+	ContextPtr config=ContextNew(argc,argv);
+	RegionPtr region=NULL;
+	char* rgn_str=NULL;
+	char* regions_filename=NULL;
+	MarkerRangePtr ranges=NULL;
+	size_t n_ranges=0UL;
+	PairFilter filter;
+	IbdDataSetPtr ibdds;
+	
+	PairFilterInit(&filter);
+	memset((void*)&sink,0,sizeof(SegmentSink));
+	sink.min_markers=1UL;
+	sink.treshold=DEFAULT_TRESHOLD_LIMIT;
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_load_reskins = 0;
+	
+	if(argc==1)
+		{
+		segments_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"region",    required_argument, 0, 'r'},
+			{"regions",    required_argument, 0, 'R'},
+			{"noheader",  no_argument, &print_header, 0},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"treshold",  required_argument, 0,1026},
+			{"reskin",  required_argument, 0,1027},
+			{"relationship",  required_argument, 0,1041},
+			{"kinship-min",  required_argument, 0,1042},
+			{"min-markers",  required_argument, 0,1028},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "r:R:i:p:F:I:P:Y:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'r': rgn_str = optarg ;break;
+			case 'R': regions_filename = optarg ;break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 1026: sink.treshold = atof(optarg);break;
+			case 1027:
+				if(PairFilterParseReskin(&filter,optarg)!=0) return EXIT_FAILURE;
+				config->on_read_load_reskins = 1;
+				break;
+			case 1041: if(PairFilterParseRelationship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1042: if(PairFilterParseKinship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1028:
+				if(atoi(optarg)<1)
+					{
+					fprintf(stderr,"bad number of markers %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				sink.min_markers=(size_t)atoi(optarg);
+				break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(rgn_str!=NULL && regions_filename!=NULL)
+		{
+		fprintf(stderr,"options --region and --regions are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	
+	if(rgn_str!=NULL)
+		{
+		region=(RegionPtr)safeCalloc(1,sizeof(Region));
+		parseRegion(config,region,rgn_str);
+		}
+	selectPairs(config,&filter);
+	
+	ranges = buildMarkerRanges(config,region,regions_filename,&n_ranges);
+	ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	
+	if(print_header)
+		{
+		fputs("#CHROM\tSTART\tEND\tPAIR\tN_MARKERS\tMEAN_IBD0\n",config->out);
+		}
+	
+	scanIbdSegments(config,ibdds,ranges,n_ranges,&sink,1);
+	
+	IbdDataSetClose(ibdds);
+	MarkerRangesFree(ranges,n_ranges);
+	free(region);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+
+
+static void printPeak(ContextPtr config,const char* scope,size_t rank,const IbdWindowPtr w)
+	{
+	fprintf(config->out,"%s\t%d\t%s\t%d\t%d\t%d\t%f\t%d\n",
+		scope,
+		(int)rank,
+		config->chromosomes[config->markers[w->first_marker].tid].name,
+		w->start,
+		w->end,
+		(int)w->n_markers,
+		w->mean,
+		w->max
+		);
+	}
+
+static void peaks_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Prints the K best non-overlapping windows of COUNT_IBD (see 'ibd') for each chromosome and for the whole genome.\n",stderr);
+	fputs("The windows are ranked on the mean, then the max of COUNT_IBD.\n",stderr);
+	fputs("Columns: SCOPE (chromosome or 'genome'), RANK, CHROM, START, END, N_MARKERS, MEAN_COUNT_IBD, MAX_COUNT_IBD.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -r|--region (chr|chr:start-end) restrict to that region. Optional.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.\n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
+	fputs(" --relationship (list) restrict to the pairs having one of those comma-separated relationships computed from the pedigree: self, parent-offspring, full-sibs, first-degree, second-degree, third-degree, distant, related, unrelated.\n",stderr);
+	fputs(" --kinship-min (float) restrict to the pairs having a pedigree kinship coefficient >= this value (e.g. 0.125).\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs(" -k|--top (int) number of windows per chromosome and for the genome. Default: 10.\n",stderr);
+	fputs(" --window-markers (int) windows of N markers. Default: 1 (the markers).\n",stderr);
+	fputs(" --window-bp (int) windows of N bases.\n",stderr);
+	fputs(" --window-step (int) move the windows by N markers or N bases. Default: the size of the window.\n",stderr);
+	fputs(" --threads (int) scan the markers of each chromosome with N processes. Default: 1.\n",stderr);
+	fputs(" --nochrom only print the best windows of the genome.\n",stderr);
+	fputs(" --noheader don't print header.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_peaks(int argc,char** argv)
+	{
+	int print_header=TRUE;
+	int print_chrom=TRUE;
+	size_t i,sb,se,top_k=10UL;
+	long window_markers=0L;
+	long window_bp=0L;
+	long window_step=0L;
+	int n_threads=1;
+	ContextPtr config=ContextNew(argc,argv);
+	RegionPtr region=NULL;
+	char* rgn_str=NULL;
+	MarkerRangePtr ranges=NULL;
+	size_t n_ranges=0UL;
+	PairFilter filter;
+	IbdScan scan;
+	WindowHeap genome,chrom;
+	IbdDataSetPtr ibdds;
+	
+	PairFilterInit(&filter);
+	memset((void*)&scan,0,sizeof(IbdScan));
+	scan.treshold=DEFAULT_TRESHOLD_LIMIT;
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_load_reskins = 0;
+	
+	if(argc==1)
+		{
+		peaks_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"region",    required_argument, 0, 'r'},
+			{"noheader",  no_argument, &print_header, 0},
+			{"nochrom",  no_argument, &print_chrom, 0},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"top",  required_argument, 0, 'k'},
+			{"treshold",  required_argument, 0,1026},
+			{"reskin",  required_argument, 0,1027},
+			{"relationship",  required_argument, 0,1041},
+			{"kinship-min",  required_argument, 0,1042},
+			{"threads",  required_argument, 0,1031},
+			{"window-markers",  required_argument, 0,1032},
+			{"window-bp",  required_argument, 0,1033},
+			{"window-step",  required_argument, 0,1034},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "r:i:p:F:I:P:Y:k:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'r': rgn_str = optarg ;break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 'k':
+				if(atoi(optarg)<1)
+					{
+					fprintf(stderr,"bad number of windows %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				top_k=(size_t)atoi(optarg);
+				break;
+			case 1026: scan.treshold = atof(optarg);break;
+			case 1027:
+				if(PairFilterParseReskin(&filter,optarg)!=0) return EXIT_FAILURE;
+				config->on_read_load_reskins = 1;
+				break;
+			case 1041: if(PairFilterParseRelationship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1042: if(PairFilterParseKinship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1031: n_threads = atoi(optarg);
+				if(n_threads<1)
+					{
+					fprintf(stderr,"bad number of threads %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1032: window_markers = atol(optarg); break;
+			case 1033: window_bp = atol(optarg); break;
+			case 1034: window_step = atol(optarg); break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_markers<0 || window_bp<0 || window_step<0 || window_bp>INT_MAX)
+		{
+		fprintf(stderr,"bad window size or step.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_markers>0 && window_bp>0)
+		{
+		fprintf(stderr,"options --window-markers and --window-bp are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if(window_markers==0 && window_bp==0) window_markers=1;
+	if(window_step==0) window_step=(window_markers>0?window_markers:window_bp);
+	
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	if(rgn_str!=NULL)
+		{
+		region=(RegionPtr)safeCalloc(1,sizeof(Region));
+		parseRegion(config,region,rgn_str);
+		}
+	selectPairs(config,&filter);
+	ranges = buildMarkerRanges(config,region,NULL,&n_ranges);
+	ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	
+	memset((void*)&genome,0,sizeof(WindowHeap));
+	genome.heap=(IbdWindowPtr)safeCalloc(top_k,sizeof(IbdWindow));
+	genome.capacity=top_k;
+	/* a window overlaps at most 2*(size/step+1) windows, so the greedy selection of K windows
+	 * only looks at the K*(2*(size/step+1)+1) best windows of a chromosome */
+	memset((void*)&chrom,0,sizeof(WindowHeap));
+	chrom.capacity=(size_t)MIN((double)top_k*(2.0*((window_markers>0?window_markers:window_bp)/window_step+1)+1.0),
+		(double)MAX(top_k,config->marker_count));
+	chrom.heap=(IbdWindowPtr)safeCalloc(chrom.capacity,sizeof(IbdWindow));
+	scan.peaks=&chrom;
+	
+	if(print_header)
+		{
+		fputs("#SCOPE\tRANK\tCHROM\tSTART\tEND\tN_MARKERS\tMEAN_COUNT_IBD\tMAX_COUNT_IBD\n",config->out);
+		}
+	/* one chromosome at a time: only the counts of one chromosome and its best windows are kept in memory */
+	for(sb=ranges[0].begin;sb< ranges[0].end;sb=se)
+		{
+		MarkerRange chrom_range;
+		size_t n_selected;
+		for(se=sb+1;se< ranges[0].end && config->markers[se].tid==config->markers[sb].tid;++se) {}
+		memset((void*)&chrom_range,0,sizeof(MarkerRange));
+		chrom_range.begin=sb;
+		chrom_range.end=se;
+		scan.counts=(int*)safeCalloc(se-sb,sizeof(int));
+		if(n_threads>1)
+			{
+			scanMarkerRangesParallel(config,ibdds,&scan,&chrom_range,1,n_threads);
+			}
+		else
+			{
+			scanMarkerRanges(config,ibdds,&scan,&chrom_range,1,0,se-sb);
+			}
+		for(;;)
+			{
+			chrom.size=0UL;
+			chrom.offered=0UL;
+			windowIbdCounts(config,&scan,&chrom_range,1,(size_t)window_markers,(int)window_bp,(size_t)window_step);
+			n_selected=selectNonOverlappingWindows(chrom.heap,chrom.size,top_k);
+			/* less than K windows and some windows were dropped by the heap (markers sharing a position) : try again with a larger heap */
+			if(n_selected==top_k || chrom.offered<=chrom.capacity) break;
+			chrom.capacity*=2;
+			chrom.heap=(IbdWindowPtr)safeRealloc(chrom.heap,chrom.capacity*sizeof(IbdWindow));
+			}
+		free(scan.counts);
+		scan.counts=NULL;
+		
+		for(i=0;i< n_selected;++i)
+			{
+			if(print_chrom) printPeak(config,config->chromosomes[config->markers[sb].tid].name,i+1,&chrom.heap[i]);
+			WindowHeapOffer(&genome,&chrom.heap[i]);
+			}
+		}
+	
+	qsort(genome.heap,genome.size,sizeof(IbdWindow),IbdWindowCompareByScore);
+	for(i=0;i< genome.size;++i)
+		{
+		printPeak(config,"genome",i+1,&genome.heap[i]);
+		}
+	
+	IbdDataSetClose(ibdds);
+	MarkerRangesFree(ranges,n_ranges);
+	free(genome.heap);
+	free(chrom.heap);
+	free(region);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+/** the state of a tile pyramid, saved in 'dir/TILES_STATE_FILENAME' for the incremental updates */
+#define TILES_STATE_FILENAME "tiles.bins"
+#define TILES_STATE_MAGIC "IBDDB-TILES"
+#define TILES_STATE_VERSION 1
+/* the bins of the deepest zoom: at most 2^24 columns of pixels (tile_size<<max_zoom) */
+#define TILES_MAX_COLUMNS (((size_t)1)<<24)
+/* the pyramid: at most 2^24 tiles (4^z tiles at zoom z) */
+#define TILES_MAX_TILES (((size_t)1)<<24)
+
+typedef struct tiles_state_t
+	{
+	int tile_size;
+	int min_zoom;
+	int max_zoom;
+	long genome_size;
+	size_t marker_count;
+	/** hash of the selected pairs and of the treshold: an update must select the same pairs */
+	QueryHash selection;
+	/** the top of the count axis */
+	double y_max;
+	/** COUNT_IBD of the markers by column of pixels at max_zoom */
+	ImageBinsPtr bins;
+	} TilesState,*TilesStatePtr;
+
+static void TilesStateSave(const TilesStatePtr state,const char* dir)
+	{
+	char* filename=(char*)safeMalloc(strlen(dir)+strlen(TILES_STATE_FILENAME)+2);
+	FILE* out;
+	sprintf(filename,"%s/%s",dir,TILES_STATE_FILENAME);
+	out=fopen(filename,"wb");
+	if(out==NULL) DIE_FAILURE("Cannot open %s : %s.",filename,strerror(errno));
+	fprintf(out,"%s\t%d\t%d\t%d\t%d\t%ld\t%zu\t%016"PRIx64"%016"PRIx64"\t%.17g\t%zu\n",
+		TILES_STATE_MAGIC,TILES_STATE_VERSION,
+		state->tile_size,state->min_zoom,state->max_zoom,
+		state->genome_size,state->marker_count,
+		state->selection.h1,state->selection.h2,
+		state->y_max,state->bins->width
+		);
+	if(ImageBinsWrite(state->bins,out)!=0 || fclose(out)!=0)
+		{
+		DIE_FAILURE("Cannot write %s.",filename);
+		}
+	free(filename);
+	}
+
+/** load the state saved by TilesStateSave, returns NULL if there is no state in 'dir' */
+static TilesStatePtr TilesStateLoad(const char* dir)
+	{
+	char magic[20];
+	int version;
+	size_t width,i;
+	TilesStatePtr state;
+	char* filename=(char*)safeMalloc(strlen(dir)+strlen(TILES_STATE_FILENAME)+2);
+	FILE* in;
+	sprintf(filename,"%s/%s",dir,TILES_STATE_FILENAME);
+	in=fopen(filename,"rb");
+	if(in==NULL)
+		{
+		free(filename);
+		return NULL;
+		}
+	state=(TilesStatePtr)safeCalloc(1,sizeof(TilesState));
+	if(fscanf(in,"%19s\t%d\t%d\t%d\t%d\t%ld\t%zu\t%16"SCNx64"%16"SCNx64"\t%lf\t%zu",
+		magic,&version,
+		&state->tile_size,&state->min_zoom,&state->max_zoom,
+		&state->genome_size,&state->marker_count,
+		&state->selection.h1,&state->selection.h2,
+		&state->y_max,&width)!=11 ||
+		strcmp(magic,TILES_STATE_MAGIC)!=0 ||
+		version!=TILES_STATE_VERSION ||
+		fgetc(in)!='\n' ||
+		width!=((size_t)state->tile_size<<state->max_zoom))
+		{
+		DIE_FAILURE("%s is not a valid state of tiles.",filename);
+		}
+	state->bins=ImageBinsNew(width,NULL,state->genome_size);
+	if(ImageBinsReadMerge(state->bins,in)!=0) DIE_FAILURE("Cannot read %s.",filename);
+	for(i=0;i< width;++i)
+		{
+		if(state->bins->count[i]>0 && state->bins->max[i]> state->bins->max_y) state->bins->max_y=state->bins->max[i];
+		}
+	fclose(in);
+	free(filename);
+	return state;
+	}
+
+/** the bins of 'src' merged into 'width' columns. src->width must be a multiple of 'width' */
+static ImageBinsPtr ImageBinsDownsample(const ImageBinsPtr src,size_t width)
+	{
+	size_t i,f=src->width/width;
+	ImageBinsPtr bins=ImageBinsNew(width,src->region,(long)src->genome_size);
+	for(i=0;i< src->width;++i)
+		{
+		size_t c=i/f;
+		if(src->count[i]==0) continue;
+		if(bins->count[c]==0 || src->min[i]< bins->min[c]) bins->min[c]=src->min[i];
+		if(bins->count[c]==0 || src->max[i]> bins->max[c]) bins->max[c]=src->max[i];
+		bins->count[c]+=src->count[i];
+		}
+	bins->max_y=src->max_y;
+	return bins;
+	}
+
+/**
+ * paint the tile (zoom,tx,ty) of the pyramid: the world is a square of tile_size<<zoom pixels,
+ * x is the genome (the columns of 'level'), y is the COUNT_IBD from y_max (top) to 0 (bottom)
+ */
+static void paintIbdTile(ContextPtr config,HersheyPtr hershey,cairo_t *cr,const ImageBinsPtr level,int tile_size,int zoom,int tx,int ty,double y_max)
+	{
+	size_t i,c,c_start,c_end;
+	int j,n_lines=10<<zoom;
+	double world=(double)((size_t)tile_size<<zoom);
+	double x0=(double)tx*tile_size;
+	double y0=(double)ty*tile_size;
+	
+	//draw background
+	cairo_set_source_rgb (cr, COLOR_WHITE);
+	cairo_rectangle(cr,0,0,tile_size,tile_size);
+	cairo_fill(cr);
+	
+#define BASE2PIXEL(chrom,POS) (((config->chromosomes[chrom].cumulative_start+(POS))/(double)level->genome_size)*world-x0)
+#define COUNT2PIXEL(V) (world-((V)/y_max)*world-y0)
+	for(i=0;i< config->chromosome_count;++i)
+		{
+		double chrom_x1=BASE2PIXEL(i,0);
+		double chrom_x2=BASE2PIXEL(i,config->chromosomes[i].length);
+		double label_len=strlen(config->chromosomes[i].name)*7;
+		if(chrom_x2< 0 || chrom_x1> tile_size) continue;
+		if(i%2==0)
+			{
+			cairo_set_source_rgb (cr, COLOR_GRAY(0.95));
+			}
+		else
+			{
+			cairo_set_source_rgb (cr,  COLOR_GRAY(0.90));
+			}
+		cairo_rectangle(cr,chrom_x1,0,chrom_x2-chrom_x1,tile_size);
+		cairo_fill(cr);
+		
+		/* the name of the chromosome, at the left of its visible part */
+		if(MIN(chrom_x2,tile_size)-MAX(chrom_x1,0)>=label_len+10)
+			{
+			cairo_set_source_rgb (cr, COLOR_BLACK);
+			HersheyPaint(hershey,cr,config->chromosomes[i].name,MAX(chrom_x1,0)+5,5,label_len,10);
+			cairo_stroke(cr);
+			}
+		}
+	
+	/* horizontal lines, ~10 per tile whatever the zoom */
+	cairo_set_line_width (cr, 0.5);
+	for(j=0;j<= n_lines;++j)
+		{
+		double cy=COUNT2PIXEL((j/(double)n_lines)*y_max);
+		char label[100];
+		if(cy< 0 || cy> tile_size) continue;
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.5));
+		cairo_move_to (cr, 0, cy);
+		cairo_line_to (cr, tile_size, cy);
+		cairo_stroke (cr);
+		sprintf(label,"%.2f",(j/(double)n_lines)*y_max);
+		cairo_set_source_rgb (cr, COLOR_GRAY(0.2));
+		HersheyPaint(hershey,cr,label,2,cy-12,strlen(label)*7,10);
+		cairo_stroke (cr);
+		}
+	
+	/* the position of the left side of the tiles at the bottom of the pyramid */
+	if(ty==(1<<zoom)-1)
+		{
+		double pos=(x0/world)*level->genome_size;
+		for(i=0;i+1< config->chromosome_count && config->chromosomes[i+1].cumulative_start<=pos;++i) {}
+		if(config->chromosome_count>0)
+			{
+			char* label=(char*)safeMalloc(strlen(config->chromosomes[i].name)+30);
+			sprintf(label,"%s:%ld",config->chromosomes[i].name,(long)(pos-config->chromosomes[i].cumulative_start)+1L);
+			cairo_set_source_rgb (cr, COLOR_GRAY(0.2));
+			cairo_move_to (cr, 0, tile_size-15);
+			cairo_line_to (cr, 0, tile_size);
+			cairo_stroke (cr);
+			HersheyPaint(hershey,cr,label,3,tile_size-14,MIN(strlen(label)*7,tile_size-6),10);
+			cairo_stroke (cr);
+			free(label);
+			}
+		}
+	
+	//draw data points, as paintIbdImage
+	c_start=(size_t)tx*tile_size;
+	c_end=MIN(level->width,c_start+tile_size);
+	cairo_set_line_width (cr, 0.2);
+	cairo_set_source_rgb (cr, COLOR_GRAY(0.3));
+	cairo_new_path (cr);
+	for(c=c_start;c< c_end;++c)
+		{
+		double cx,cy_min,cy_max;
+		if(level->count[c]==0) continue;
+		cy_min = COUNT2PIXEL(level->min[c]);
+		cy_max = COUNT2PIXEL(level->max[c]);
+		if(cy_min< -5 || cy_max> tile_size+5) continue;
+		cx = (double)(c-c_start) + 0.5;
+		cairo_move_to (cr, cx-3, cy_min);
+		cairo_line_to (cr, cx+3, cy_min);
+		if(cy_max!=cy_min)
+			{
+			cairo_move_to (cr, cx-3, cy_max);
+			cairo_line_to (cr, cx+3, cy_max);
+			}
+		cairo_move_to (cr, cx, cy_max-3);
+		cairo_line_to (cr, cx, cy_min+3);
+		}
+	cairo_stroke (cr);
+#undef COUNT2PIXEL
+#undef BASE2PIXEL
+	}
+
+/** a tile to be rendered by renderIbdTilesThread */
+typedef struct ibd_tile_t
+	{
+	int zoom;
+	int x;
+	int y;
+	} IbdTile,*IbdTilePtr;
+
+/** the tiles rendered by one thread */
+typedef struct ibd_tiles_render_t
+	{
+	ContextPtr config;
+	HersheyPtr hershey;
+	const char* dir;
+	/** levels[zoom] are the bins of the zoom */
+	ImageBinsPtr* levels;
+	int tile_size;
+	double y_max;
+	IbdTilePtr tiles;
+	size_t n_tiles;
+	/** this thread renders the tiles thread_index, thread_index+n_threads, ... */
+	size_t thread_index;
+	size_t n_threads;
+	} IbdTilesRender,*IbdTilesRenderPtr;
+
+static void* renderIbdTilesThread(void* arg)
+	{
+	IbdTilesRenderPtr render=(IbdTilesRenderPtr)arg;
+	char* filename=(char*)safeMalloc(strlen(render->dir)+100);
+	size_t t;
+	for(t=render->thread_index;t< render->n_tiles;t+=render->n_threads)
+		{
+		IbdTilePtr tile=&render->tiles[t];
+		cairo_surface_t *surface=createImageSurface(IMAGE_FORMAT_PNG,"tile",render->tile_size,render->tile_size);
+		cairo_t *cr = cairo_create(surface);
+		if(cr==NULL) DIE_FAILURE("Cannot create image context");
+		paintIbdTile(render->config,render->hershey,cr,render->levels[tile->zoom],render->tile_size,tile->zoom,tile->x,tile->y,render->y_max);
+		cairo_destroy(cr);
+		sprintf(filename,"%s/%d/%d/%d.png",render->dir,tile->zoom,tile->x,tile->y);
+		closeImageSurface(IMAGE_FORMAT_PNG,surface,filename);
+		}
+	free(filename);
+	return NULL;
+	}
+
+/** create the directory 'path' if it doesn't exist */
+static void makeDirectory(const char* path)
+	{
+	if(mkdir(path,0755)!=0 && errno!=EEXIST)
+		{
+		DIE_FAILURE("Cannot create directory %s : %s.",path,strerror(errno));
+		}
+	}
+
+/** write 'dir/tiles.json', the layout of the pyramid for the web page */
+static void writeTilesJson(ContextPtr config,const TilesStatePtr state,const char* dir)
+	{
+	size_t i;
+	char* filename=(char*)safeMalloc(strlen(dir)+20);
+	FILE* out;
+	sprintf(filename,"%s/tiles.json",dir);
+	out=fopen(filename,"w");
+	if(out==NULL) DIE_FAILURE("Cannot open %s : %s.",filename,strerror(errno));
+	fprintf(out,"{\n\"url\":\"{z}/{x}/{y}.png\",\n\"tile_size\":%d,\n\"min_zoom\":%d,\n\"max_zoom\":%d,\n\"genome_size\":%ld,\n\"y_max\":%f,\n\"chromosomes\":[",
+		state->tile_size,state->min_zoom,state->max_zoom,state->genome_size,state->y_max);
+	for(i=0;i< config->chromosome_count;++i)
+		{
+		if(i>0) fputc(',',out);
+		fputs("\n\t{\"name\":",out);
+		fputJsonString(config->chromosomes[i].name,out);
+		fprintf(out,",\"start\":%ld,\"length\":%d}",config->chromosomes[i].cumulative_start,config->chromosomes[i].length);
+		}
+	fputs("\n\t]\n}\n",out);
+	if(fclose(out)!=0) DIE_FAILURE("Cannot write %s.",filename);
+	free(filename);
+	}
+
+static void tiles_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Renders the COUNT_IBD of the whole genome (see 'ibd --image') as a pyramid of PNG tiles 'dir/z/x/y.png' for a web map (e.g. Leaflet with L.CRS.Simple).\n",stderr);
+	fputs("At zoom z, the genome (x) and the COUNT_IBD (y) are split into 2^z x 2^z tiles. 'dir/tiles.json' describes the pyramid and the chromosomes.\n",stderr);
+	fputs("The COUNT_IBD by column of pixels of the deepest zoom are saved in 'dir/"TILES_STATE_FILENAME"' to update the tiles of a region.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -o|--out (dir) output directory. Required.\n",stderr);
+	fputs(" -r|--region (chr|chr:start-end) with --update: re-scan the markers of that region and only render the tiles overlapping it.\n",stderr);
+	fputs(" --update update the existing pyramid of 'dir'. The tile size and the zooms of the pyramid are kept, the pairs and the treshold must be the same.\n",stderr);
+	fputs(" --tile-size (int) width and height of a tile. Default: 256.\n",stderr);
+	fputs(" --min-zoom (int) Default: 0.\n",stderr);
+	fputs(" --max-zoom (int) Default: 5. The deepest zoom is at most 2^24 pixels wide (tile-size * 2^max-zoom) and the pyramid has at most 2^24 tiles.\n",stderr);
+	fputs(" --threads (int) number of threads rendering the tiles, and of processes scanning the markers. Default: 1.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.\n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
+	fputs(" --relationship (list) restrict to the pairs having one of those comma-separated relationships computed from the pedigree: self, parent-offspring, full-sibs, first-degree, second-degree, third-degree, distant, related, unrelated.\n",stderr);
+	fputs(" --kinship-min (float) restrict to the pairs having a pedigree kinship coefficient >= this value (e.g. 0.125).\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs("\n\n",stderr);
+	}
+
+int main_tiles(int argc,char** argv)
+	{
+	int z,update=FALSE,n_threads=1;
+	int tile_size=256,min_zoom=0,max_zoom=5;
+	size_t i,t,n_tiles=0UL,col_first=0UL,col_last=0UL,n_render_threads;
+	long genome_size=0L;
+	long n_cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	double y_max;
+	ContextPtr config=ContextNew(argc,argv);
+	RegionPtr region=NULL;
+	char* rgn_str=NULL;
+	char* dir=NULL;
+	char* path;
+	MarkerRange range;
+	PairFilter filter;
+	IbdScan scan;
+	IbdDataSetPtr ibdds;
+	TilesStatePtr state=NULL;
+	QueryHash selection;
+	ImageBinsPtr* levels;
+	IbdTilePtr tiles;
+	IbdTilesRenderPtr renders;
+	pthread_t* threads;
+	HersheyPtr hershey;
+	
+	PairFilterInit(&filter);
+	memset((void*)&scan,0,sizeof(IbdScan));
+	memset((void*)&range,0,sizeof(MarkerRange));
+	scan.treshold=DEFAULT_TRESHOLD_LIMIT;
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_load_reskins = 0;
+	
+	if(argc==1)
+		{
+		tiles_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"out",    required_argument, 0, 'o'},
+			{"region",    required_argument, 0, 'r'},
+			{"update",  no_argument, &update, 1},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"treshold",  required_argument, 0,1026},
+			{"reskin",  required_argument, 0,1027},
+			{"relationship",  required_argument, 0,1041},
+			{"kinship-min",  required_argument, 0,1042},
+			{"threads",  required_argument, 0,1031},
+			{"tile-size",  required_argument, 0,1046},
+			{"min-zoom",  required_argument, 0,1047},
+			{"max-zoom",  required_argument, 0,1048},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "o:r:i:p:F:I:P:Y:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'o': dir = optarg ;break;
+			case 'r': rgn_str = optarg ;break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 1026: scan.treshold = atof(optarg);break;
+			case 1027:
+				if(PairFilterParseReskin(&filter,optarg)!=0) return EXIT_FAILURE;
+				config->on_read_load_reskins = 1;
+				break;
+			case 1041: if(PairFilterParseRelationship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1042: if(PairFilterParseKinship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1031: n_threads = atoi(optarg);
+				if(n_threads<1)
+					{
+					fprintf(stderr,"bad number of threads %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1046: tile_size = atoi(optarg);
+				if(tile_size<16 || tile_size>4096)
+					{
+					fprintf(stderr,"bad tile size %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 1047: min_zoom = atoi(optarg); break;
+			case 1048: max_zoom = atoi(optarg); break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(dir==NULL)
+		{
+		fprintf(stderr,"option --out is required.\n");
+		return EXIT_FAILURE;
+		}
+	if(min_zoom<0 || max_zoom< min_zoom || max_zoom>20)
+		{
+		fprintf(stderr,"bad zooms %d-%d.\n",min_zoom,max_zoom);
+		return EXIT_FAILURE;
+		}
+	if(((size_t)tile_size<<max_zoom) > TILES_MAX_COLUMNS)
+		{
+		fprintf(stderr,"--max-zoom %d is too deep: %zu columns of pixels for --tile-size %d (max %zu).\n",
+			max_zoom,(size_t)tile_size<<max_zoom,tile_size,TILES_MAX_COLUMNS);
+		return EXIT_FAILURE;
+		}
+	for(n_tiles=0UL,z=min_zoom;z<=max_zoom;++z) n_tiles+=((size_t)1)<<(2*z);
+	if(n_tiles > TILES_MAX_TILES)
+		{
+		fprintf(stderr,"--max-zoom %d is too deep: %zu tiles for the zooms %d-%d (max %zu).\n",
+			max_zoom,n_tiles,min_zoom,max_zoom,TILES_MAX_TILES);
+		return EXIT_FAILURE;
+		}
+	n_tiles=0UL;
+	if(rgn_str!=NULL && !update)
+		{
+		fprintf(stderr,"option --region requires --update.\n");
+		return EXIT_FAILURE;
+		}
+	
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	for(i=0;i< config->chromosome_count;++i)
+		{
+		config->chromosomes[i].cumulative_start = genome_size;
+		genome_size += config->chromosomes[i].length;
+		}
+	selectPairs(config,&filter);
+	
+	/* the pyramid depends on the selected pairs and the treshold */
+	selection.h1=14695981039346656037ULL;
+	selection.h2=14695981039346656037ULL ^ 0x5bd1e995ULL;
+	QueryHashDouble(&selection,scan.treshold);
+	for(i=0;i< config->pair_count;++i)
+		{
+		if(config->pairs[i].selected) QueryHashLong(&selection,(long long)i);
+		}
+	
+	if(update)
+		{
+		state=TilesStateLoad(dir);
+		if(state==NULL) DIE_FAILURE("There are no tiles to update in %s.",dir);
+		if(state->genome_size!=genome_size || state->marker_count!=config->marker_count)
+			{
+			DIE_FAILURE("The chromosomes or the markers of %s are not the ones of the tiles. Rebuild the tiles.",config->hdf5_filename);
+			}
+		if(state->selection.h1!=selection.h1 || state->selection.h2!=selection.h2)
+			{
+			DIE_FAILURE("The selected pairs or the treshold are not the ones of the tiles.");
+			}
+		tile_size=state->tile_size;
+		min_zoom=state->min_zoom;
+		max_zoom=state->max_zoom;
+		}
+	else
+		{
+		makeDirectory(dir);
+		state=(TilesStatePtr)safeCalloc(1,sizeof(TilesState));
+		state->tile_size=tile_size;
+		state->min_zoom=min_zoom;
+		state->max_zoom=max_zoom;
+		state->genome_size=genome_size;
+		state->marker_count=config->marker_count;
+		state->selection=selection;
+		state->bins=ImageBinsNew((size_t)tile_size<<max_zoom,NULL,genome_size);
+		}
+	
+	/* the markers to scan and the columns to render */
+	if(rgn_str!=NULL)
+		{
+		region=(RegionPtr)safeCalloc(1,sizeof(Region));
+		parseRegion(config,region,rgn_str);
+		}
+	findMarkerRange(config,region,&range.begin,&range.end);
+	if(range.begin< range.end)
+		{
+		/* a column may hold markers out of the region: scan all the markers of the columns */
+		col_first=ImageBinsColumn(config,state->bins,&config->markers[range.begin]);
+		col_last=ImageBinsColumn(config,state->bins,&config->markers[range.end-1]);
+		while(range.begin>0 && ImageBinsColumn(config,state->bins,&config->markers[range.begin-1])==col_first) range.begin--;
+		while(range.end< config->marker_count && ImageBinsColumn(config,state->bins,&config->markers[range.end])==col_last) range.end++;
+		for(i=col_first;i<=col_last;++i)
+			{
+			state->bins->min[i]=0.0;
+			state->bins->max[i]=0.0;
+			state->bins->count[i]=0UL;
+			}
+		}
+	if(region==NULL)
+		{
+		/* the whole genome is rendered, even the columns without marker */
+		col_first=0UL;
+		col_last=state->bins->width-1;
+		}
+	DEBUG("scanning the markers [%zu,%zu[ for the columns [%zu,%zu].",range.begin,range.end,col_first,col_last);
+	
+	config->query_range_markers=range.end-range.begin;
+	ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	scan.image=TRUE;
+	scan.image_per=IMAGE_PER_NONE;
+	scan.n_panels=1;
+	scan.panels=&state->bins;
+	if(n_threads>1)
+		{
+		scanMarkerRangesParallel(config,ibdds,&scan,&range,1,n_threads);
+		}
+	else
+		{
+		scanMarkerRanges(config,ibdds,&scan,&range,1,0,range.end-range.begin);
+		}
+	IbdDataSetClose(ibdds);
+	
+	/* the top of the count axis, rounded as in paintIbdImage. Kept by the updates unless a count is larger */
+	y_max=MAX(1.0,state->bins->max_y);
+	if(state->y_max< y_max || !update)
+		{
+		double step=pow(10,floor(log10(y_max)));
+		double y2=0.0;
+		while(y2< y_max) y2+=step;
+		if(update)
+			{
+			fprintf(stderr,"[WARNING] the scale of the COUNT_IBD changed, all the tiles are rendered.\n");
+			col_first=0UL;
+			col_last=state->bins->width-1;
+			}
+		state->y_max=y2;
+		}
+	
+	/* the bins of each zoom, and the tiles to render */
+	levels=(ImageBinsPtr*)safeCalloc(max_zoom+1,sizeof(ImageBinsPtr));
+	path=(char*)safeMalloc(strlen(dir)+100);
+	for(z=min_zoom;z<=max_zoom;++z)
+		{
+		size_t shift=(size_t)(max_zoom-z);
+		size_t x,x_first=(col_first>>shift)/tile_size;
+		size_t x_last=(col_last>>shift)/tile_size;
+		levels[z]=(z==max_zoom?state->bins:ImageBinsDownsample(state->bins,(size_t)tile_size<<z));
+		n_tiles+=(x_last-x_first+1)*((size_t)1<<z);
+		sprintf(path,"%s/%d",dir,z);
+		makeDirectory(path);
+		for(x=x_first;x<=x_last;++x)
+			{
+			sprintf(path,"%s/%d/%zu",dir,z,x);
+			makeDirectory(path);
+			}
+		}
+	tiles=(IbdTilePtr)safeCalloc(MAX(1,n_tiles),sizeof(IbdTile));
+	for(t=0,z=min_zoom;z<=max_zoom;++z)
+		{
+		size_t shift=(size_t)(max_zoom-z);
+		size_t x,y;
+		for(x=(col_first>>shift)/tile_size;x<=(col_last>>shift)/tile_size;++x)
+			{
+			for(y=0;y< ((size_t)1<<z);++y)
+				{
+				tiles[t].zoom=z;
+				tiles[t].x=(int)x;
+				tiles[t].y=(int)y;
+				t++;
+				}
+			}
+		}
+	
+	/* render the tiles with MIN(threads,CPUs) threads */
+	hershey=HersheyNew();
+	if(hershey==NULL) DIE_FAILURE("Cannot create hershey");
+	n_render_threads=MAX(1UL,MIN(MIN((size_t)n_threads,n_tiles),(size_t)MAX(1L,n_cpus)));
+	threads=(pthread_t*)safeCalloc(n_render_threads,sizeof(pthread_t));
+	renders=(IbdTilesRenderPtr)safeCalloc(n_render_threads,sizeof(IbdTilesRender));
+	DEBUG("rendering %zu tile(s) with %zu thread(s).",n_tiles,n_render_threads);
+	for(t=0;t< n_render_threads;++t)
+		{
+		renders[t].config=config;
+		renders[t].hershey=hershey;
+		renders[t].dir=dir;
+		renders[t].levels=levels;
+		renders[t].tile_size=tile_size;
+		renders[t].y_max=state->y_max;
+		renders[t].tiles=tiles;
+		renders[t].n_tiles=n_tiles;
+		renders[t].thread_index=t;
+		renders[t].n_threads=n_render_threads;
+		}
+	if(n_render_threads==1)
+		{
+		renderIbdTilesThread(&renders[0]);
+		}
+	else
+		{
+		for(t=0;t< n_render_threads;++t)
+			{
+			if(pthread_create(&threads[t],NULL,renderIbdTilesThread,&renders[t])!=0)
+				{
+				DIE_FAILURE("Cannot create thread.");
+				}
+			}
+		for(t=0;t< n_render_threads;++t) pthread_join(threads[t],NULL);
+		}
+	
+	TilesStateSave(state,dir);
+	writeTilesJson(config,state,dir);
+	
+	for(z=min_zoom;z< max_zoom;++z) ImageBinsFree(levels[z]);
+	free(levels);
+	free(tiles);
+	free(renders);
+	free(threads);
+	free(path);
+	HersheyFree(hershey);
+	ImageBinsFree(state->bins);
+	free(state);
+	free(region);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+static void subset_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Writes a new database containing only the selected markers and pairs (and their individuals, chromosomes and reskin data).\n",stderr);
+	fputs("Indexes are renumbered. '/ibd' is copied by blocks of markers.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -o|--out (file.h5) output database. Required.\n",stderr);
+	fputs(" -r|--region (chr|chr:start-end) restrict to that region. Optional.\n",stderr);
+	fputs(" -R|--regions (file.bed) restrict to the intervals of that BED file. Optional.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.\n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fputs(" --reskin 'min/max' if defined and reskin data available, will restrict to pair having reskin ibd0 in this range .\n",stderr);
+	fputs(" --relationship (list) restrict to the pairs having one of those comma-separated relationships computed from the pedigree: self, parent-offspring, full-sibs, first-degree, second-degree, third-degree, distant, related, unrelated.\n",stderr);
+	fputs(" --kinship-min (float) restrict to the pairs having a pedigree kinship coefficient >= this value (e.g. 0.125).\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_subset(int argc,char** argv)
+	{
+	size_t i,j,k,r,n;
+	ContextPtr config=ContextNew(argc,argv);
+	ContextPtr sub=NULL;
+	RegionPtr region=NULL;
+	char* rgn_str=NULL;
+	char* regions_filename=NULL;
+	char* out_filename=NULL;
+	MarkerRangePtr ranges=NULL;
+	size_t n_ranges=0UL;
+	PairFilter filter;
+	IbdDataSetPtr ibdds;
+	int* indi_remap=NULL;
+	int* chrom_remap=NULL;
+	int* pair_remap=NULL;
+	size_t* columns=NULL;
+	size_t n_selected,pair_start,pair_end,row_size,block_markers,marker_offset=0UL;
+	float* block=NULL;
+	float* out_block=NULL;
+	hid_t out_dataset_id,out_dataspace_id;
+	
+	PairFilterInit(&filter);
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_load_reskins = 1;
+	
+	if(argc==1)
+		{
+		subset_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"out",    required_argument, 0, 'o'},
+			{"region",    required_argument, 0, 'r'},
+			{"regions",    required_argument, 0, 'R'},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"reskin",  required_argument, 0,1027},
+			{"relationship",  required_argument, 0,1041},
+			{"kinship-min",  required_argument, 0,1042},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "o:r:R:i:p:F:I:P:Y:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'o': out_filename = optarg ;break;
+			case 'r': rgn_str = optarg ;break;
+			case 'R': regions_filename = optarg ;break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 1027:
+				if(PairFilterParseReskin(&filter,optarg)!=0) return EXIT_FAILURE;
+				break;
+			case 1041: if(PairFilterParseRelationship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 1042: if(PairFilterParseKinship(&filter,optarg)!=0) return EXIT_FAILURE; break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(rgn_str!=NULL && regions_filename!=NULL)
+		{
+		fprintf(stderr,"options --region and --regions are mutually exclusive.\n");
+		return EXIT_FAILURE;
+		}
+	if(out_filename==NULL || !strEndsWith(out_filename,".h5"))
+		{
+		fprintf(stderr,"option --out (file.h5) is required.\n");
+		return EXIT_FAILURE;
+		}
+	if(strcmp(out_filename,argv[optind])==0)
+		{
+		fprintf(stderr,"input and output are the same file.\n");
+		return EXIT_FAILURE;
+		}
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	if(rgn_str!=NULL)
+		{
+		region=(RegionPtr)safeCalloc(1,sizeof(Region));
+		parseRegion(config,region,rgn_str);
+		}
+	selectPairs(config,&filter);
+	ranges = buildMarkerRanges(config,region,regions_filename,&n_ranges);
+	
+	/* the new context only points to the strings of 'config' */
+	sub=ContextNew(argc,argv);
+	sub->hdf5_filename=out_filename;
+	
+	/* pairs and individuals: the order is kept, so the pairs remain sorted */
+	indi_remap=(int*)safeMalloc(MAX(1,config->individual_count)*sizeof(int));
+	pair_remap=(int*)safeMalloc(MAX(1,config->pair_count)*sizeof(int));
+	for(i=0;i< config->individual_count;++i) indi_remap[i]=-1;
+	for(i=0;i< config->pair_count;++i)
+		{
+		PairIndiPtr pair = &config->pairs[i];
+		pair_remap[i]=-1;
+		if(!pair->selected) continue;
+		indi_remap[pair->indi1idx]=0;
+		indi_remap[pair->indi2idx]=0;
+		}
+	sub->individuals=(IndividualPtr)safeCalloc(MAX(1,config->individual_count),sizeof(Individual));
+	for(i=0;i< config->individual_count;++i)
+		{
+		if(indi_remap[i]<0) continue;
+		indi_remap[i]=(int)sub->individual_count;
+		sub->individuals[sub->individual_count]=config->individuals[i];
+		sub->individuals[sub->individual_count].index=(int)sub->individual_count;
+		sub->individual_count++;
+		}
+	/* the kinship is computed with the whole pedigree, the parents might not be in the subset */
+	ensurePairKinship(config);
+	sub->pairs=(PairIndiPtr)safeCalloc(MAX(1,config->pair_count),sizeof(PairIndi));
+	for(i=0;i< config->pair_count;++i)
+		{
+		PairIndiPtr pair = &config->pairs[i];
+		if(!pair->selected) continue;
+		pair_remap[i]=(int)sub->pair_count;
+		sub->pairs[sub->pair_count].indi1idx=indi_remap[pair->indi1idx];
+		sub->pairs[sub->pair_count].indi2idx=indi_remap[pair->indi2idx];
+		sub->pairs[sub->pair_count].index=(int)sub->pair_count;
+		sub->pairs[sub->pair_count].kinship=pair->kinship;
+		sub->pairs[sub->pair_count].relationship=pair->relationship;
+		sub->pair_count++;
+		}
+	sub->reskins=(ReskinPtr)safeCalloc(MAX(1,config->reskin_count),sizeof(Reskin));
+	for(i=0;i< config->reskin_count;++i)
+		{
+		int pair_id=config->reskins[i].pair_id;
+		if(pair_id<0 || (size_t)pair_id>=config->pair_count || pair_remap[pair_id]<0) continue;
+		sub->reskins[sub->reskin_count]=config->reskins[i];
+		sub->reskins[sub->reskin_count].pair_id=pair_remap[pair_id];
+		sub->reskin_count++;
+		}
+	
+	/* markers and chromosomes having a marker */
+	chrom_remap=(int*)safeMalloc(MAX(1,config->chromosome_count)*sizeof(int));
+	for(i=0;i< config->chromosome_count;++i) chrom_remap[i]=-1;
+	for(r=0;r< n_ranges;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;++i) chrom_remap[config->markers[i].tid]=0;
+		}
+	sub->chromosomes=(ChromPtr)safeCalloc(MAX(1,config->chromosome_count),sizeof(Chrom));
+	for(i=0;i< config->chromosome_count;++i)
+		{
+		if(chrom_remap[i]<0) continue;
+		chrom_remap[i]=(int)sub->chromosome_count;
+		sub->chromosomes[sub->chromosome_count]=config->chromosomes[i];
+		sub->chromosomes[sub->chromosome_count].tid=(int)sub->chromosome_count;
+		sub->chromosome_count++;
+		}
+	sub->marker_count=countMarkersInRanges(ranges,n_ranges);
+	sub->markers=(MarkerPtr)safeCalloc(MAX(1,sub->marker_count),sizeof(Marker));
+	for(r=0,k=0;r< n_ranges;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;++i,++k)
+			{
+			sub->markers[k]=config->markers[i];
+			sub->markers[k].tid=chrom_remap[config->markers[i].tid];
+			sub->markers[k].index=(int)k;
+			}
+		}
+	DEBUG("subset: %d markers, %d individuals, %d pairs.",(int)sub->marker_count,(int)sub->individual_count,(int)sub->pair_count);
+	
+	sub->file_id = H5Fcreate(sub->hdf5_filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if( sub->file_id < 0)
+		{
+		DIE_FAILURE("Cannot create %s.\n", sub->hdf5_filename);
+		}
+	writePedigree(sub);
+	writeDictionary(sub);
+	writeMarkers(sub);
+	writePairs(sub);
+	writeReskins(sub);
+	writeSnapshot(sub);
+	
+	/* copy '/ibd' by blocks of markers over the columns of the selected pairs */
+	ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	out_dataset_id=createIbdDataset(sub);
+	out_dataspace_id=VERIFY(H5Dget_space(out_dataset_id));
+	columns=(size_t*)safeCalloc(MAX(1,config->pair_count),sizeof(size_t));
+	n_selected=selectedPairColumns(config,columns,&pair_start,&pair_end);
+	row_size=(pair_end-pair_start)*3;
+	block_markers=MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,row_size)*sizeof(float)));
+	if(n_selected>0)
+		{
+		block=(float*)safeMalloc(MIN(block_markers,MAX(1,config->marker_count))*row_size*sizeof(float));
+		out_block=(float*)safeMalloc(MIN(block_markers,MAX(1,config->marker_count))*n_selected*3*sizeof(float));
+		}
+	for(r=0;r< n_ranges && n_selected>0;++r)
+		{
+		for(i=ranges[r].begin;i< ranges[r].end;i+=n)
+			{
+			hsize_t write_start[3] = {marker_offset,0,0};
+			hsize_t write_count[3] = {0,n_selected,3};
+			hid_t memspace;
+			n=MIN(block_markers,ranges[r].end-i);
+			IbdDataSetReadBlock(config,ibdds,i,n,pair_start,pair_end-pair_start,block);
+			for(j=0;j< n;++j)
+				{
+				for(k=0;k< n_selected;++k)
+					{
+					memcpy((void*)&out_block[(j*n_selected+k)*3],(void*)&block[j*row_size+columns[k]],3*sizeof(float));
+					}
+				}
+			write_count[0]=n;
+			memspace = VERIFY(H5Screate_simple(3, write_count, NULL));
+			VERIFY(H5Sselect_hyperslab(
+				out_dataspace_id,
+				H5S_SELECT_SET,
+				write_start, NULL,
+				write_count, NULL
+				));
+			VERIFY(H5Dwrite(
+				out_dataset_id,
+				H5T_NATIVE_FLOAT,
+				memspace,
+				out_dataspace_id,
+				H5P_DEFAULT,
+				out_block
+				));
+			VERIFY(H5Sclose(memspace));
+			marker_offset+=n;
+			}
+		}
+	VERIFY(H5Sclose(out_dataspace_id));
+	VERIFY(H5Dclose(out_dataset_id));
+	IbdDataSetClose(ibdds);
+	VERIFY(H5Fclose(sub->file_id));
+	
+	free(block);
+	free(out_block);
+	free(columns);
+	free(indi_remap);
+	free(pair_remap);
+	free(chrom_remap);
+	free(sub->individuals);
+	free(sub->pairs);
+	free(sub->reskins);
+	free(sub->chromosomes);
+	free(sub->markers);
+	free(sub);
+	MarkerRangesFree(ranges,n_ranges);
+	free(region);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+/**
+ * 'merge'
+ */
+#define MERGE_POLICY_FIRST 0
+#define MERGE_POLICY_LAST 1
+#define MERGE_POLICY_MEAN 2
+#define MERGE_POLICY_ERROR 3
+
+/** a source database of 'merge' and the tables mapping its indexes to the merged database */
+typedef struct merge_source_t
+	{
+	ContextPtr config;
+	IbdDataSetPtr ibdds;
+	int* tid_remap;
+	int* marker_remap;
+	int* indi_remap;
+	int* pair_remap;
+	/** merged marker index to the marker index in this source or -1 */
+	int* marker_inverse;
+	} MergeSource,*MergeSourcePtr;
+
+/** strcmp where NULL is an empty string (unknown parents) */
+static int nullSafeStrCmp(const char* a,const char* b)
+	{
+	return strcmp(a==NULL?"":a,b==NULL?"":b);
+	}
+
+/** apply the merge policy to one cell of 3 IBD status. 'count' is the number of sources already merged in this cell */
+static size_t mergeIbdCell(float* dest,const float* src,int* count,int policy)
+	{
+	int i;
+	if(!(src[0] > IBD_UNDEFINED)) return 0;
+	if(*count==0 || !(dest[0] > IBD_UNDEFINED))
+		{
+		memcpy((void*)dest,(const void*)src,3*sizeof(float));
+		*count=1;
+		return 0;
+		}
+	switch(policy)
+		{
+		case MERGE_POLICY_FIRST: break;
+		case MERGE_POLICY_LAST: memcpy((void*)dest,(const void*)src,3*sizeof(float)); break;
+		case MERGE_POLICY_MEAN:
+			for(i=0;i< 3;++i) dest[i]=(dest[i]*(*count)+src[i])/(*count+1);
+			break;
+		default:
+			if(memcmp((const void*)dest,(const void*)src,3*sizeof(float))!=0)
+				{
+				DIE_FAILURE("conflicting IBD values (%f/%f/%f) and (%f/%f/%f).\n",
+					dest[0],dest[1],dest[2],
+					src[0],src[1],src[2]);
+				}
+			break;
+		}
+	(*count)++;
+	return 1;
+	}
+
+static void merge_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file1.h5 file2.h5 ...\n\n",argv[0]);
+	fputs("Merges databases built independently. The chromosomes, markers, individuals and pairs are the union of the sources.\n",stderr);
+	fputs("'/ibd' is copied by blocks of markers.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -o|--out (file.h5) output database. Required.\n",stderr);
+	fputs(" --policy (first|last|mean|error) how to merge a cell defined in more than one source. Default: first.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_merge(int argc,char** argv)
+	{
+	size_t i,j,n,src_index;
+	int policy=MERGE_POLICY_FIRST;
+	char* has_reskin=NULL;
+	char* out_filename=NULL;
+	ContextPtr merged=NULL;
+	MergeSourcePtr sources=NULL;
+	size_t n_sources=0UL;
+	MarkerPtr markersbyname=NULL;
+	size_t n_byname=0UL;
+	size_t block_markers,row_size,max_src_row_size=0UL,n_conflicts=0UL;
+	float* out_block=NULL;
+	float* src_block=NULL;
+	int* counts=NULL;
+	hid_t out_dataset_id,out_dataspace_id;
+	
+	if(argc==1)
+		{
+		merge_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"out",    required_argument, 0, 'o'},
+			{"policy",    required_argument, 0, 1029},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "o:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'o': out_filename = optarg ;break;
+			case 1029:
+				if(strcmp(optarg,"first")==0) policy=MERGE_POLICY_FIRST;
+				else if(strcmp(optarg,"last")==0) policy=MERGE_POLICY_LAST;
+				else if(strcmp(optarg,"mean")==0) policy=MERGE_POLICY_MEAN;
+				else if(strcmp(optarg,"error")==0) policy=MERGE_POLICY_ERROR;
+				else
+					{
+					fprintf(stderr,"bad --policy \"%s\".\n",optarg);
+					return EXIT_FAILURE;
+					}
+				break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind>=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(out_filename==NULL || !strEndsWith(out_filename,".h5"))
+		{
+		fprintf(stderr,"option --out (file.h5) is required.\n");
+		return EXIT_FAILURE;
+		}
+	for(i=optind;i< (size_t)argc;++i)
+		{
+		if(strcmp(out_filename,argv[i])==0)
+			{
+			fprintf(stderr,"input and output are the same file.\n");
+			return EXIT_FAILURE;
+			}
+		}
+	
+	n_sources=(size_t)(argc-optind);
+	sources=(MergeSourcePtr)safeCalloc(n_sources,sizeof(MergeSource));
+	merged=ContextNew(argc,argv);
+	merged->hdf5_filename=out_filename;
+	
+	/* the merged context only points to the strings of the sources */
+	for(src_index=0;src_index< n_sources;++src_index)
+		{
+		MergeSourcePtr src=&sources[src_index];
+		ContextPtr config=ContextNew(argc,argv);
+		config->hdf5_filename = argv[optind+src_index];
+		config->on_read_load_pedigree = 1;
+		config->on_read_load_pairs = 1;
+		config->on_read_load_dict = 1;
+		config->on_read_load_markers = 1;
+		config->on_read_load_reskins = 1;
+		ContextOpenForRead(config);
+		src->config=config;
+		
+		/* union of the dictionaries: a new chromosome is inserted after the previous chromosome of this source */
+		for(i=0,n=0;i< config->chromosome_count;++i)
+			{
+			ChromPtr chrom=findChromosomeByName(merged,config->chromosomes[i].name);
+			if(chrom==NULL)
+				{
+				merged->chromosomes=(ChromPtr)safeRealloc(merged->chromosomes,(merged->chromosome_count+1)*sizeof(Chrom));
+				memmove((void*)&merged->chromosomes[n+1],(void*)&merged->chromosomes[n],(merged->chromosome_count-n)*sizeof(Chrom));
+				chrom=&merged->chromosomes[n];
+				*chrom=config->chromosomes[i];
+				merged->chromosome_count++;
+				}
+			else if(chrom->length!=config->chromosomes[i].length)
+				{
+				DIE_FAILURE("chromosome \"%s\" has a different length in %s.\n",chrom->name,config->hdf5_filename);
+				}
+			n=(size_t)(chrom-merged->chromosomes)+1;
+			}
+		}
+	for(i=0;i< merged->chromosome_count;++i) merged->chromosomes[i].tid=(int)i;
+	
+	for(src_index=0;src_index< n_sources;++src_index)
+		{
+		MergeSourcePtr src=&sources[src_index];
+		ContextPtr config=src->config;
+		src->tid_remap=(int*)safeMalloc(MAX(1,config->chromosome_count)*sizeof(int));
+		for(i=0;i< config->chromosome_count;++i)
+			{
+			src->tid_remap[i]=findChromosomeByName(merged,config->chromosomes[i].name)->tid;
+			}
+		
+		/* union of the individuals */
+		merged->individuals=(IndividualPtr)safeRealloc(merged->individuals,(merged->individual_count+config->individual_count+1)*sizeof(Individual));
+		n=merged->individual_count;
+		for(i=0;i< config->individual_count;++i)
+			{
+			IndividualPtr indi=&config->individuals[i];
+			IndividualPtr found=(IndividualPtr)bsearch(
+				(const void*)indi,
+				merged->individuals,
+				n,
+				sizeof(Individual),
+				IndividualCompareByFamName
+				);
+			if(found==NULL)
+				{
+				merged->individuals[merged->individual_count++]=*indi;
+				}
+			else if(nullSafeStrCmp(found->father,indi->father)!=0 ||
+				nullSafeStrCmp(found->mother,indi->mother)!=0 ||
+				found->sex!=indi->sex ||
+				found->status!=indi->status)
+				{
+				DIE_FAILURE("individual \"%s:%s\" is defined differently in %s.\n",indi->family,indi->name,config->hdf5_filename);
+				}
+			}
+		qsort(
+			(void*)merged->individuals,
+			merged->individual_count,
+			sizeof (Individual),
+			IndividualCompareByFamName
+			);
+		
+		/* union of the markers, on (chromosome,name) */
+		markersbyname=(MarkerPtr)safeRealloc(markersbyname,(n_byname+config->marker_count+1)*sizeof(Marker));
+		n=n_byname;
+		for(i=0;i< config->marker_count;++i)
+			{
+			Marker key=config->markers[i];
+			MarkerPtr found;
+			key.tid=src->tid_remap[key.tid];
+			found=(MarkerPtr)bsearch(
+				(const void*)&key,
+				markersbyname,
+				n,
+				sizeof(Marker),
+				MarkerCompareByChromName
+				);
+			if(found==NULL)
+				{
+				markersbyname[n_byname++]=key;
+				}
+			else if(found->position!=key.position)
+				{
+				DIE_FAILURE("marker \"%s\" has a different position in %s.\n",key.name,config->hdf5_filename);
+				}
+			}
+		qsort(
+			(void*)markersbyname,
+			n_byname,
+			sizeof (Marker),
+			MarkerCompareByChromName
+			);
+		}
+	for(i=0;i< merged->individual_count;++i) merged->individuals[i].index=(int)i;
+	
+	merged->marker_count=n_byname;
+	merged->markers=(MarkerPtr)safeMalloc(MAX(1,n_byname)*sizeof(Marker));
+	memcpy((void*)merged->markers,(void*)markersbyname,n_byname*sizeof(Marker));
+	qsort(
+		(void*)merged->markers,
+		merged->marker_count,
+		sizeof (Marker),
+		MarkerCompareByLoc
+		);
+	for(i=0;i< merged->marker_count;++i) merged->markers[i].index=(int)i;
+	/* update the index of the markers sorted on name */
+	for(i=0;i< merged->marker_count;++i)
+		{
+		MarkerPtr found=(MarkerPtr)bsearch(
+			(const void*)&merged->markers[i],
+			markersbyname,
+			n_byname,
+			sizeof(Marker),
+			MarkerCompareByChromName
+			);
+		found->index=(int)i;
+		}
+	
+	/* remap the markers and the pairs of each source */
+	for(src_index=0;src_index< n_sources;++src_index)
+		{
+		MergeSourcePtr src=&sources[src_index];
+		ContextPtr config=src->config;
+		src->marker_remap=(int*)safeMalloc(MAX(1,config->marker_count)*sizeof(int));
+		src->marker_inverse=(int*)safeMalloc(MAX(1,merged->marker_count)*sizeof(int));
+		for(i=0;i< merged->marker_count;++i) src->marker_inverse[i]=-1;
+		for(i=0;i< config->marker_count;++i)
+			{
+			Marker key=config->markers[i];
+			key.tid=src->tid_remap[key.tid];
+			src->marker_remap[i]=((MarkerPtr)bsearch(
+				(const void*)&key,
+				markersbyname,
+				n_byname,
+				sizeof(Marker),
+				MarkerCompareByChromName
+				))->index;
+			src->marker_inverse[src->marker_remap[i]]=(int)i;
+			}
+		src->indi_remap=(int*)safeMalloc(MAX(1,config->individual_count)*sizeof(int));
+		for(i=0;i< config->individual_count;++i)
+			{
+			src->indi_remap[i]=findIndividualByFamName(merged,config->individuals[i].family,config->individuals[i].name)->index;
+			}
+		merged->pairs=(PairIndiPtr)safeRealloc(merged->pairs,(merged->pair_count+config->pair_count+1)*sizeof(PairIndi));
+		n=merged->pair_count;
+		for(i=0;i< config->pair_count;++i)
+			{
+			PairIndi key;
+			int i1=src->indi_remap[config->pairs[i].indi1idx];
+			int i2=src->indi_remap[config->pairs[i].indi2idx];
+			key.indi1idx=MIN(i1,i2);
+			key.indi2idx=MAX(i1,i2);
+			key.selected=0;
+			if(bsearch((const void*)&key,merged->pairs,n,sizeof(PairIndi),PairIndiCompare)==NULL)
+				{
+				merged->pairs[merged->pair_count++]=key;
+				}
+			}
+		qsort(
+			(void*)merged->pairs,
+			merged->pair_count,
+			sizeof (PairIndi),
+			PairIndiCompare
+			);
+		max_src_row_size=MAX(max_src_row_size,config->pair_count*3);
+		}
+	for(i=0;i< merged->pair_count;++i) merged->pairs[i].index=(int)i;
+	/* the pedigrees of the sources were merged */
+	computePairKinship(merged);
+	has_reskin=(char*)safeCalloc(MAX(1,merged->pair_count),sizeof(char));
+	
+	for(src_index=0;src_index< n_sources;++src_index)
+		{
+		MergeSourcePtr src=&sources[src_index];
+		ContextPtr config=src->config;
+		src->pair_remap=(int*)safeMalloc(MAX(1,config->pair_count)*sizeof(int));
+		for(i=0;i< config->pair_count;++i)
+			{
+			PairIndi key;
+			int i1=src->indi_remap[config->pairs[i].indi1idx];
+			int i2=src->indi_remap[config->pairs[i].indi2idx];
+			key.indi1idx=MIN(i1,i2);
+			key.indi2idx=MAX(i1,i2);
+			src->pair_remap[i]=((PairIndiPtr)bsearch(
+				(const void*)&key,
+				merged->pairs,
+				merged->pair_count,
+				sizeof(PairIndi),
+				PairIndiCompare
+				))->index;
+			}
+		/* reskin: the first source defining a pair wins */
+		for(i=0;i< config->reskin_count;++i)
+			{
+			int pair_id=config->reskins[i].pair_id;
+			if(pair_id<0 || (size_t)pair_id>=config->pair_count) continue;
+			if(has_reskin[src->pair_remap[pair_id]]) continue;
+			has_reskin[src->pair_remap[pair_id]]=1;
+			merged->reskins=(ReskinPtr)safeRealloc(merged->reskins,(merged->reskin_count+1)*sizeof(Reskin));
+			merged->reskins[merged->reskin_count]=config->reskins[i];
+			merged->reskins[merged->reskin_count].pair_id=src->pair_remap[pair_id];
+			merged->reskin_count++;
+			}
+		src->ibdds=IbdDataSetOpen(config);
+		IbdDataSetAdvise(src->ibdds,TRUE);
+		}
+	DEBUG("merge: %d chromosomes, %d markers, %d individuals, %d pairs.",
+		(int)merged->chromosome_count,
+		(int)merged->marker_count,
+		(int)merged->individual_count,
+		(int)merged->pair_count);
+	
+	merged->file_id = H5Fcreate(merged->hdf5_filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+	if( merged->file_id < 0)
+		{
+		DIE_FAILURE("Cannot create %s.\n", merged->hdf5_filename);
+		}
+	writePedigree(merged);
+	writeDictionary(merged);
+	writeMarkers(merged);
+	writePairs(merged);
+	writeReskins(merged);
+	writeSnapshot(merged);
+	
+	/* fill '/ibd' by blocks of complete rows: each block is written once */
+	out_dataset_id=createIbdDataset(merged);
+	out_dataspace_id=VERIFY(H5Dget_space(out_dataset_id));
+	row_size=merged->pair_count*3;
+	block_markers=MIN(MAX(1,merged->marker_count),MAX(1,IBD_READ_BLOCK_SIZE/(MAX(1,row_size)*sizeof(float))));
+	out_block=(float*)safeMalloc(block_markers*MAX(1,row_size)*sizeof(float));
+	src_block=(float*)safeMalloc(block_markers*MAX(1,max_src_row_size)*sizeof(float));
+	counts=(int*)safeMalloc(block_markers*MAX(1,merged->pair_count)*sizeof(int));
+	for(i=0;i< merged->marker_count && row_size>0;i+=n)
+		{
+		hsize_t write_start[3] = {i,0,0};
+		hsize_t write_count[3] = {0,merged->pair_count,3};
+		hid_t memspace;
+		n=MIN(block_markers,merged->marker_count-i);
+		for(j=0;j< n*row_size;++j) out_block[j]=IBD_UNDEFINED;
+		memset((void*)counts,0,n*merged->pair_count*sizeof(int));
+		
+		for(src_index=0;src_index< n_sources;++src_index)
+			{
+			MergeSourcePtr src=&sources[src_index];
+			ContextPtr config=src->config;
+			size_t src_row_size=config->pair_count*3;
+			j=0;
+			while(j< n)
+				{
+				/* read the longest run of consecutive markers of this source */
+				size_t run=1,m,p;
+				int first=src->marker_inverse[i+j];
+				if(first<0 || src_row_size==0)
+					{
+					++j;
+					continue;
+					}
+				while(j+run< n && src->marker_inverse[i+j+run]==first+(int)run) ++run;
+				IbdDataSetReadMarkers(config,src->ibdds,(size_t)first,run,src_block);
+				for(m=0;m< run;++m)
+					{
+					for(p=0;p< config->pair_count;++p)
+						{
+						size_t cell=(j+m)*merged->pair_count+(size_t)src->pair_remap[p];
+						n_conflicts+=mergeIbdCell(
+							&out_block[cell*3],
+							&src_block[m*src_row_size+p*3],
+							&counts[cell],
+							policy
+							);
+						}
+					}
+				j+=run;
+				}
+			}
+		write_count[0]=n;
+		memspace = VERIFY(H5Screate_simple(3, write_count, NULL));
+		VERIFY(H5Sselect_hyperslab(
+			out_dataspace_id,
+			H5S_SELECT_SET,
+			write_start, NULL,
+			write_count, NULL
+			));
+		VERIFY(H5Dwrite(
+			out_dataset_id,
+			H5T_NATIVE_FLOAT,
+			memspace,
+			out_dataspace_id,
+			H5P_DEFAULT,
+			out_block
+			));
+		VERIFY(H5Sclose(memspace));
+		}
+	DEBUG("merge: %zu cells defined in more than one source.",n_conflicts);
+	VERIFY(H5Sclose(out_dataspace_id));
+	VERIFY(H5Dclose(out_dataset_id));
+	VERIFY(H5Fclose(merged->file_id));
+	
+	free(out_block);
+	free(src_block);
+	free(counts);
+	for(src_index=0;src_index< n_sources;++src_index)
+		{
+		MergeSourcePtr src=&sources[src_index];
+		IbdDataSetClose(src->ibdds);
+		free(src->tid_remap);
+		free(src->marker_remap);
+		free(src->marker_inverse);
+		free(src->indi_remap);
+		free(src->pair_remap);
+		ContextFree(src->config);
+		}
+	free(sources);
+	free(has_reskin);
+	free(markersbyname);
+	free(merged->chromosomes);
+	free(merged->markers);
+	free(merged->individuals);
+	free(merged->pairs);
+	free(merged->reskins);
+	free(merged);
+	return EXIT_SUCCESS;
+	}
+
+static void snapshot_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s file.h5\n\n",argv[0]);
+	fputs("Writes (or replaces) the metadata snapshot of a database: a compact copy of the dictionary, markers, pedigree and pairs\n",stderr);
+	fputs("loaded at startup instead of the compound datasets. 'build', 'subset' and 'merge' always write a snapshot.\n\n",stderr);
+	}
+
+int main_snapshot(int argc,char** argv)
+	{
+	ContextPtr config=ContextNew(argc,argv);
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_no_snapshot = 1;
+	if(argc!=2)
+		{
+		snapshot_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	config->hdf5_filename = argv[1];
+	ContextOpenForRead(config);
+	
+	/* re-open the file for writing */
+	VERIFY(H5Fclose(config->file_id));
+	config->file_id = H5Fopen(config->hdf5_filename, H5F_ACC_RDWR, H5P_DEFAULT);
+	if( config->file_id < 0)
+		{
+		DIE_FAILURE("Cannot open %s for writing.\n", config->hdf5_filename);
+		}
+	if(H5Lexists(config->file_id,DATASET_SNAPSHOT,H5P_DEFAULT)>0)
+		{
+		VERIFY(H5Ldelete(config->file_id,DATASET_SNAPSHOT,H5P_DEFAULT));
+		}
+	writeSnapshot(config);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+/**
+ * 'index' / 'locus'
+ *
+ * The segments of all the pairs are stored in the HDF5 file for some fixed tresholds:
+ * the group GROUP_SEGMENTS/(treshold) contains a dataset 'intervals' of IbdSegment sorted on (tid,start,end)
+ * and a dataset 'offsets' (chromosome_count+1) : the segments of chromosome 'tid' are [offsets[tid],offsets[tid+1][ .
+ * Each chromosome is an implicit interval tree (the sorted array is the in-order traversal of a
+ * complete binary tree, and 'max_end' is the max end of each sub-tree ) so 'locus' can find the
+ * overlapping segments without reading '/ibd'.
+ */
+#define GROUP_SEGMENTS "/segments"
+#define SEGMENTS_INTERVALS "intervals"
+#define SEGMENTS_OFFSETS "offsets"
+
+static void segmentGroupName(char* buffer,float treshold)
+	{
+	sprintf(buffer,GROUP_SEGMENTS "/%g",treshold);
+	}
+
+static hid_t createSegmentType()
+	{
+	hid_t segtype = H5Tcreate (H5T_COMPOUND, sizeof (IbdSegment));
+	H5Tinsert(segtype, "tid", HOFFSET(IbdSegment, tid), H5T_NATIVE_INT);
+	H5Tinsert(segtype, "start", HOFFSET(IbdSegment, start), H5T_NATIVE_INT);
+	H5Tinsert(segtype, "end", HOFFSET(IbdSegment, end), H5T_NATIVE_INT);
+	H5Tinsert(segtype, "pair_index", HOFFSET(IbdSegment, pair_index), H5T_NATIVE_INT);
+	H5Tinsert(segtype, "n_markers", HOFFSET(IbdSegment, n_markers), H5T_NATIVE_INT);
+	H5Tinsert(segtype, "mean_ibd0", HOFFSET(IbdSegment, mean_ibd0), H5T_NATIVE_FLOAT);
+	H5Tinsert(segtype, "max_end", HOFFSET(IbdSegment, max_end), H5T_NATIVE_INT);
+	return segtype;
+	}
+
+/** callback for sorting the segments on tid,start,end,pair */
+static int IbdSegmentCompare(const void* a,const void *b)
+	{
+	const IbdSegment* i=(const IbdSegment*)a;
+	const IbdSegment* j=(const IbdSegment*)b;
+	if(i->tid != j->tid) return i->tid - j->tid;
+	if(i->start != j->start) return (i->start < j->start ? -1 : 1);
+	if(i->end != j->end) return (i->end < j->end ? -1 : 1);
+	return i->pair_index - j->pair_index;
+	}
+
+/**
+ * fill 'max_end' of the 'n' sorted segments of one chromosome.
+ * returns the level of the root of the implicit tree.
+ */
+static int IbdSegmentIndex(IbdSegmentPtr a,size_t n)
+	{
+	size_t i,last_i=0UL;
+	int k,last=0;
+	if(n==0) return -1;
+	/* leaves (level 0) are the even indexes */
+	for(i=0;i< n;i+=2)
+		{
+		last_i=i;
+		last=a[i].max_end=a[i].end;
+		}
+	for(k=1;(((size_t)1)<<k) <= n;++k)
+		{
+		size_t x=((size_t)1)<<(k-1);
+		size_t step=x<<2;
+		for(i=(x<<1)-1;i< n;i+=step)
+			{
+			int el=a[i-x].max_end;
+			/* the right child may be out of the array: use the last node */
+			int er=(i+x< n?a[i+x].max_end:last);
+			int e=a[i].end;
+			if(el>e) e=el;
+			if(er>e) e=er;
+			a[i].max_end=e;
+			}
+		last_i=((last_i>>k)&1)?last_i-x:last_i+x;
+		if(last_i< n && a[last_i].max_end > last) last=a[last_i].max_end;
+		}
+	return k-1;
+	}
+
+/** level of the root of the implicit tree of 'n' segments */
+static int IbdSegmentMaxLevel(size_t n)
+	{
+	int k=0;
+	while((((size_t)1)<<(k+1)) <= n) ++k;
+	return k;
+	}
+
+static int sizeTCompare(const void* a,const void *b)
+	{
+	size_t i=*((const size_t*)a);
+	size_t j=*((const size_t*)b);
+	return (i<j?-1:(i>j?1:0));
+	}
+
+/**
+ * find the segments overlapping [start,end[ in the 'n' indexed segments of one chromosome.
+ * their indexes are appended to '*hits' (allocated size '*hits_capacity'). returns the number of hits.
+ */
+static size_t IbdSegmentQuery(const IbdSegmentPtr a,size_t n,int max_level,int start,int end,size_t** hits,size_t* n_hits,size_t* hits_capacity)
+	{
+	struct {int k;size_t x;int w;} stack[64];
+	size_t i,count=0UL;
+	int t=0;
+	if(n==0) return 0;
+	stack[t].k=max_level;
+	stack[t].x=(((size_t)1)<<max_level)-1;
+	stack[t].w=0;
+	++t;
+#define PUSH_HIT(idx) do { \
+	if(*n_hits==*hits_capacity) { *hits_capacity=MAX(64,*hits_capacity*2); *hits=(size_t*)safeRealloc(*hits,*hits_capacity*sizeof(size_t)); } \
+	(*hits)[(*n_hits)++]=(idx); count++; } while(0)
+	while(t>0)
+		{
+		int k;
+		size_t x;
+		int w;
+		--t;
+		k=stack[t].k;
+		x=stack[t].x;
+		w=stack[t].w;
+		if(k<=3)
+			{
+			/* small sub-tree: linear scan */
+			size_t i0=(x>>k)<<k;
+			size_t i1=i0+(((size_t)1)<<(k+1))-1;
+			if(i1>n) i1=n;
+			for(i=i0;i< i1 && a[i].start< end;++i)
+				{
+				if(start < a[i].end) PUSH_HIT(i);
+				}
+			}
+		else if(w==0)
+			{
+			/* visit the left child, then come back to this node */
+			size_t y=x-(((size_t)1)<<(k-1));
+			stack[t].k=k;
+			stack[t].x=x;
+			stack[t].w=1;
+			++t;
+			if(y>=n || a[y].max_end > start)
+				{
+				stack[t].k=k-1;
+				stack[t].x=y;
+				stack[t].w=0;
+				++t;
+				}
+			}
+		else if(x< n && a[x].start < end)
+			{
+			if(start < a[x].end) PUSH_HIT(x);
+			stack[t].k=k-1;
+			stack[t].x=x+(((size_t)1)<<(k-1));
+			stack[t].w=0;
+			++t;
+			}
+		}
+#undef PUSH_HIT
+	return count;
+	}
+
+static void index_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Finds the IBD segments of all the pairs (see 'segments') and stores them in the HDF5 file\n",stderr);
+	fputs("as an interval index per chromosome, used by 'locus'. An existing index for the same treshold is replaced.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD. Can be used multiple times. Default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs(" --min-markers (int) only index the segments with at least N markers. Default: 1.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_index(int argc,char** argv)
+	{
+	size_t i,t,n_sinks=0UL;
+	SegmentSinkPtr sinks=NULL;
+	size_t min_markers=1UL;
+	ContextPtr config=ContextNew(argc,argv);
+	MarkerRangePtr ranges=NULL;
+	size_t n_ranges=0UL;
+	PairFilter filter;
+	IbdDataSetPtr ibdds;
+	hid_t segtype;
+	
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 1;
+	config->on_read_load_reskins = 0;
+	
+	if(argc==1)
+		{
+		index_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"treshold",  required_argument, 0,1026},
+			{"min-markers",  required_argument, 0,1028},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 1026:
+				sinks=(SegmentSinkPtr)safeRealloc(sinks,(n_sinks+1)*sizeof(SegmentSink));
+				memset((void*)&sinks[n_sinks],0,sizeof(SegmentSink));
+				sinks[n_sinks].treshold = atof(optarg);
+				n_sinks++;
+				break;
+			case 1028:
+				if(atoi(optarg)<1)
+					{
+					fprintf(stderr,"bad number of markers %s\n",optarg);
+					return EXIT_FAILURE;
+					}
+				min_markers=(size_t)atoi(optarg);
+				break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(n_sinks==0)
+		{
+		sinks=(SegmentSinkPtr)safeCalloc(1,sizeof(SegmentSink));
+		sinks[0].treshold = DEFAULT_TRESHOLD_LIMIT;
+		n_sinks=1;
+		}
+	for(t=0;t< n_sinks;++t)
+		{
+		sinks[t].min_markers=min_markers;
+		sinks[t].collect=TRUE;
+		}
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	
+	/* all the pairs are indexed */
+	PairFilterInit(&filter);
+	selectPairs(config,&filter);
+	
+	ranges = buildMarkerRanges(config,NULL,NULL,&n_ranges);
+	ibdds= IbdDataSetOpen(config);
+	IbdDataSetAdvise(ibdds,TRUE);
+	scanIbdSegments(config,ibdds,ranges,n_ranges,sinks,n_sinks);
+	IbdDataSetClose(ibdds);
+	MarkerRangesFree(ranges,n_ranges);
+	
+	/* re-open the file for writing */
+	VERIFY(H5Fclose(config->file_id));
+	config->file_id = H5Fopen(config->hdf5_filename, H5F_ACC_RDWR, H5P_DEFAULT);
+	if( config->file_id < 0)
+		{
+		DIE_FAILURE("Cannot open %s for writing.\n", config->hdf5_filename);
+		}
+	segtype = createSegmentType();
+	for(t=0;t< n_sinks;++t)
+		{
+		char group_name[100];
+		hid_t lcpl,group_id,dataspace_id,dataset_id;
+		hsize_t dims[1];
+		hsize_t* offsets=(hsize_t*)safeCalloc(config->chromosome_count+1,sizeof(hsize_t));
+		SegmentSinkPtr sink=&sinks[t];
+		
+		qsort(sink->segments,sink->segment_count,sizeof(IbdSegment),IbdSegmentCompare);
+		for(i=0;i< sink->segment_count;++i)
+			{
+			offsets[sink->segments[i].tid+1]++;
+			}
+		for(i=0;i< config->chromosome_count;++i)
+			{
+			offsets[i+1]+=offsets[i];
+			IbdSegmentIndex(&sink->segments[offsets[i]],offsets[i+1]-offsets[i]);
+			}
+		
+		segmentGroupName(group_name,sink->treshold);
+		DEBUG("Writing %d segments in %s",(int)sink->segment_count,group_name);
+		if(H5Lexists(config->file_id,GROUP_SEGMENTS,H5P_DEFAULT)>0 &&
+		   H5Lexists(config->file_id,group_name,H5P_DEFAULT)>0)
+			{
+			VERIFY(H5Ldelete(config->file_id,group_name,H5P_DEFAULT));
+			}
+		lcpl = VERIFY(H5Pcreate(H5P_LINK_CREATE));
+		VERIFY(H5Pset_create_intermediate_group(lcpl,1));
+		group_id = VERIFY(H5Gcreate2(config->file_id,group_name,lcpl,H5P_DEFAULT,H5P_DEFAULT));
+		
+		dims[0]=sink->segment_count;
+		dataspace_id = VERIFY(H5Screate_simple(1, dims, NULL));
+		dataset_id = VERIFY(H5Dcreate2(group_id,SEGMENTS_INTERVALS,segtype,dataspace_id,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT));
+		if(sink->segment_count>0)
+			{
+			VERIFY(H5Dwrite(dataset_id,segtype,H5S_ALL,H5S_ALL,H5P_DEFAULT,sink->segments));
+			}
+		VERIFY(H5Dclose(dataset_id));
+		VERIFY(H5Sclose(dataspace_id));
+		
+		dims[0]=config->chromosome_count+1;
+		dataspace_id = VERIFY(H5Screate_simple(1, dims, NULL));
+		dataset_id = VERIFY(H5Dcreate2(group_id,SEGMENTS_OFFSETS,H5T_NATIVE_HSIZE,dataspace_id,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT));
+		VERIFY(H5Dwrite(dataset_id,H5T_NATIVE_HSIZE,H5S_ALL,H5S_ALL,H5P_DEFAULT,offsets));
+		VERIFY(H5Dclose(dataset_id));
+		VERIFY(H5Sclose(dataspace_id));
+		
+		VERIFY(H5Gclose(group_id));
+		VERIFY(H5Pclose(lcpl));
+		free(offsets);
+		free(sink->segments);
+		}
+	VERIFY(H5Tclose(segtype));
+	free(sinks);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+static void locus_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file.h5\n\n",argv[0]);
+	fputs("Prints the indexed segments (see 'index') overlapping a locus, that is the pairs IBD at this locus.\n",stderr);
+	fputs("The output has the same columns as 'segments'. '/ibd' is not read.\n\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -r|--region (chr:pos|chr:start-end) the locus. Required. Can be used multiple times.\n",stderr);
+	fputs(" -i|--individual (fam:name) restrict to that individual. Can be used multiple times.\n",stderr);
+	fputs(" -I|--individualfile (file): tab delimited file containing fam\\tname\\n to restrict to those individuals.\n",stderr);
+	fputs(" -p|--pair (fam1:name1|fam2:name2) restrict to that pair. Can be used multiple times.\n",stderr);
+	fputs(" -P|--pairfile (file):   tab delimited file containing : fam1\\tname1\\tfam2\\tname2\\n to restrict to those pairs.\n",stderr);
+	fputs(" -F|--family (fam) restrict to that family. Can be used multiple times.\n",stderr);
+	fputs(" -Y|--familyfile (file) read file to restrict to thoses families. Can be used multiple times.\n",stderr);
+	fputs(" --noselfself ignore all self-self pairs.\n",stderr);
+	fprintf(stderr," --treshold (float) IBD TRESHOLD of the index. default:%f \n", DEFAULT_TRESHOLD_LIMIT);
+	fputs(" --noheader don't print header.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_locus(int argc,char** argv)
+	{
+	float treshold=DEFAULT_TRESHOLD_LIMIT;
+	int print_header=TRUE;
+	size_t i,q;
+	ContextPtr config=ContextNew(argc,argv);
+	struct ArrayOfStrings loci;
+	PairFilter filter;
+	char group_name[100];
+	hid_t group_id,dataset_id,dataspace_id,segtype;
+	hsize_t* offsets=NULL;
+	/* the segments of each chromosome, read once and shared by the loci */
+	IbdSegmentPtr* chrom_segments=NULL;
+	size_t* hits=NULL;
+	size_t hits_capacity=0UL;
+	
+	memset((void*)&loci,0,sizeof(struct ArrayOfStrings));
+	PairFilterInit(&filter);
+	config->on_read_load_pedigree = 1;
+	config->on_read_load_pairs = 1;
+	config->on_read_load_dict = 1;
+	config->on_read_load_markers = 0;
+	config->on_read_load_reskins = 0;
+	
+	if(argc==1)
+		{
+		locus_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"region",    required_argument, 0, 'r'},
+			{"noheader",  no_argument, &print_header, 0},
+			{"individual",  required_argument, 0, 'i'},
+			{"individualfile",  required_argument, 0, 'I'},
+			{"pair",  required_argument, 0, 'p'},
+			{"pairfile",  required_argument, 0, 'P'},
+			{"family",  required_argument, 0, 'F'},
+			{"familyfile",  required_argument, 0, 'Y'},
+			{"noselfself", no_argument, &filter.allow_self_self, 0},
+			{"treshold",  required_argument, 0,1026},
+			{0, 0, 0, 0}
+		     };
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "r:i:p:F:I:P:Y:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 'r': PUSH_STR_TO_ARRAY(loci,optarg);break;
+			case 'i': PUSH_STR_TO_ARRAY(filter.limitIndividuals,optarg);break;
+			case 'I': selectIndividualsFromFile(&filter.limitIndividuals,optarg); break;
+			case 'p': PUSH_STR_TO_ARRAY(filter.limitPairs,optarg);break;
+			case 'P': selectPairsFromFile(&filter.limitPairs,optarg); break;
+			case 'F': PUSH_STR_TO_ARRAY(filter.limitFamilies,optarg);break;
+			case 'Y': selectFamiliesFromFile(&filter.limitFamilies,optarg); break;
+			case 1026: treshold = atof(optarg);break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(optind+1!=argc)
+		{
+		fprintf(stderr,"Illegal number of arguments.\n");
+		return EXIT_FAILURE;
+		}
+	if(loci.size==0)
+		{
+		fprintf(stderr,"option --region is required.\n");
+		return EXIT_FAILURE;
+		}
+	config->hdf5_filename = argv[optind];
+	ContextOpenForRead(config);
+	selectPairs(config,&filter);
+	
+	segmentGroupName(group_name,treshold);
+	if(H5Lexists(config->file_id,GROUP_SEGMENTS,H5P_DEFAULT)<=0 ||
+	   H5Lexists(config->file_id,group_name,H5P_DEFAULT)<=0)
+		{
+		DIE_FAILURE("No segment index for treshold %g in %s. Run 'ibddb index --treshold %g %s' first.",
+			treshold,config->hdf5_filename,treshold,config->hdf5_filename);
+		}
+	group_id = VERIFY(H5Gopen2(config->file_id,group_name,H5P_DEFAULT));
+	offsets=(hsize_t*)safeCalloc(config->chromosome_count+1,sizeof(hsize_t));
+	dataset_id = VERIFY(H5Dopen2(group_id,SEGMENTS_OFFSETS,H5P_DEFAULT));
+	VERIFY(H5Dread(dataset_id,H5T_NATIVE_HSIZE,H5S_ALL,H5S_ALL,H5P_DEFAULT,offsets));
+	VERIFY(H5Dclose(dataset_id));
+	dataset_id = VERIFY(H5Dopen2(group_id,SEGMENTS_INTERVALS,H5P_DEFAULT));
+	dataspace_id = VERIFY(H5Dget_space(dataset_id));
+	segtype = createSegmentType();
+	chrom_segments=(IbdSegmentPtr*)safeCalloc(MAX(1,config->chromosome_count),sizeof(IbdSegmentPtr));
+	
+	if(print_header)
+		{
+		fputs("#CHROM\tSTART\tEND\tPAIR\tN_MARKERS\tMEAN_IBD0\n",config->out);
+		}
+	for(q=0;q< loci.size;++q)
+		{
+		Region region;
+		IbdSegmentPtr segments;
+		size_t n_segments,n_hits=0UL;
+		char* rgn_str;
+		/* chr:pos is chr:pos-pos */
+		if(strchr(loci.data[q],':')!=NULL && strchr(strchr(loci.data[q],':'),'-')==NULL)
+			{
+			rgn_str=(char*)safeMalloc(strlen(loci.data[q])*2+2);
+			sprintf(rgn_str,"%s-%s",loci.data[q],strchr(loci.data[q],':')+1);
+			}
+		else
+			{
+			rgn_str=safeStrDup(loci.data[q]);
+			}
+		parseRegion(config,&region,rgn_str);
+		free(rgn_str);
+		
+		/* read the segments of this chromosome, the first time it is queried */
+		n_segments=offsets[region.tid+1]-offsets[region.tid];
+		if(n_segments>0 && chrom_segments[region.tid]==NULL)
+			{
+			hsize_t read_start[1]={offsets[region.tid]};
+			hsize_t read_count[1]={n_segments};
+			hid_t memspace = VERIFY(H5Screate_simple(1, read_count, NULL));
+			DEBUG("Reading the %zu segments of %s",n_segments,config->chromosomes[region.tid].name);
+			chrom_segments[region.tid]=(IbdSegmentPtr)safeMalloc(n_segments*sizeof(IbdSegment));
+			VERIFY(H5Sselect_hyperslab(dataspace_id,H5S_SELECT_SET,read_start,NULL,read_count,NULL));
+			VERIFY(H5Dread(dataset_id,segtype,memspace,dataspace_id,H5P_DEFAULT,chrom_segments[region.tid]));
+			VERIFY(H5Sclose(memspace));
+			}
+		segments=chrom_segments[region.tid];
+		if(n_segments>0)
+			{
+			/* the region is inclusive */
+			IbdSegmentQuery(segments,n_segments,IbdSegmentMaxLevel(n_segments),
+				region.start,region.end+1,&hits,&n_hits,&hits_capacity);
+			}
+		/* hits are returned in the order of the tree, the segments are sorted on start */
+		qsort(hits,n_hits,sizeof(size_t),sizeTCompare);
+		for(i=0;i< n_hits;++i)
+			{
+			IbdSegmentPtr seg=&segments[hits[i]];
+			if(!config->pairs[seg->pair_index].selected) continue;
+			printSegment(config,seg);
+			}
+		}
+	for(i=0;i< config->chromosome_count;++i)
+		{
+		free(chrom_segments[i]);
+		}
+	free(chrom_segments);
+	free(hits);
+	VERIFY(H5Tclose(segtype));
+	VERIFY(H5Sclose(dataspace_id));
+	VERIFY(H5Dclose(dataset_id));
+	VERIFY(H5Gclose(group_id));
+	free(offsets);
+	free(loci.data);
+	ContextFree(config);
+	return EXIT_SUCCESS;
+	}
+
+/**
+ * 'serve' / 'client'
+ *
+ * The server opens the databases once and listens on a unix socket.
+ * Protocol, all integers are uint32 in network order:
+ *   client -> server : argc, then for each argument: length, bytes
+ *   server -> client : frames (1 byte type, length, bytes) where type is
+ *     SERVE_FRAME_STDOUT, SERVE_FRAME_STDERR, and finally SERVE_FRAME_STATUS (4 bytes exit status).
+ * Each query runs in a forked process sharing the loaded context (copy-on-write),
+ * so a failing query (DIE_FAILURE) doesn't stop the server. What a query warms up
+ * (chunk cache of /ibd, selected pairs) stays in its child and is not reused.
+ */
+#define SERVE_FRAME_STDOUT 'O'
+#define SERVE_FRAME_STDERR 'E'
+#define SERVE_FRAME_STATUS 'S'
+#define SERVE_MAX_ARGS 100000
+#define SERVE_MAX_ARG_LENGTH (1024*1024)
+
+static const char* serve_socket_path = NULL;
+
+static int writeFully(int fd,const void* buffer,size_t n)
+	{
+	const char* p=(const char*)buffer;
+	while(n>0)
+		{
+		ssize_t w=write(fd,p,n);
+		if(w<0 && errno==EINTR) continue;
+		if(w<=0) return -1;
+		p+=w;
+		n-=(size_t)w;
+		}
+	return 0;
+	}
+
+static int readFully(int fd,void* buffer,size_t n)
+	{
+	char* p=(char*)buffer;
+	while(n>0)
+		{
+		ssize_t r=read(fd,p,n);
+		if(r<0 && errno==EINTR) continue;
+		if(r<=0) return -1;
+		p+=r;
+		n-=(size_t)r;
+		}
+	return 0;
+	}
+
+static int writeUInt32(int fd,uint32_t v)
+	{
+	v=htonl(v);
+	return writeFully(fd,&v,sizeof(uint32_t));
+	}
+
+static int readUInt32(int fd,uint32_t* v)
+	{
+	if(readFully(fd,v,sizeof(uint32_t))!=0) return -1;
+	*v=ntohl(*v);
+	return 0;
+	}
+
+static int sendFrame(int fd,char type,const void* data,uint32_t len)
+	{
+	if(writeFully(fd,&type,1)!=0) return -1;
+	if(writeUInt32(fd,len)!=0) return -1;
+	return writeFully(fd,data,len);
+	}
+
+static int openUnixSocket(const char* path,struct sockaddr_un* addr)
+	{
+	int fd;
+	if(strlen(path)>=sizeof(addr->sun_path))
+		{
+		DIE_FAILURE("socket path too long %s",path);
+		}
+	memset((void*)addr,0,sizeof(struct sockaddr_un));
+	addr->sun_family=AF_UNIX;
+	strcpy(addr->sun_path,path);
+	fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd<0) DIE_FAILURE("Cannot create socket : %s.",strerror(errno));
+	return fd;
+	}
+
+static void serveSignalHandler(int sig)
+	{
+	if(serve_socket_path!=NULL) unlink(serve_socket_path);
+	_exit(EXIT_SUCCESS);
+	}
+
+/** find the served context for a filename, using the real paths */
+static ContextPtr serveFindContext(ContextPtr* contexts,char** realpaths,size_t n_contexts,const char* filename)
+	{
+	size_t i;
+	char resolved[PATH_MAX];
+	if(realpath(filename,resolved)==NULL) return NULL;
+	for(i=0;i< n_contexts;++i)
+		{
+		if(strcmp(realpaths[i],resolved)==0) return contexts[i];
+		}
+	return NULL;
+	}
+
+/** handle one connection: read the arguments, run the query in a child process, relay its output */
+static void serveConnection(int client,ContextPtr* contexts,char** realpaths,size_t n_contexts)
+	{
+	uint32_t i,argc=0,status=EXIT_FAILURE;
+	char** argv=NULL;
+	int out_pipe[2],err_pipe[2];
+	pid_t pid;
+	ContextPtr ctx;
+
+	if(readUInt32(client,&argc)!=0 || argc<1 || argc>SERVE_MAX_ARGS) return;
+	argv=(char**)safeCalloc(argc+1,sizeof(char*));
+	for(i=0;i< argc;++i)
+		{
+		uint32_t len;
+		if(readUInt32(client,&len)!=0 || len>SERVE_MAX_ARG_LENGTH) return;
+		argv[i]=(char*)safeMalloc(len+1);
+		if(readFully(client,argv[i],len)!=0) return;
+		argv[i][len]=0;
+		}
+	ctx=serveFindContext(contexts,realpaths,n_contexts,argv[argc-1]);
+	if(ctx==NULL)
+		{
+		char msg[100+PATH_MAX];
+		sprintf(msg,"%.*s is not served by this server.\n",PATH_MAX,argv[argc-1]);
+		sendFrame(client,SERVE_FRAME_STDERR,msg,(uint32_t)strlen(msg));
+		status=htonl(status);
+		sendFrame(client,SERVE_FRAME_STATUS,&status,sizeof(uint32_t));
+		return;
+		}
+	if(pipe(out_pipe)!=0 || pipe(err_pipe)!=0) DIE_FAILURE("pipe failed : %s.",strerror(errno));
+	pid=fork();
+	if(pid<0) DIE_FAILURE("fork failed : %s.",strerror(errno));
+	if(pid==0)
+		{
+		int ret;
+		close(client);
+		close(out_pipe[0]);
+		close(err_pipe[0]);
+		dup2(err_pipe[1],STDERR_FILENO);
+		ctx->out=fdopen(out_pipe[1],"w");
+		if(ctx->out==NULL) _exit(EXIT_FAILURE);
+		optind=0;/* re-initialize getopt */
+		ret=ibdQuery(ctx,(int)argc,argv);
+		fflush(ctx->out);
+		fflush(stderr);
+		_exit(ret);
+		}
+	close(out_pipe[1]);
+	close(err_pipe[1]);
+	/* relay stdout and stderr of the query */
+	{
+	struct pollfd fds[2];
+	char buffer[BUFSIZ];
+	int n_open=2;
+	fds[0].fd=out_pipe[0];fds[0].events=POLLIN;
+	fds[1].fd=err_pipe[0];fds[1].events=POLLIN;
+	while(n_open>0)
+		{
+		int k;
+		if(poll(fds,2,-1)<0)
+			{
+			if(errno==EINTR) continue;
+			break;
+			}
+		for(k=0;k<2;++k)
+			{
+			ssize_t nread;
+			if(fds[k].fd<0 || fds[k].revents==0) continue;
+			nread=read(fds[k].fd,buffer,BUFSIZ);
+			if(nread<0 && errno==EINTR) continue;
+			if(nread<=0)
+				{
+				close(fds[k].fd);
+				fds[k].fd=-1;
+				n_open--;
+				continue;
+				}
+			if(sendFrame(client,(k==0?SERVE_FRAME_STDOUT:SERVE_FRAME_STDERR),buffer,(uint32_t)nread)!=0)
+				{
+				/* client is gone */
+				kill(pid,SIGTERM);
+				}
+			}
+		}
+	}
+	{
+	int wstatus=0;
+	if(waitpid(pid,&wstatus,0)==pid && WIFEXITED(wstatus))
+		{
+		status=(uint32_t)WEXITSTATUS(wstatus);
+		}
+	}
+	status=htonl(status);
+	sendFrame(client,SERVE_FRAME_STATUS,&status,sizeof(uint32_t));
+	}
+
+static void serve_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (options) file1.h5 (file2.h5...)\n\n",argv[0]);
+	fputs("Opens the databases once and answers the 'ibd' queries of 'ibddb client' on a unix socket.\n",stderr);
+	fputs("Options:\n\n",stderr);
+	fputs(" -s|--socket (path) unix socket. Required.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_serve(int argc,char** argv)
+	{
+	size_t i,n_contexts=0UL;
+	ContextPtr* contexts;
+	char** realpaths;
+	struct sockaddr_un addr;
+	int server;
+	char* socket_path=NULL;
+	for(;;)
+		{
+		struct option long_options[] =
+		     {
+			{"socket",    required_argument, 0, 's'},
+		       {0, 0, 0, 0}
+		     };
+		 /* getopt_long stores the option index here. */
+		int option_index = 0;
+	     	int c = getopt_long (argc, argv, "s:",
+		                    long_options, &option_index);
+		if(c==-1) break;
+		switch(c)
+			{
+			case 's': socket_path = optarg ;break;
+			case 0: break;
+			case '?': break;
+			default: exit(EXIT_FAILURE); break;
+			}
+		}
+	if(socket_path==NULL || optind==argc)
+		{
+		serve_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	n_contexts=(size_t)(argc-optind);
+	contexts=(ContextPtr*)safeCalloc(n_contexts,sizeof(ContextPtr));
+	realpaths=(char**)safeCalloc(n_contexts,sizeof(char*));
+	for(i=0;i< n_contexts;++i)
+		{
+		char resolved[PATH_MAX];
+		ContextPtr config=ContextNew(argc,argv);
+		config->on_read_load_pedigree = 1;
+		config->on_read_load_pairs = 1;
+		config->on_read_load_dict = 1;
+		config->on_read_load_markers = 1;
+		config->on_read_load_reskins = 1;
+		config->hdf5_filename=argv[optind+i];
+		if(realpath(config->hdf5_filename,resolved)==NULL)
+			{
+			DIE_FAILURE("Cannot resolve %s : %s.",config->hdf5_filename,strerror(errno));
+			}
+		ContextOpenForRead(config);
+		realpaths[i]=safeStrDup(resolved);
+		contexts[i]=config;
+		}
+
+	server=openUnixSocket(socket_path,&addr);
+	unlink(socket_path);
+	if(bind(server,(struct sockaddr*)&addr,sizeof(struct sockaddr_un))!=0)
+		{
+		DIE_FAILURE("Cannot bind %s : %s.",socket_path,strerror(errno));
+		}
+	if(listen(server,SOMAXCONN)!=0)
+		{
+		DIE_FAILURE("Cannot listen %s : %s.",socket_path,strerror(errno));
+		}
+	serve_socket_path=socket_path;
+	signal(SIGINT,serveSignalHandler);
+	signal(SIGTERM,serveSignalHandler);
+	signal(SIGPIPE,SIG_IGN);
+	/* the connection handlers are reaped automatically */
+	signal(SIGCHLD,SIG_IGN);
+	DEBUG("listening on %s",socket_path);
+	for(;;)
+		{
+		pid_t pid;
+		int client=accept(server,NULL,NULL);
+		if(client<0)
+			{
+			if(errno==EINTR) continue;
+			DIE_FAILURE("accept failed : %s.",strerror(errno));
+			}
+		pid=fork();
+		if(pid<0)
+			{
+			fprintf(stderr,"[WARN] fork failed : %s.\n",strerror(errno));
+			close(client);
+			continue;
+			}
+		if(pid==0)
+			{
+			close(server);
+			signal(SIGCHLD,SIG_DFL);
+			signal(SIGINT,SIG_DFL);
+			signal(SIGTERM,SIG_DFL);
+			serveConnection(client,contexts,realpaths,n_contexts);
+			close(client);
+			_exit(EXIT_SUCCESS);
+			}
+		close(client);
+		}
+	return EXIT_SUCCESS;
+	}
+
+static void client_usage(int argc,char** argv)
+	{
+	USAGE_PREAMBLE;
+	fprintf(stderr,"Usage:\n\t%s (socket) (ibd options) file.h5\n\n",argv[0]);
+	fputs("Forwards an 'ibd' query to a running 'ibddb serve'. The options are the same as 'ibddb ibd'.\n",stderr);
+	fputs("Output files (--image, --out...) are written by the server: use absolute paths.\n",stderr);
+	fputs("\n\n",stderr);
+	}
+
+int main_client(int argc,char** argv)
+	{
+	int i,fd;
+	uint32_t status=EXIT_FAILURE;
+	struct sockaddr_un addr;
+	char resolved[PATH_MAX];
+	char* buffer=NULL;
+	size_t buffer_capacity=0UL;
+	if(argc<3)
+		{
+		client_usage(argc,argv);
+		return EXIT_FAILURE;
+		}
+	fd=openUnixSocket(argv[1],&addr);
+	if(connect(fd,(struct sockaddr*)&addr,sizeof(struct sockaddr_un))!=0)
+		{
+		fprintf(stderr,"Cannot connect to %s : %s.\n",argv[1],strerror(errno));
+		return EXIT_FAILURE;
+		}
+	/* send argv[0]="ibd" and the options. The server and the client may not share the same directory */
+	if(writeUInt32(fd,(uint32_t)(argc-1))!=0) DIE_FAILURE("Cannot write to server.");
+	for(i=1;i< argc;++i)
+		{
+		const char* arg=(i==1?"ibd":argv[i]);
+		if(i+1==argc && realpath(argv[i],resolved)!=NULL) arg=resolved;
+		if(writeUInt32(fd,(uint32_t)strlen(arg))!=0 ||
+			writeFully(fd,arg,strlen(arg))!=0)
+			{
+			DIE_FAILURE("Cannot write to server.");
+			}
+		}
+	for(;;)
+		{
+		char type;
+		uint32_t len;
+		if(readFully(fd,&type,1)!=0 || readUInt32(fd,&len)!=0)
+			{
+			fprintf(stderr,"Connection to server lost.\n");
+			break;
+			}
+		if(len>buffer_capacity)
+			{
+			buffer_capacity=len;
+			buffer=(char*)safeRealloc(buffer,buffer_capacity);
+			}
+		if(readFully(fd,buffer,len)!=0)
+			{
+			fprintf(stderr,"Connection to server lost.\n");
+			break;
+			}
+		if(type==SERVE_FRAME_STDOUT)
+			{
+			fwrite(buffer,1,len,stdout);
+			}
+		else if(type==SERVE_FRAME_STDERR)
+			{
+			fwrite(buffer,1,len,stderr);
+			}
+		else if(type==SERVE_FRAME_STATUS && len==sizeof(uint32_t))
+			{
+			memcpy(&status,buffer,sizeof(uint32_t));
+			status=ntohl(status);
+			break;
+			}
+		}
+	free(buffer);
+	close(fd);
+	fflush(stdout);
+	return (int)status;
+	}
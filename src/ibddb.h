@@ -66,11 +66,28 @@ typedef struct individual_t
 	TRANSIENT(boolean_t) selected;
 	} Individual,*IndividualPtr;
 
+/** relationship class of a pair, computed from the pedigree */
+#define RELATIONSHIP_UNKNOWN -1
+#define RELATIONSHIP_UNRELATED 0
+#define RELATIONSHIP_SELF 1
+#define RELATIONSHIP_PARENT_OFFSPRING 2
+#define RELATIONSHIP_FULL_SIBS 3
+#define RELATIONSHIP_SECOND_DEGREE 4
+#define RELATIONSHIP_THIRD_DEGREE 5
+#define RELATIONSHIP_DISTANT 6
+#define RELATIONSHIP_COUNT 7
+/** kinship of the pairs of the databases built before the kinship was stored */
+#define PAIR_KINSHIP_UNKNOWN -1.0f
+
 typedef struct pair_id
 	{
 	int indi1idx;
 	int indi2idx;
 	int index;
+	/** pedigree kinship coefficient of the two individuals */
+	float kinship;
+	/** one of RELATIONSHIP_* */
+	int relationship;
 	TRANSIENT(boolean_t) selected;
 	} PairIndi,*PairIndiPtr;
 
@@ -81,6 +98,28 @@ typedef struct region_id
 	int end;
 	} Region,*RegionPtr;
 
+/** a range [begin,end[ of consecutive markers, e.g. the markers overlapping a region */
+typedef struct marker_range_t
+	{
+	/** optional label, e.g. the name of a BED interval */
+	char* label;
+	size_t begin;
+	size_t end;
+	} MarkerRange,*MarkerRangePtr;
+
+/** a segment of consecutive markers where a pair is IBD. [start,end[ is 0-based like BED */
+typedef struct ibd_segment_t
+	{
+	int tid;
+	int start;
+	int end;
+	int pair_index;
+	int n_markers;
+	float mean_ibd0;
+	/** max 'end' of the sub-tree rooted at this segment in the implicit interval tree */
+	int max_end;
+	} IbdSegment,*IbdSegmentPtr;
+
 #define RESKIN_COLUMN_COUNT 9
 #define RESKIN_COLUMN_IBD0  ( RESKIN_COLUMN_COUNT -1 )
 typedef struct reskin_id
@@ -131,6 +170,30 @@ typedef struct context_t
 	boolean_t on_read_load_pedigree;
 	boolean_t on_read_load_pairs;
 	boolean_t on_read_load_reskins;
+	/** load the markers of a chromosome only when it is used. Requires on_read_load_dict */
+	boolean_t on_read_lazy_markers;
+	/** don't use the metadata snapshot, read the compound datasets */
+	boolean_t on_read_no_snapshot;
+	
+	/** lazy markers: index of the first marker of each chromosome (chromosome_count+1 items), NULL if all the markers were loaded */
+	size_t* chrom_marker_offsets;
+	/** lazy markers: flag for the chromosomes whose markers were loaded */
+	boolean_t* chrom_markers_loaded;
+	/** the tables were loaded from the metadata snapshot, the strings point into it */
+	boolean_t snapshot_loaded;
+	/** the metadata snapshot, mapped with mmap or read in a buffer */
+	void* snapshot_mmap_base;
+	size_t snapshot_mmap_length;
+	void* snapshot_buffer;
+	/** the first byte of the snapshot (in the mapping or in the buffer), kept to load the markers of a chromosome */
+	const void* snapshot_data;
+	
+	/** number of markers of the largest range of the query (set by buildMarkerRanges), 0 if unknown. Used to size the chunk cache */
+	size_t query_range_markers;
+	/** HDF5 chunk cache of a chunked '/ibd'. 0 (or w0<0) means 'computed from the query' */
+	size_t chunk_cache_bytes;
+	size_t chunk_cache_slots;
+	double chunk_cache_w0;
 	} Context,*ContextPtr;
 
 /* create a new context from argc/argv */
@@ -139,6 +202,14 @@ ContextPtr ContextNew(int,char** );
 void ContextFree(ContextPtr);
 /** open IBD context for reading after config->hdf5_filename and config->on_load_* be assigned */
 void ContextOpenForRead(ContextPtr config);
+/** with on_read_lazy_markers: load the markers of the chromosome 'tid' if they were not loaded. Does nothing otherwise */
+void ContextLoadMarkers(ContextPtr config,int tid);
+/** get the marker at 'index', loading its chromosome if needed */
+MarkerPtr ContextGetMarker(ContextPtr config,size_t index);
+
+/** a model of the chunk cache of '/ibd' counting the hits and misses */
+struct chunk_cache_model_t;
+typedef struct chunk_cache_model_t* ChunkCacheModelPtr;
 
 /** placeholder to open/close the '/IBD' dataset, used by standalone and R extension */
 typedef struct ibd_dataset_t
@@ -146,6 +217,15 @@ typedef struct ibd_dataset_t
 	hid_t dataset_id;
 	hid_t dataspace_id;
 	hid_t  memspace;
+	/** number of floats per marker (pair_count*3) */
+	size_t row_size;
+	/** when '/ibd' is contiguous and unfiltered, the pages mapped with mmap and the address of the first float, or NULL */
+	void* mmap_base;
+	size_t mmap_length;
+	const float* mapped;
+	/** when '/ibd' is chunked: the shape of the chunks and a model of the chunk cache, or NULL */
+	hsize_t chunk_dims[3];
+	ChunkCacheModelPtr chunk_cache;
 	} IbdDataSet,*IbdDataSetPtr;
 	
 	
@@ -153,6 +233,16 @@ typedef struct ibd_dataset_t
 IbdDataSetPtr IbdDataSetOpen(ContextPtr config);
 /** close the IBD dataset after reading */
 void IbdDataSetClose(IbdDataSetPtr ds);
+/** tell the kernel if the mapped dataset will be read sequentially or randomly. Does nothing if '/ibd' is not mapped */
+void IbdDataSetAdvise(IbdDataSetPtr ds,boolean_t sequential);
+/** address of the row 'marker_start' in the mapped dataset (followed by the next rows) or NULL if '/ibd' is not mapped */
+const float* IbdDataSetMappedRows(IbdDataSetPtr ds,size_t marker_start);
+/** read the block of markers [marker_start,marker_start+n_markers[ x pairs [pair_start,pair_start+n_pairs[ x 3 status into 'buffer' */
+void IbdDataSetReadBlock(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,size_t pair_start,size_t n_pairs,float* buffer);
+/** read the rows [marker_start,marker_start+n_markers[ of the 'n_pairs' sorted pair indexes in 'pairs' into 'buffer' (n_markers x n_pairs x 3) */
+void IbdDataSetReadPairs(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,const size_t* pairs,size_t n_pairs,float* buffer);
+/** read 'n_markers' complete rows (all pairs x 3 status) starting at 'marker_start' into 'buffer' */
+void IbdDataSetReadMarkers(ContextPtr config,IbdDataSetPtr ds,size_t marker_start,size_t n_markers,float* buffer);
 
 /** graphics Stuff */
 typedef struct rectangle2d_t
@@ -184,13 +274,6 @@ typedef struct dimension2d_t
 	} Dimension2D,*Dimension2DPtr;
 
 
-typedef struct expdata_t
-	{
-	size_t marker_index;
-	double value;
-	} ExpData,*ExpDataPtr;
-
-
 #define USAGE_PREAMBLE fprintf(stderr,"\n\n%s\nAuthor: Pierre Lindenbaum PhD\nGit-Hash: "GIT_HASH"\nWWW: https://github.com/lindenb/ibddb\nCompilation: %s at %s\n\n",argv[0],__DATE__,__TIME__)
 
 #endif
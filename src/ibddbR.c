@@ -63,7 +63,7 @@ static void _RIbdDbFinalizer(SEXP handle)
 	RIbdDbClose(handle);
 	}
 
-SEXP RIbdDbOpen(SEXP Rfilename)
+SEXP RIbdDbOpen(SEXP Rfilename,SEXP Rchunk_cache_mb,SEXP Rchunk_cache_slots,SEXP Rchunk_cache_w0)
 	{
 	IbdHandlerPtr handler;
 	const char* filename= CHAR(STRING_ELT(Rfilename, 0));
@@ -75,7 +75,12 @@ SEXP RIbdDbOpen(SEXP Rfilename)
 	handler->context->on_read_load_pairs = 1;
 	handler->context->on_read_load_dict = 1;
 	handler->context->on_read_load_markers = 1;
+	handler->context->on_read_lazy_markers = 1;
 	handler->context->hdf5_filename=(char*)filename;
+	/* chunk cache of '/ibd': NA means 'computed' */
+	if(!ISNA(asReal(Rchunk_cache_mb))) handler->context->chunk_cache_bytes=(size_t)(asReal(Rchunk_cache_mb)*1024.0*1024.0);
+	if(!ISNA(asReal(Rchunk_cache_slots))) handler->context->chunk_cache_slots=(size_t)asReal(Rchunk_cache_slots);
+	if(!ISNA(asReal(Rchunk_cache_w0))) handler->context->chunk_cache_w0=asReal(Rchunk_cache_w0);
 	ContextOpenForRead(handler->context);
 	handler->ds_param = IbdDataSetOpen(handler->context);
 	SEXP ext = PROTECT(R_MakeExternalPtr(handler, R_NilValue, R_NilValue));
@@ -117,6 +122,7 @@ METHOD_COUNT_ENTITY(Chromosomes,chromosome_count)
 SEXP RIbdDbGetMarkerAt(SEXP handle,SEXP index_r)
 	{
 	GET_ITEM_AT(MarkerPtr,markers,marker_count);
+	item = ContextGetMarker(ctx,(size_t)index);
 	
 	SEXP res = PROTECT(allocVector(VECSXP, 4));
 	SET_VECTOR_ELT(res, 0, mkString(item->name));
@@ -220,34 +226,36 @@ SEXP priv_RIbdDbGetIBD(SEXP handle,SEXP marker_y,SEXP pair_y,int ibd_index)
 		DIE_FAILURE("marker index out of range.");
 		}
 	DEBUG("");
-	 pair_index=0;
 	if(pair_index<0 || pair_index >=  handler->context->pair_count) 
 		{
 		DIE_FAILURE("pair index out of range.");
 		}	
 	DEBUG("");
-	hsize_t read_start[3] = {marker_index,pair_index,0};
-	hsize_t read_count[3] = {1,1,3};
-
-
-	
-	
-	
-	VERIFY(H5Sselect_hyperslab(
-				handler->ds_param->dataspace_id,
-				H5S_SELECT_SET,
-				read_start, NULL, 
-				read_count, NULL
-				));
-			
-	VERIFY(H5Dread(
-		handler->ds_param->dataset_id,
-		H5T_NATIVE_FLOAT,
-		handler->ds_param->memspace,
-		handler->ds_param->dataspace_id,
-		H5P_DEFAULT,
-		ibd_values
-		));
+	if(handler->ds_param->mapped!=NULL)
+		{
+		/* '/ibd' is mapped in memory: no HDF5 call */
+		const float* row=IbdDataSetMappedRows(handler->ds_param,(size_t)marker_index);
+		memcpy((void*)ibd_values,(const void*)&row[pair_index*3],3*sizeof(float));
+		}
+	else
+		{
+		hsize_t read_start[3] = {marker_index,pair_index,0};
+		hsize_t read_count[3] = {1,1,3};
+		VERIFY(H5Sselect_hyperslab(
+			handler->ds_param->dataspace_id,
+			H5S_SELECT_SET,
+			read_start, NULL, 
+			read_count, NULL
+			));
+		VERIFY(H5Dread(
+			handler->ds_param->dataset_id,
+			H5T_NATIVE_FLOAT,
+			handler->ds_param->memspace,
+			handler->ds_param->dataspace_id,
+			H5P_DEFAULT,
+			ibd_values
+			));
+		}
 	if( ibd_values[ibd_index] <0.0 || ibd_values[ibd_index]>1.0) return  Rf_ScalarReal(R_NaN);//Rf_ScalarReal(NAN);
 	return Rf_ScalarReal(ibd_values[ibd_index]);
 	}
@@ -31,6 +31,16 @@ SUBPROG(markers);
 SUBPROG(ped);
 SUBPROG(pairs);
 SUBPROG(pedigree);
+SUBPROG(segments);
+SUBPROG(peaks);
+SUBPROG(tiles);
+SUBPROG(subset);
+SUBPROG(merge);
+SUBPROG(snapshot);
+SUBPROG(index);
+SUBPROG(locus);
+SUBPROG(serve);
+SUBPROG(client);
 
 static void main_usage(int argc,char** argv)
 	{
@@ -43,6 +53,16 @@ static void main_usage(int argc,char** argv)
 	fputs(" ped     : dump pedigree.\n",stderr);
 	fputs(" markers : dump markers.\n",stderr);
 	fputs(" pairs   : dump pairs of individuals.\n",stderr);
+	fputs(" segments: print the IBD segments of the pairs.\n",stderr);
+	fputs(" peaks   : print the best windows of COUNT_IBD.\n",stderr);
+	fputs(" tiles   : render the COUNT_IBD as a pyramid of PNG tiles for a web map.\n",stderr);
+	fputs(" subset  : extract a smaller database.\n",stderr);
+	fputs(" merge   : merge databases.\n",stderr);
+	fputs(" snapshot: write the metadata snapshot of an existing database.\n",stderr);
+	fputs(" index   : store an interval index of the IBD segments in the database.\n",stderr);
+	fputs(" locus   : print the pairs IBD at a locus using the index of the segments.\n",stderr);
+	fputs(" serve   : keep databases opened and answer 'ibd' queries on a unix socket.\n",stderr);
+	fputs(" client  : send an 'ibd' query to 'serve'.\n",stderr);
 	fputs("\n\n",stderr);
 	}
 
@@ -78,6 +98,46 @@ int main(int argc,char** argv)
 			{
 			status= main_ibd(argc-1,&argv[1]);
 			}
+		else if(strcmp("segments",argv[1])==0)
+			{
+			status= main_segments(argc-1,&argv[1]);
+			}
+		else if(strcmp("peaks",argv[1])==0)
+			{
+			status= main_peaks(argc-1,&argv[1]);
+			}
+		else if(strcmp("tiles",argv[1])==0)
+			{
+			status= main_tiles(argc-1,&argv[1]);
+			}
+		else if(strcmp("subset",argv[1])==0)
+			{
+			status= main_subset(argc-1,&argv[1]);
+			}
+		else if(strcmp("merge",argv[1])==0)
+			{
+			status= main_merge(argc-1,&argv[1]);
+			}
+		else if(strcmp("snapshot",argv[1])==0)
+			{
+			status= main_snapshot(argc-1,&argv[1]);
+			}
+		else if(strcmp("index",argv[1])==0)
+			{
+			status= main_index(argc-1,&argv[1]);
+			}
+		else if(strcmp("locus",argv[1])==0)
+			{
+			status= main_locus(argc-1,&argv[1]);
+			}
+		else if(strcmp("serve",argv[1])==0)
+			{
+			status= main_serve(argc-1,&argv[1]);
+			}
+		else if(strcmp("client",argv[1])==0)
+			{
+			status= main_client(argc-1,&argv[1]);
+			}
 		else
 			{
 			fprintf(stderr,"Unknown sub program %s.\n",argv[1]);
@@ -0,0 +1,329 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Pierre Lindenbaum PhD.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#include <stdio.h>
+#include "ibdkernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IBDKERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*CountBelowFun)(const float*,size_t,float,float);
+typedef size_t (*CountBelowStridedFun)(const float*,size_t,size_t,float,float);
+typedef size_t (*CountBelowGatherFun)(const float*,const size_t*,size_t,float,float);
+
+static size_t countBelowScalar(const float* values,size_t n,float treshold,float undefined)
+	{
+	size_t i,count=0UL;
+	for(i=0;i< n;++i)
+		{
+		count+=(values[i] < treshold && values[i] > undefined);
+		}
+	return count;
+	}
+
+static size_t countBelowStridedScalar(const float* values,size_t stride,size_t n,float treshold,float undefined)
+	{
+	size_t i,count=0UL;
+	for(i=0;i< n;++i)
+		{
+		float v=values[i*stride];
+		count+=(v < treshold && v > undefined);
+		}
+	return count;
+	}
+
+static size_t countBelowGatherScalar(const float* row,const size_t* columns,size_t n,float treshold,float undefined)
+	{
+	size_t i,count=0UL;
+	for(i=0;i< n;++i)
+		{
+		float v=row[columns[i]];
+		count+=(v < treshold && v > undefined);
+		}
+	return count;
+	}
+
+#ifdef IBDKERNEL_X86
+__attribute__((target("sse2")))
+static size_t countBelowSSE2(const float* values,size_t n,float treshold,float undefined)
+	{
+	size_t i=0UL,count=0UL;
+	const __m128 t=_mm_set1_ps(treshold);
+	const __m128 u=_mm_set1_ps(undefined);
+	for(;i+4<=n;i+=4)
+		{
+		__m128 v=_mm_loadu_ps(&values[i]);
+		__m128 m=_mm_and_ps(_mm_cmplt_ps(v,t),_mm_cmpgt_ps(v,u));
+		count+=(size_t)__builtin_popcount((unsigned)_mm_movemask_ps(m));
+		}
+	return count+countBelowScalar(&values[i],n-i,treshold,undefined);
+	}
+
+__attribute__((target("avx2")))
+static size_t countBelowAVX2(const float* values,size_t n,float treshold,float undefined)
+	{
+	size_t i=0UL,count=0UL;
+	const __m256 t=_mm256_set1_ps(treshold);
+	const __m256 u=_mm256_set1_ps(undefined);
+	/* two vectors per iteration */
+	for(;i+16<=n;i+=16)
+		{
+		__m256 v1=_mm256_loadu_ps(&values[i]);
+		__m256 v2=_mm256_loadu_ps(&values[i+8]);
+		__m256 m1=_mm256_and_ps(_mm256_cmp_ps(v1,t,_CMP_LT_OQ),_mm256_cmp_ps(v1,u,_CMP_GT_OQ));
+		__m256 m2=_mm256_and_ps(_mm256_cmp_ps(v2,t,_CMP_LT_OQ),_mm256_cmp_ps(v2,u,_CMP_GT_OQ));
+		count+=(size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(m1));
+		count+=(size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(m2));
+		}
+	for(;i+8<=n;i+=8)
+		{
+		__m256 v=_mm256_loadu_ps(&values[i]);
+		__m256 m=_mm256_and_ps(_mm256_cmp_ps(v,t,_CMP_LT_OQ),_mm256_cmp_ps(v,u,_CMP_GT_OQ));
+		count+=(size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(m));
+		}
+	return count+countBelowScalar(&values[i],n-i,treshold,undefined);
+	}
+
+__attribute__((target("avx2")))
+static size_t countBelowStridedAVX2(const float* values,size_t stride,size_t n,float treshold,float undefined)
+	{
+	size_t i=0UL,count=0UL;
+	const __m256 t=_mm256_set1_ps(treshold);
+	const __m256 u=_mm256_set1_ps(undefined);
+	const int s=(int)stride;
+	const __m256i offsets=_mm256_setr_epi32(0,s,2*s,3*s,4*s,5*s,6*s,7*s);
+	if(stride==1) return countBelowAVX2(values,n,treshold,undefined);
+	if(stride>(size_t)(0x7fffffff/8)) return countBelowStridedScalar(values,stride,n,treshold,undefined);
+	for(;i+8<=n;i+=8)
+		{
+		__m256 v=_mm256_i32gather_ps(&values[i*stride],offsets,4);
+		__m256 m=_mm256_and_ps(_mm256_cmp_ps(v,t,_CMP_LT_OQ),_mm256_cmp_ps(v,u,_CMP_GT_OQ));
+		count+=(size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(m));
+		}
+	return count+countBelowStridedScalar(&values[i*stride],stride,n-i,treshold,undefined);
+	}
+
+#ifdef __x86_64__
+/* the columns are 64-bits: two gathers of 4 floats per vector */
+__attribute__((target("avx2")))
+static size_t countBelowGatherAVX2(const float* row,const size_t* columns,size_t n,float treshold,float undefined)
+	{
+	size_t i=0UL,count=0UL;
+	const __m256 t=_mm256_set1_ps(treshold);
+	const __m256 u=_mm256_set1_ps(undefined);
+	for(;i+8<=n;i+=8)
+		{
+		__m128 lo=_mm256_i64gather_ps(row,_mm256_loadu_si256((const __m256i*)&columns[i]),4);
+		__m128 hi=_mm256_i64gather_ps(row,_mm256_loadu_si256((const __m256i*)&columns[i+4]),4);
+		__m256 v=_mm256_insertf128_ps(_mm256_castps128_ps256(lo),hi,1);
+		__m256 m=_mm256_and_ps(_mm256_cmp_ps(v,t,_CMP_LT_OQ),_mm256_cmp_ps(v,u,_CMP_GT_OQ));
+		count+=(size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(m));
+		}
+	return count+countBelowGatherScalar(row,&columns[i],n-i,treshold,undefined);
+	}
+#endif
+#endif
+
+static CountBelowFun countBelowImpl=NULL;
+static CountBelowStridedFun countBelowStridedImpl=NULL;
+static CountBelowGatherFun countBelowGatherImpl=NULL;
+static const char* countBelowImplName="scalar";
+
+static void selectCountBelow()
+	{
+	countBelowImpl=countBelowScalar;
+	countBelowStridedImpl=countBelowStridedScalar;
+	countBelowGatherImpl=countBelowGatherScalar;
+	countBelowImplName="scalar";
+#ifdef IBDKERNEL_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		{
+		countBelowImpl=countBelowAVX2;
+		countBelowStridedImpl=countBelowStridedAVX2;
+#ifdef __x86_64__
+		countBelowGatherImpl=countBelowGatherAVX2;
+#endif
+		countBelowImplName="avx2";
+		}
+	else if(__builtin_cpu_supports("sse2"))
+		{
+		countBelowImpl=countBelowSSE2;
+		countBelowImplName="sse2";
+		}
+#endif
+	}
+
+size_t IbdCountBelow(const float* values,size_t n,float treshold,float undefined)
+	{
+	if(countBelowImpl==NULL) selectCountBelow();
+	return countBelowImpl(values,n,treshold,undefined);
+	}
+
+size_t IbdCountBelowStrided(const float* values,size_t stride,size_t n,float treshold,float undefined)
+	{
+	if(countBelowImpl==NULL) selectCountBelow();
+	return countBelowStridedImpl(values,stride,n,treshold,undefined);
+	}
+
+size_t IbdCountBelowGather(const float* row,const size_t* columns,size_t n,float treshold,float undefined)
+	{
+	if(countBelowImpl==NULL) selectCountBelow();
+	return countBelowGatherImpl(row,columns,n,treshold,undefined);
+	}
+
+const char* IbdCountBelowName()
+	{
+	if(countBelowImpl==NULL) selectCountBelow();
+	return countBelowImplName;
+	}
+
+#ifdef TEST_THIS_CODE
+/* microbenchmark: gcc -O2 -DTEST_THIS_CODE -o ibdkernel-bench ibdkernel.c */
+#include <stdlib.h>
+#include <time.h>
+
+static double benchmark(CountBelowFun f,const float* values,size_t n,int loops,size_t* count)
+	{
+	int i;
+	clock_t start=clock();
+	*count=0UL;
+	for(i=0;i< loops;++i)
+		{
+		*count+=f(values,n,0.1f,-9999.99f);
+		}
+	return (double)(clock()-start)/CLOCKS_PER_SEC;
+	}
+
+/* the IBD0 of the selected pairs of a row: copied in an array and counted, as before the gather kernels */
+static double benchmarkCopy(const float* row,const size_t* columns,size_t n,float* ibd0,int loops,size_t* count)
+	{
+	int i;
+	size_t k;
+	clock_t start=clock();
+	*count=0UL;
+	for(i=0;i< loops;++i)
+		{
+		for(k=0;k< n;++k) ibd0[k]=row[columns[k]];
+		*count+=IbdCountBelow(ibd0,n,0.1f,-9999.99f);
+		}
+	return (double)(clock()-start)/CLOCKS_PER_SEC;
+	}
+
+static double benchmarkStrided(CountBelowStridedFun f,const float* row,size_t n,int loops,size_t* count)
+	{
+	int i;
+	clock_t start=clock();
+	*count=0UL;
+	for(i=0;i< loops;++i)
+		{
+		*count+=f(row,3,n,0.1f,-9999.99f);
+		}
+	return (double)(clock()-start)/CLOCKS_PER_SEC;
+	}
+
+static double benchmarkGather(CountBelowGatherFun f,const float* row,const size_t* columns,size_t n,int loops,size_t* count)
+	{
+	int i;
+	clock_t start=clock();
+	*count=0UL;
+	for(i=0;i< loops;++i)
+		{
+		*count+=f(row,columns,n,0.1f,-9999.99f);
+		}
+	return (double)(clock()-start)/CLOCKS_PER_SEC;
+	}
+
+static void printPairs(const char* label,size_t count,double seconds,size_t n_pairs,int loops)
+	{
+	printf("%s\t%zu\t%.3f sec\t%.1f Mpairs/s\n",label,count,seconds,((double)n_pairs*(double)loops)/(seconds*1E6));
+	}
+
+int main(int argc,char** argv)
+	{
+	size_t i,n=(argc>1?(size_t)atol(argv[1]):10000000UL),count;
+	int loops=(argc>2?atoi(argv[2]):20);
+	float* values=(float*)malloc(sizeof(float)*n);
+	double seconds;
+	if(values==NULL) return EXIT_FAILURE;
+	srand(0);
+	for(i=0;i< n;++i)
+		{
+		int r=rand()%100;
+		values[i]=(r<5?-9999.99f:(float)rand()/(float)RAND_MAX);
+		}
+	seconds=benchmark(countBelowScalar,values,n,loops,&count);
+	printf("scalar\t%zu\t%.3f sec\t%.1f Mb/s\n",count,seconds,(n*sizeof(float)*(double)loops)/(seconds*1E6));
+#ifdef IBDKERNEL_X86
+	seconds=benchmark(countBelowSSE2,values,n,loops,&count);
+	printf("sse2\t%zu\t%.3f sec\t%.1f Mb/s\n",count,seconds,(n*sizeof(float)*(double)loops)/(seconds*1E6));
+	if(__builtin_cpu_supports("avx2"))
+		{
+		seconds=benchmark(countBelowAVX2,values,n,loops,&count);
+		printf("avx2\t%zu\t%.3f sec\t%.1f Mb/s\n",count,seconds,(n*sizeof(float)*(double)loops)/(seconds*1E6));
+		}
+#endif
+	
+	/* the values are a row of n/3 pairs (IBD0,IBD1,IBD2): all the pairs (stride 3) or one pair out of two (gather) */
+	{
+	size_t n_pairs=n/3,n_half=0UL;
+	size_t* all=(size_t*)malloc(sizeof(size_t)*(n_pairs+1));
+	size_t* half=(size_t*)malloc(sizeof(size_t)*(n_pairs+1));
+	float* ibd0=(float*)malloc(sizeof(float)*(n_pairs+1));
+	if(all==NULL || half==NULL || ibd0==NULL) return EXIT_FAILURE;
+	for(i=0;i< n_pairs;++i)
+		{
+		all[i]=i*3;
+		if(rand()%2==0) half[n_half++]=i*3;
+		}
+	seconds=benchmarkCopy(values,all,n_pairs,ibd0,loops,&count);
+	printPairs("copy+count/all",count,seconds,n_pairs,loops);
+	seconds=benchmarkStrided(countBelowStridedScalar,values,n_pairs,loops,&count);
+	printPairs("strided-scalar",count,seconds,n_pairs,loops);
+	seconds=benchmarkCopy(values,half,n_half,ibd0,loops,&count);
+	printPairs("copy+count/half",count,seconds,n_half,loops);
+	seconds=benchmarkGather(countBelowGatherScalar,values,half,n_half,loops,&count);
+	printPairs("gather-scalar",count,seconds,n_half,loops);
+#ifdef IBDKERNEL_X86
+	if(__builtin_cpu_supports("avx2"))
+		{
+		seconds=benchmarkStrided(countBelowStridedAVX2,values,n_pairs,loops,&count);
+		printPairs("strided-avx2",count,seconds,n_pairs,loops);
+#ifdef __x86_64__
+		seconds=benchmarkGather(countBelowGatherAVX2,values,half,n_half,loops,&count);
+		printPairs("gather-avx2",count,seconds,n_half,loops);
+#endif
+		}
+#endif
+	free(ibd0);
+	free(half);
+	free(all);
+	}
+	printf("selected: %s\n",IbdCountBelowName());
+	free(values);
+	return 0;
+	}
+#endif
@@ -0,0 +1,40 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2016 Pierre Lindenbaum PhD.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef IBDKERNEL_H
+#define IBDKERNEL_H
+#include <stddef.h>
+
+/**
+ * count the values 'v' of an array where undefined < v < treshold .
+ * Uses AVX2 or SSE2 when the CPU supports them (runtime dispatch), otherwise a scalar loop.
+ */
+size_t IbdCountBelow(const float* values,size_t n,float treshold,float undefined);
+/** same as IbdCountBelow for the values values[k*stride] (0<=k<n), e.g. the IBD0 of consecutive pairs (stride=3) */
+size_t IbdCountBelowStrided(const float* values,size_t stride,size_t n,float treshold,float undefined);
+/** same as IbdCountBelow for the values row[columns[k]] (0<=k<n), e.g. the IBD0 of the selected pairs */
+size_t IbdCountBelowGather(const float* row,const size_t* columns,size_t n,float treshold,float undefined);
+/** name of the implementation selected by IbdCountBelow */
+const char* IbdCountBelowName();
+#endif
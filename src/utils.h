@@ -77,20 +77,21 @@ void* _safeRealloc(const char*,int,void*,size_t);
 
 
 
-static inline int _assertGT0(const char* fnamen,int line,int status)
+/* status is a long long, so 64-bits HDF5 hid_t are not truncated */
+static inline long long _assertGT0(const char* fnamen,int line,long long status)
 	{
 	if(status<=0)
 		{
-		fprintf(stderr,"%s:%d : Error result status %d<=0\n",fnamen,line,status);
+		fprintf(stderr,"%s:%d : Error result status %lld<=0\n",fnamen,line,status);
 		exit(EXIT_FAILURE);
 		}
 	return status;
 	}
-static inline int _assertGE0(const char* fnamen,int line,int status)
+static inline long long _assertGE0(const char* fnamen,int line,long long status)
 	{
 	if(status<0)
 		{
-		fprintf(stderr,"%s:%d : Error result %d<0\n",fnamen,line,status);
+		fprintf(stderr,"%s:%d : Error result %lld<0\n",fnamen,line,status);
 		exit(EXIT_FAILURE);
 		}
 	return status;
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# compares the output of 'locus' with a linear scan of the segments printed by 'segments'
+# on a small generated database. Usage: locus.sh path/to/ibddb
+#
+IBDDB=${1:-../bin/ibddb}
+case "${IBDDB}" in
+	/*) ;;
+	*) IBDDB="`pwd`/${IBDDB}" ;;
+esac
+TMPDIR=`mktemp -d`
+trap 'rm -rf "${TMPDIR}"' EXIT
+cd "${TMPDIR}" || exit 1
+
+# one family of 8 individuals (36 pairs).
+# chromosome 1 has 310 markers. The pairs #1 to #35 have a segment of one marker on the
+# markers 0 to 298 and the pair #0 has a segment from the marker 100 to the end: there are 300
+# segments and the last nodes of the tree must remember the end of the long segment.
+# chromosomes 2 to 4 are random: a third of the pairs have long segments.
+awk 'BEGIN {for(c=1;c<=4;c++) printf("%d\t1000000\n",c);}' > ref.dict
+awk 'BEGIN {srand(11);
+	for(m=0;m<310;m++) printf("1\t%d\t%d\n",1000*(m+1),1000*(m+1)+1);
+	for(c=2;c<=4;c++)
+		{
+		delete seen;
+		n=0;
+		while(n<100*c) {p=1+int(rand()*999990);if(!(p in seen)) {seen[p]=1;n++;}}
+		for(p in seen) printf("%d\t%d\t%d\n",c,p,p+1);
+		}
+	}' | sort -t '	' -k1,1n -k2,2n |\
+	awk -F '	' '{printf("%s\t%s\t%s\trs%d\n",$1,$2,$3,NR);}' > markers.bed
+awk 'BEGIN {for(i=1;i<=8;i++) printf("F1 I%d 0 0 1 1\n",i);}' > ped.fam
+rm -f ibd.list
+for C in 1 2 3 4
+do
+	awk -F '	' -v C=${C} 'BEGIN {srand(17+C);}
+		($1==C) {names[++n]=$4;}
+		END {
+		printf("3\t36\t%d\t%d",C,n);
+		for(m=1;m<=n;m++) printf("\t%s",names[m]);
+		printf("\n");
+		p=0;
+		for(a=1;a<=8;a++) for(b=a;b<=8;b++)
+			{
+			printf("F1\tI%d\tF1\tI%d",a,b);
+			st=rand();
+			rate=(b%3==0?0.005:0.08);
+			for(m=0;m<n;m++)
+				{
+				if(C==1)
+					{
+					ibd=(p==0 ? m>=100 : (m< 299 && m%35==p-1));
+					}
+				else
+					{
+					if(rand()<rate) st=rand();
+					ibd=(st<0.5);
+					}
+				if(ibd) printf("\t0.0\t0.7\t0.3"); else printf("\t1.0\t0.0\t0.0");
+				}
+			printf("\n");
+			p++;
+			}
+		}' markers.bed | gzip > ibd_${C}.txt.gz
+	echo "ibd_${C}.txt.gz" >> ibd.list
+done
+
+${IBDDB} build -o test.h5 -D ref.dict -b markers.bed -p ped.fam -i ibd.list > /dev/null 2>&1 || { echo "locus: build failed" ; exit 1; }
+${IBDDB} index --treshold 0.1 test.h5 > /dev/null 2>&1 || { echo "locus: index failed" ; exit 1; }
+${IBDDB} segments --noheader --treshold 0.1 test.h5 2> /dev/null | sort -k1,1 -k2,2n > segments.txt
+
+# the implicit tree of a chromosome is incomplete when its number of segments is not a power of two
+N=`wc -l < segments.txt`
+cut -f 1 segments.txt | uniq -c | while read COUNT CHROM
+do
+	case "${COUNT}" in
+		1|2|4|8|16|32|64|128|256|512|1024) echo "locus: ${COUNT} segments on chromosome ${CHROM} is a power of two.";;
+	esac
+done
+
+# every marker and some ranges
+awk -F '	' 'BEGIN {srand(23);}
+	{printf("%s\t%d\t%d\n",$1,$2,$2);}
+	END {for(c=1;c<=4;c++) for(i=0;i<20;i++) {s=1+int(rand()*990000);printf("%d\t%d\t%d\n",c,s,s+int(rand()*10000));}}' markers.bed > queries.txt
+
+STATUS=0
+while read CHROM START END
+do
+	${IBDDB} locus --noheader --treshold 0.1 -r "${CHROM}:${START}-${END}" test.h5 2> /dev/null | sort > found.txt
+	awk -F '	' -v C=${CHROM} -v S=${START} -v E=${END} '($1==C && $2 <= E && S < $3)' segments.txt | sort > expect.txt
+	if ! cmp -s found.txt expect.txt
+	then
+		echo "locus: ${CHROM}:${START}-${END} : got `wc -l < found.txt` segments, expected `wc -l < expect.txt`"
+		STATUS=1
+	fi
+done < queries.txt
+
+if [ ${STATUS} -eq 0 ]
+then
+	echo "locus: OK (${N} segments, `wc -l < queries.txt` queries)"
+fi
+exit ${STATUS}